@@ -0,0 +1,806 @@
+// Microbenchmarks for the hot paths, one JSON object per line on stdout:
+//   {"bench":"parse","ops":..,"seconds":..,"ops_per_sec":..,"p50_ns":..,...}
+// Latencies are per operation, timed with readTsc() into a LatencyHistogram.
+//
+// Benches that check what they move, e.g. the byte order through a full socket, also
+// exit non zero when the check fails.
+//
+// usage: tinyfix_bench [--iterations N] [--fds N] [--port N] [bench ...]
+// benches: frame parse encode encode_template epoll_dispatch loopback_rtt
+//          uring_backpressure spsc_queue mpsc_queue reactor_post msg_pool, all by default
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "poller.h"
+#include "socket.h"
+#include "lockfree_queue.h"
+#include "reactor_group.h"
+#include "msg_pool.h"
+#include "tiny_fix_msg.h"
+#include "tiny_fix_msg_template.h"
+#include "tiny_fix_framer.h"
+#include "latency_probe.h"
+
+namespace {
+
+using namespace TinyFix;
+
+// the library logs every fd it registers, not what a benchmark wants to time
+std::ostream quietOut( nullptr );
+
+class BenchEpollerComponents : public DefaultEpollerComponents
+{
+public:
+    constexpr static auto& outStream = quietOut;
+    using OutStreamType = std::ostream;
+};
+
+class BenchSocketComponents : public DefaultSocketComponents
+{
+public:
+    constexpr static auto& outStream = quietOut;
+    using OutStreamType = std::ostream;
+};
+
+class BenchIoUringEpollerComponents : public DefaultIoUringEpollerComponents
+{
+public:
+    constexpr static auto& outStream = quietOut;
+    using OutStreamType = std::ostream;
+};
+
+// the threads of a queue check may share a core, spinning would hold it for a slice
+class BenchQueueComponents : public DefaultLockFreeQueueComponents
+{
+public:
+    using WaitStrategy = YieldWaitStrategy;
+};
+
+class BenchReactorGroupComponents : public DefaultReactorGroupComponents
+{
+public:
+    using EpollerComponents = BenchEpollerComponents;
+    constexpr static auto& outStream = quietOut;
+    using OutStreamType = std::ostream;
+    // small, so posting wraps the ring over and over and keeps finding it full
+    constexpr static size_t TASK_QUEUE_SIZE = 64;
+};
+
+using Clock = std::chrono::steady_clock;
+using Histogram = LatencyHistogram<>;
+using Msg = TinyFixMsgBase<>;
+using MsgView = TinyFixMsgView<>;
+using Framer = TinyFixFramer<>;
+using Socket = TCPSocket<BenchSocketComponents>;
+using NewOrderTemplate = TinyFixMsgTemplate<NewOrderSingleTemplateSchema>;
+
+struct BenchOptions
+{
+    uint64_t iterations = 1000000;
+    int      fds = 1024;
+    int      port = 13898;
+};
+
+// keeps results alive so the optimizer can't drop the work being timed
+volatile uint64_t sink;
+// checks that failed, the exit status
+int failures = 0;
+
+void fail( const char* name, const std::string& what )
+{
+    std::cerr << name << ": " << what << std::endl;
+    failures++;
+}
+
+void report( const char* name, uint64_t ops, double seconds, const Histogram& histogram )
+{
+    LatencySnapshot snap = histogram.snapshot();
+    ::printf( "{\"bench\":\"%s\",\"ops\":%llu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+              "\"samples\":%llu,\"p50_ns\":%.1f,\"p99_ns\":%.1f,\"p999_ns\":%.1f,"
+              "\"max_ns\":%.1f}\n",
+              name,
+              static_cast<unsigned long long>( ops ),
+              seconds,
+              seconds > 0 ? ops / seconds : 0.0,
+              static_cast<unsigned long long>( snap.count ),
+              snap.p50,
+              snap.p99,
+              snap.p999,
+              snap.max );
+    ::fflush( stdout );
+}
+
+// Runs op a tenth of iterations untimed to warm caches and branch predictors, then
+// iterations times with every call timed. op returns the operations it did, e.g. the
+// frames one frame() call found, which is what throughput counts.
+void run( const char* name, uint64_t iterations, const std::function<uint64_t()>& op )
+{
+    for( uint64_t i = 0; i < iterations / 10; i++ )
+    {
+        sink = op();
+    }
+    Histogram         histogram;
+    uint64_t          ops = 0;
+    Clock::time_point start = Clock::now();
+    for( uint64_t i = 0; i < iterations; i++ )
+    {
+        uint64_t begin = readTsc();
+        ops += op();
+        histogram.record( readTsc() - begin );
+    }
+    double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+    report( name, ops, seconds, histogram );
+}
+
+// a NewOrderSingle the way a gateway would send one
+void encodeOrder( Msg& msg, uint64_t seqNum )
+{
+    msg.reset();
+    msg.add_field( 35, "D" );
+    msg.add_field( 49, "SENDER" );
+    msg.add_field( 56, "TARGET" );
+    msg.add_int( 34, static_cast<int64_t>( seqNum ) );
+    msg.add_field( 52, "20240102-09:30:00.123" );
+    msg.add_field( 11, "ORD0000000000001" );
+    msg.add_field( 55, "AAPL" );
+    msg.add_char( 54, '1' );
+    msg.add_field( 60, "20240102-09:30:00.123" );
+    msg.add_int( 38, 100 );
+    msg.add_char( 40, '2' );
+    msg.add_decimal( 44, 18525, 2 );
+    msg.gen_tail();
+}
+
+void benchFrame( const BenchOptions& options )
+{
+    // one read's worth of back to back messages
+    Msg         msg;
+    std::string stream;
+    for( int i = 0; i < Framer::MAX_BATCH; i++ )
+    {
+        encodeOrder( msg, i + 1 );
+        stream.append( msg.get_msg_data(), msg.get_msg_size() );
+    }
+    Framer framer;
+    run( "frame", options.iterations / Framer::MAX_BATCH, [&]() -> uint64_t {
+        framer.frame( stream.data(), stream.size() );
+        return framer.frame_count();
+    } );
+}
+
+void benchParse( const BenchOptions& options )
+{
+    Msg msg;
+    encodeOrder( msg, 1 );
+    std::string data( msg.get_msg_data(), msg.get_msg_size() );
+    MsgView     view;
+    run( "parse", options.iterations, [&]() -> uint64_t {
+        if( !view.parse( data.data(), data.size() ) )
+        {
+            return 0;
+        }
+        int64_t qty = 0;
+        view.get_int( 38, qty );
+        return qty != 0 ? 1 : 0;
+    } );
+}
+
+void benchEncode( const BenchOptions& options )
+{
+    Msg      msg;
+    uint64_t seqNum = 0;
+    run( "encode", options.iterations, [&]() -> uint64_t {
+        encodeOrder( msg, ++seqNum );
+        return msg.get_msg_size() != 0 ? 1 : 0;
+    } );
+}
+
+void benchEncodeTemplate( const BenchOptions& options )
+{
+    using Slot = NewOrderSingleTemplateSchema::Slot;
+    NewOrderTemplate tmpl;
+    tmpl.init( "SENDER", "TARGET" );
+    char     buf[NewOrderTemplate::SIZE];
+    uint64_t seqNum = 0;
+    run( "encode_template", options.iterations, [&]() -> uint64_t {
+        uint16_t size = tmpl.render( buf )
+                            .set_uint( Slot::MsgSeqNum, ++seqNum )
+                            .set_string( Slot::SendingTime, "20240102-09:30:00.123" )
+                            .set_string( Slot::ClOrdID, "ORD0000000000001" )
+                            .set_char( Slot::Side, '1' )
+                            .set_string( Slot::TransactTime, "20240102-09:30:00.123" )
+                            .set_uint( Slot::OrderQty, 100 )
+                            .set_char( Slot::OrdType, '2' )
+                            .set_decimal( Slot::Price, 18525, 2 )
+                            .finish();
+        return size != 0 ? 1 : 0;
+    } );
+}
+
+// options.fds eventfds registered, NUM_EVENTS of them kept readable so every poll()
+// dispatches a full ready set out of a large interest list
+void benchEpollDispatch( const BenchOptions& options )
+{
+    using EpollerType = Epoller<BenchEpollerComponents>;
+    DefaultEpollerConfig config;
+    EpollerType          epoller( config );
+    std::vector<int>     fds;
+    uint64_t             dispatched = 0;
+    for( int i = 0; i < options.fds; i++ )
+    {
+        int fd = ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        if( fd == -1 || !epoller.addEvent( fd, [&dispatched]() { dispatched++; } ) )
+        {
+            std::cerr << "epoll_dispatch: could only register " << i << " fds" << std::endl;
+            if( fd != -1 )
+            {
+                ::close( fd );
+            }
+            break;
+        }
+        fds.push_back( fd );
+    }
+    // level triggered and never read, so these stay ready
+    for( size_t i = 0; i < fds.size(); i += fds.size() / EpollerType::NUM_EVENTS + 1 )
+    {
+        uint64_t one = 1;
+        ssize_t  res = ::write( fds[i], &one, sizeof( one ) );
+        (void)res;
+    }
+    run( "epoll_dispatch", options.iterations / EpollerType::NUM_EVENTS, [&]() -> uint64_t {
+        uint64_t before = dispatched;
+        epoller.poll();
+        return dispatched - before;
+    } );
+    for( int fd : fds )
+    {
+        epoller.removeEvent( fd );
+        ::close( fd );
+    }
+}
+
+// reads whole FIX messages off socket, calls onFrame for each, false once the peer
+// is gone
+template<typename FrameHandlerT>
+bool readFrames( Socket& socket, Framer& framer, FrameHandlerT&& onFrame )
+{
+    if( socket.recv() <= 0 )
+    {
+        return false;
+    }
+    auto&  buf = socket.buf();
+    size_t consumed = framer.frame( buf.readHead(), buf.readable() );
+    for( const TinyFixFrame& frame : framer )
+    {
+        onFrame( frame );
+    }
+    buf.consume( consumed );
+    return true;
+}
+
+// client and an echo server over 127.0.0.1, both TCPSocket; one op is a message sent
+// and the same message read back
+void benchLoopbackRtt( const BenchOptions& options )
+{
+    DefaultSocketConfig config( options.port, "127.0.0.1", true, false, true );
+    Socket              server( config );
+    if( !server.create() || !server.setReUseAddr() || !server.setSockaddrIn() ||
+        !server.bind() || !server.listen() )
+    {
+        std::cerr << "loopback_rtt: can't listen on port " << options.port << std::endl;
+        return;
+    }
+    std::thread echo( [&server, &config]() {
+        Socket peer( config );
+        peer.setFd( server.accept() );
+        if( peer.getFd() == -1 || !peer.tune() )
+        {
+            return;
+        }
+        Framer framer;
+        while( readFrames( peer, framer, [&peer]( const TinyFixFrame& frame ) {
+            peer.send( frame.data, frame.size );
+        } ) )
+        {
+        }
+    } );
+
+    Socket client( config );
+    if( !client.create() || !client.setSockaddrIn() || !client.connect() )
+    {
+        std::cerr << "loopback_rtt: can't connect to port " << options.port << std::endl;
+        server.release();
+        echo.join();
+        return;
+    }
+    Msg      msg;
+    Framer   framer;
+    uint64_t seqNum = 0;
+    // a round trip is tens of microseconds, a full iteration count would take minutes
+    run( "loopback_rtt", options.iterations / 100 + 1, [&]() -> uint64_t {
+        encodeOrder( msg, ++seqNum );
+        if( client.send( msg.get_msg_data(), msg.get_msg_size() ) <= 0 )
+        {
+            return 0;
+        }
+        uint64_t echoed = 0;
+        while( echoed == 0 &&
+               readFrames( client, framer, [&echoed]( const TinyFixFrame& ) { echoed++; } ) )
+        {
+        }
+        return echoed;
+    } );
+    client.release();
+    echo.join();
+}
+
+// byte i of message n in the send pattern, so the reader can tell reordered, torn
+// or repeated bytes from the real stream
+char patternByte( uint64_t n, size_t i )
+{
+    return static_cast<char>( n * 7 + i );
+}
+
+// IoUringEpoller sends into a TCP socket with an 8KB send buffer that a slow reader
+// drains: every write but the first parks in the kernel, short writes are resumed and
+// send() refuses once the slots are all taken, which the sender waits out the way
+// Session does. One op is a message queued; the reader checks the stream byte by byte.
+void benchUringBackpressure( const BenchOptions& options )
+{
+    using EpollerType = IoUringEpoller<BenchIoUringEpollerComponents>;
+    constexpr size_t MSG_SIZE = 4000;
+    DefaultEpollerConfig config;
+    EpollerType          epoller( config );
+    if( epoller.getEpollerFd() == -1 )
+    {
+        std::cerr << "uring_backpressure: io_uring unavailable, skipped" << std::endl;
+        return;
+    }
+    DefaultSocketConfig socketConfig(
+        options.port, "127.0.0.1", true, true, true, 4, 0, false, 8192, 8192 );
+    Socket server( socketConfig );
+    Socket client( socketConfig );
+    if( !server.create() || !server.setReUseAddr() || !server.setSockaddrIn() ||
+        !server.bind() || !server.listen() || !client.create() || !client.setSockaddrIn() ||
+        !client.tune() )
+    {
+        fail( "uring_backpressure", "can't listen on port " + std::to_string( options.port ) );
+        return;
+    }
+    client.connect();
+    int peer = -1;
+    for( int i = 0; i < 1000 && peer == -1; i++ )
+    {
+        peer = server.accept();
+        if( peer == -1 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+    }
+    int rcvBuf = 8192;
+    ::setsockopt( peer, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof( rcvBuf ) );
+    int sendErrors = 0;
+    epoller.addRecv(
+        client.getFd(),
+        [&sendErrors]( const char*, int res ) { sendErrors += res < 0 ? 1 : 0; },
+        []() {} );
+
+    uint64_t bad = 0;
+    uint64_t received = 0;
+    std::thread reader( [&]() {
+        char buf[3000];
+        for( ;; )
+        {
+            ssize_t res = ::recv( peer, buf, sizeof( buf ), 0 );
+            if( res <= 0 )
+            {
+                break;
+            }
+            for( ssize_t i = 0; i < res; i++ )
+            {
+                uint64_t pos = received + static_cast<uint64_t>( i );
+                bad += buf[i] != patternByte( pos / MSG_SIZE, pos % MSG_SIZE ) ? 1 : 0;
+            }
+            received += static_cast<uint64_t>( res );
+            // slower than the sender, so its writes back up
+            std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+        }
+    } );
+
+    char     msg[MSG_SIZE];
+    uint64_t sent = 0;
+    run( "uring_backpressure", options.iterations / 100 + 1, [&]() -> uint64_t {
+        for( size_t i = 0; i < MSG_SIZE; i++ )
+        {
+            msg[i] = patternByte( sent, i );
+        }
+        while( !epoller.send( client.getFd(), msg, MSG_SIZE ) )
+        {
+            if( sendErrors != 0 )
+            {
+                return 0;
+            }
+            epoller.poll();
+        }
+        sent++;
+        return 1;
+    } );
+    while( epoller.sendPending( client.getFd() ) && sendErrors == 0 )
+    {
+        epoller.poll();
+    }
+    // the reader stops at the end of the stream
+    ::shutdown( client.getFd(), SHUT_WR );
+    reader.join();
+    uint64_t total = sent * MSG_SIZE;
+    epoller.removeEvent( client.getFd() );
+    client.release();
+    server.release();
+    ::close( peer );
+    if( sendErrors != 0 || bad != 0 || received != total )
+    {
+        fail( "uring_backpressure",
+              "send errors " + std::to_string( sendErrors ) + ", bad bytes " +
+                  std::to_string( bad ) + ", received " + std::to_string( received ) + " of " +
+                  std::to_string( total ) );
+    }
+}
+
+// slots in the rings the cross-thread checks go through, few so a run wraps them
+// many times over
+constexpr size_t CHECK_QUEUE_SIZE = 64;
+
+// A thread feeds an SPSCQueue in batches of 7, which straddle the end of the ring,
+// while the bench thread pops. One op is an item popped and checked to be the next.
+void benchSpscQueue( const BenchOptions& options )
+{
+    using QueueType = SPSCQueue<uint64_t, BenchQueueComponents>;
+    QueueType   queue( CHECK_QUEUE_SIZE );
+    uint64_t    total = options.iterations + options.iterations / 10;
+    std::thread producer( [&queue, total]() {
+        uint64_t items[7];
+        for( uint64_t next = 0; next < total; )
+        {
+            size_t count = static_cast<size_t>( std::min<uint64_t>( 7, total - next ) );
+            for( size_t i = 0; i < count; i++ )
+            {
+                items[i] = next + i;
+            }
+            for( size_t pushed = 0; pushed < count; )
+            {
+                size_t n = queue.tryPush( items + pushed, count - pushed );
+                if( n == 0 )
+                {
+                    std::this_thread::yield();
+                }
+                pushed += n;
+            }
+            next += count;
+        }
+    } );
+
+    uint64_t expected = 0;
+    uint64_t bad = 0;
+    run( "spsc_queue", options.iterations, [&]() -> uint64_t {
+        uint64_t item;
+        queue.pop( item );
+        bad += item != expected++ ? 1 : 0;
+        return 1;
+    } );
+    producer.join();
+    if( bad != 0 || !queue.empty() )
+    {
+        fail( "spsc_queue", std::to_string( bad ) + " items out of order" );
+    }
+}
+
+// Three threads push into an MPSCQueue, the first in batches of 5 that claim their
+// range together, while the bench thread pops. Items carry their producer in the top
+// byte; one op is an item popped and checked to be that producer's next.
+void benchMpscQueue( const BenchOptions& options )
+{
+    using QueueType = MPSCQueue<uint64_t, BenchQueueComponents>;
+    constexpr int      PRODUCERS = 3;
+    constexpr uint64_t SEQ_MASK = ( uint64_t( 1 ) << 56 ) - 1;
+
+    QueueType                queue( CHECK_QUEUE_SIZE );
+    uint64_t                 total = options.iterations + options.iterations / 10;
+    std::vector<std::thread> producers;
+    for( int p = 0; p < PRODUCERS; p++ )
+    {
+        uint64_t count = total / PRODUCERS + ( static_cast<uint64_t>( p ) < total % PRODUCERS );
+        producers.emplace_back( [&queue, p, count]() {
+            uint64_t tag = static_cast<uint64_t>( p ) << 56;
+            uint64_t items[5];
+            for( uint64_t seq = 0; seq < count; )
+            {
+                if( p != 0 )
+                {
+                    queue.push( tag | seq++ );
+                    continue;
+                }
+                size_t n = static_cast<size_t>( std::min<uint64_t>( 5, count - seq ) );
+                for( size_t i = 0; i < n; i++ )
+                {
+                    items[i] = tag | ( seq + i );
+                }
+                n = queue.tryPush( items, n );
+                if( n == 0 )
+                {
+                    std::this_thread::yield();
+                }
+                seq += n;
+            }
+        } );
+    }
+
+    uint64_t next[PRODUCERS] = {};
+    uint64_t bad = 0;
+    run( "mpsc_queue", options.iterations, [&]() -> uint64_t {
+        uint64_t item;
+        queue.pop( item );
+        uint64_t p = item >> 56;
+        if( p < PRODUCERS && ( item & SEQ_MASK ) == next[p] )
+        {
+            next[p]++;
+        }
+        else
+        {
+            bad++;
+        }
+        return 1;
+    } );
+    for( auto& producer : producers )
+    {
+        producer.join();
+    }
+    if( bad != 0 || !queue.empty() )
+    {
+        fail( "mpsc_queue", std::to_string( bad ) + " items out of order" );
+    }
+}
+
+// The bench thread and one other post into a Reactor whose task queue holds 64, both
+// retrying while it is full. Tasks check they run on the reactor's thread and in
+// posting order per thread. One op is a post() from the bench thread.
+void benchReactorPost( const BenchOptions& options )
+{
+    using ReactorType = Reactor<BenchReactorGroupComponents>;
+    // touched by the tasks only, read here once the reactor is stopped
+    struct State
+    {
+        ReactorType*          reactor;
+        uint64_t              next[2] = {};
+        uint64_t              bad = 0;
+        std::atomic<uint64_t> ran{ 0 };
+
+        // the poster in the top bit, its seq num below
+        void onTask( uint64_t tagged )
+        {
+            uint64_t poster = tagged >> 63;
+            uint64_t seq = tagged & ~( uint64_t( 1 ) << 63 );
+            bad += !reactor->inReactorThread() || seq != next[poster] ? 1 : 0;
+            next[poster] = seq + 1;
+            ran.fetch_add( 1, std::memory_order_release );
+        }
+    };
+    DefaultEpollerConfig epollerConfig;
+    ReactorType          reactor( epollerConfig, 0, -1 );
+    State                state;
+    state.reactor = &reactor;
+    if( !reactor.start() )
+    {
+        fail( "reactor_post", "can't start the reactor" );
+        return;
+    }
+    // a queue that stays full for seconds means the reactor stopped draining it, both
+    // posters give up then
+    std::atomic<bool> stuck{ false };
+    auto              post = [&reactor, &state, &stuck]( uint64_t poster, uint64_t seq ) {
+        // two words of capture, small enough for std::function to keep inline
+        State*            target = &state;
+        uint64_t          tagged = poster << 63 | seq;
+        Clock::time_point deadline = Clock::now() + std::chrono::seconds( 5 );
+        while( !reactor.post( [target, tagged]() { target->onTask( tagged ); } ) )
+        {
+            if( stuck.load( std::memory_order_relaxed ) || Clock::now() > deadline )
+            {
+                stuck.store( true, std::memory_order_relaxed );
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    };
+
+    // a post can wait for the reactor to be scheduled, a full iteration count would
+    // take minutes on a busy machine
+    uint64_t    iterations = options.iterations / 100 + 1;
+    uint64_t    total = iterations + iterations / 10;
+    std::thread other( [&post, total]() {
+        for( uint64_t seq = 0; seq < total && post( 1, seq ); seq++ )
+        {
+        }
+    } );
+    uint64_t seq = 0;
+    run( "reactor_post", iterations, [&]() -> uint64_t { return post( 0, seq++ ) ? 1 : 0; } );
+    other.join();
+    // stop() leaves queued tasks queued, the last ones get a few seconds to run
+    for( int i = 0; i < 5000 && state.ran.load( std::memory_order_acquire ) != 2 * total; i++ )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    reactor.stop();
+    uint64_t ran = state.ran.load( std::memory_order_acquire );
+    if( state.bad != 0 || ran != 2 * total )
+    {
+        fail( "reactor_post",
+              "ran " + std::to_string( ran ) + " of " + std::to_string( 2 * total ) +
+                  " tasks, " + std::to_string( state.bad ) + " out of order or off thread" );
+    }
+}
+
+// The bench thread allocates blocks of three size classes and a message, fills them
+// and hands them to a thread that checks and drops them, so every block goes back
+// through the pool's remote free list. One op is a block and a message handed over;
+// once they come back the pool has to stop mapping memory.
+void benchMsgPool( const BenchOptions& options )
+{
+    using Pool = MsgPool<>;
+    struct Item
+    {
+        Pool::Block block;
+        Pool::Msg   msg;
+        uint64_t    n = 0;
+    };
+    using QueueType = SPSCQueue<Item, BenchQueueComponents>;
+    const size_t sizes[] = { Pool::MIN_BLOCK_SIZE, 4096, Pool::MAX_BLOCK_SIZE };
+    Pool         pool;
+    QueueType    queue( CHECK_QUEUE_SIZE );
+    uint64_t     total = options.iterations + options.iterations / 10;
+    uint64_t     bad = 0;
+    std::thread  releaser( [&]() {
+        Item item;
+        for( uint64_t i = 0; i < total; i++ )
+        {
+            queue.pop( item );
+            size_t size = sizes[item.n % 3];
+            if( !item.block || !item.msg )
+            {
+                bad++;
+                continue;
+            }
+            std::string_view msg( item.msg->get_msg_data(), item.msg->get_msg_size() );
+            std::string      seqNum = "\x01" "34=" + std::to_string( item.n ) + "\x01";
+            if( item.block.data()[0] != patternByte( item.n, 0 ) ||
+                item.block.data()[size - 1] != patternByte( item.n, size - 1 ) ||
+                msg.find( seqNum ) == std::string_view::npos )
+            {
+                bad++;
+            }
+            // both handles go back from this thread
+            item = Item();
+        }
+    } );
+
+    uint64_t n = 0;
+    run( "msg_pool", options.iterations, [&]() -> uint64_t {
+        Item   item;
+        size_t size = sizes[n % 3];
+        item.n = n++;
+        item.block = pool.allocate( size );
+        item.msg = pool.allocateMsg();
+        if( item.block && item.msg )
+        {
+            item.block.data()[0] = patternByte( item.n, 0 );
+            item.block.data()[size - 1] = patternByte( item.n, size - 1 );
+            encodeOrder( *item.msg, item.n );
+        }
+        queue.push( std::move( item ) );
+        return 1;
+    } );
+    releaser.join();
+
+    // A class only maps a chunk once every block of it is out, and at most the queue,
+    // the item being filled and the one being checked are. Headers are under 1KB.
+    size_t bound = 0;
+    auto   addClass = [&bound]( size_t size, size_t blocksOut ) {
+        size_t perChunk = ( Pool::CHUNK_SIZE - 64 ) / ( size + 1024 );
+        bound += ( blocksOut / perChunk + 1 ) * Pool::CHUNK_SIZE;
+    };
+    addClass( sizes[0], 2 * ( CHECK_QUEUE_SIZE + 2 ) ); // the messages are this size too
+    addClass( sizes[1], CHECK_QUEUE_SIZE + 2 );
+    addClass( sizes[2], CHECK_QUEUE_SIZE + 2 );
+    if( bad != 0 || pool.getMappedBytes() > bound )
+    {
+        fail( "msg_pool",
+              std::to_string( bad ) + " blocks lost or corrupted, mapped " +
+                  std::to_string( pool.getMappedBytes() ) + " bytes, expected at most " +
+                  std::to_string( bound ) );
+    }
+}
+
+struct Bench
+{
+    const char* name;
+    void ( *run )( const BenchOptions& );
+};
+
+const Bench benches[] = {
+    { "frame", benchFrame },
+    { "parse", benchParse },
+    { "encode", benchEncode },
+    { "encode_template", benchEncodeTemplate },
+    { "epoll_dispatch", benchEpollDispatch },
+    { "loopback_rtt", benchLoopbackRtt },
+    { "uring_backpressure", benchUringBackpressure },
+    { "spsc_queue", benchSpscQueue },
+    { "mpsc_queue", benchMpscQueue },
+    { "reactor_post", benchReactorPost },
+    { "msg_pool", benchMsgPool },
+};
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    BenchOptions             options;
+    std::vector<std::string> selected;
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if( arg == "--iterations" && i + 1 < argc )
+        {
+            options.iterations = ::strtoull( argv[++i], nullptr, 10 );
+        }
+        else if( arg == "--fds" && i + 1 < argc )
+        {
+            options.fds = ::atoi( argv[++i] );
+        }
+        else if( arg == "--port" && i + 1 < argc )
+        {
+            options.port = ::atoi( argv[++i] );
+        }
+        else if( arg.compare( 0, 2, "--" ) == 0 )
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--iterations N] [--fds N] [--port N] [bench ...]" << std::endl;
+            return 1;
+        }
+        else
+        {
+            selected.push_back( arg );
+        }
+    }
+    // calibrate the tick length before anything is timed
+    tscNanosPerTick();
+    for( const Bench& bench : benches )
+    {
+        bool wanted = selected.empty();
+        for( const std::string& name : selected )
+        {
+            wanted = wanted || name == bench.name;
+        }
+        if( wanted )
+        {
+            bench.run( options );
+        }
+    }
+    return failures != 0 ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "poller.h"
+#include "socket.h"
+#include "timer_wheel.h"
+#include "session.h"
+#include "acceptor_misc.h"
+
+namespace TinyFix {
+
+// TCP listener on one Epoller. The socket is bound with SO_REUSEPORT, so every
+// reactor of a ReactorGroup can run its own Acceptor on the same port and the kernel
+// spreads incoming connections over them; a reconnect storm is accepted on all
+// cores at once instead of through one accept() loop. Connections are taken with
+// accept4(), tuned with the socket config's option profile and handed to the
+// Handler on the same thread, which puts the session on the same Epoller (or post()s
+// the fd to another reactor).
+// start() registers the listener, so call it on the Epoller's thread or before the
+// reactor is started.
+template<typename AcceptorComponentsT = DefaultAcceptorComponents>
+class Acceptor
+{
+public:
+    using SocketType = TCPSocket<typename AcceptorComponentsT::SocketComponents>;
+    using EpollerType = Poller<typename AcceptorComponentsT::EpollerComponents>;
+    using TimerWheelType = TimerWheel<typename AcceptorComponentsT::TimerWheelComponents>;
+    using TimerNodeType = typename TimerWheelType::Node;
+    using Handler = typename AcceptorComponentsT::Handler;
+    using OutType = typename AcceptorComponentsT::OutStreamType;
+    constexpr static auto& out = AcceptorComponentsT::outStream;
+    constexpr static int   MAX_ACCEPTS_PER_EVENT = AcceptorComponentsT::MAX_ACCEPTS_PER_EVENT;
+    constexpr static int   ACCEPT_BACKOFF_MILLIS = AcceptorComponentsT::ACCEPT_BACKOFF_MILLIS;
+
+    Acceptor( Acceptor& ) = delete;
+    Acceptor& operator=( Acceptor& ) = delete;
+
+    // config gives the listen address, port and backlog, and the option profile
+    // accepted connections are tuned with; timerWheel runs on epoller's
+    // thread and re-arms the listener after a pause, see pause()
+    Acceptor( SocketConfigBase& config,
+              EpollerType&      epoller,
+              TimerWheelType&   timerWheel,
+              Handler&          handler )
+        : m_socket( config )
+        , m_peer( config )
+        , m_epoller( epoller )
+        , m_timerWheel( timerWheel )
+        , m_handler( handler )
+        , m_accepted( 0 )
+        , m_pauses( 0 )
+    {
+        m_resumeTimer.callback = [this]() { resume(); };
+    }
+
+    virtual ~Acceptor()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        if( m_socket.getFd() != -1 )
+        {
+            return false;
+        }
+        // the listener is non blocking whatever the config says, the accept loop
+        // stops on EAGAIN
+        if( !m_socket.create( SOCK_NONBLOCK | SOCK_CLOEXEC ) || !m_socket.setReUseAddr() ||
+            !m_socket.setReUsePort() || !m_socket.setSockaddrIn() || !m_socket.bind() ||
+            !m_socket.listen() ||
+            !m_epoller.addEvent( m_socket.getFd(), [this]() { onReadable(); } ) )
+        {
+            out << "acceptor on port " << m_socket.getConfig().getPort() << " start failed"
+                << std::endl;
+            m_socket.release();
+            return false;
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        m_timerWheel.cancel( m_resumeTimer );
+        m_pauses = 0;
+        if( m_socket.getFd() != -1 )
+        {
+            m_epoller.removeEvent( m_socket.getFd() );
+            m_socket.release();
+        }
+    }
+
+    SocketType& getSocket()
+    {
+        return m_socket;
+    }
+
+    EpollerType& getEpoller()
+    {
+        return m_epoller;
+    }
+
+    // what tune() made of the fd being handed to Handler::onAccept(), for
+    // Session::accept( fd, tuning )
+    const SocketTuningReport& getPeerTuning() const
+    {
+        return m_peer.getTuning();
+    }
+
+    // connections handed to the Handler so far
+    uint64_t getAccepted() const
+    {
+        return m_accepted;
+    }
+
+private:
+    void onReadable()
+    {
+        for( int i = 0; i < MAX_ACCEPTS_PER_EVENT; i++ )
+        {
+            struct sockaddr_in peer;
+            int                fd = m_socket.accept4( peer );
+            if( fd == -1 )
+            {
+                // the client gave up while queued, the next one may be fine
+                if( errno == ECONNABORTED || errno == EINTR )
+                {
+                    continue;
+                }
+                if( errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM )
+                {
+                    pause( errno );
+                }
+                return;
+            }
+            if( m_pauses != 0 )
+            {
+                out << "acceptor on port " << m_socket.getConfig().getPort()
+                    << " accepting again after " << m_pauses << " pauses" << std::endl;
+                m_pauses = 0;
+            }
+            m_peer.setFd( fd );
+            bool tuned = m_peer.tune();
+            m_peer.setFd( -1 );
+            if( !tuned )
+            {
+                // tune() logged what the kernel refused
+                ::close( fd );
+                continue;
+            }
+            m_accepted++;
+            m_handler.onAccept( *this, fd, peer );
+        }
+    }
+
+    // Out of fds or socket memory. The connection stays queued, so the level triggered
+    // listener would fire again at once and spin the loop; it is taken off the Epoller
+    // for ACCEPT_BACKOFF_MILLIS instead. Logged once until an accept succeeds again.
+    void pause( int error )
+    {
+        if( m_pauses++ == 0 )
+        {
+            out << "acceptor on port " << m_socket.getConfig().getPort()
+                << " paused: " << ::strerror( error ) << ", retrying every "
+                << ACCEPT_BACKOFF_MILLIS << "ms" << std::endl;
+        }
+        m_epoller.modifyEvent( m_socket.getFd(), 0 );
+        m_timerWheel.schedule( m_resumeTimer, ACCEPT_BACKOFF_MILLIS );
+    }
+
+    void resume()
+    {
+        if( m_socket.getFd() != -1 )
+        {
+            m_epoller.modifyEvent( m_socket.getFd(), EpollerType::EPOLL_MODE );
+        }
+    }
+
+    SocketType      m_socket;
+    // tunes accepted fds, it never owns one
+    SocketType      m_peer;
+    EpollerType&    m_epoller;
+    TimerWheelType& m_timerWheel;
+    Handler&        m_handler;
+    uint64_t        m_accepted;
+    // pauses since the last accepted connection
+    uint64_t        m_pauses;
+    TimerNodeType   m_resumeTimer;
+};
+
+} // namespace TinyFix
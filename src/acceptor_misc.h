@@ -0,0 +1,70 @@
+#pragma once
+
+#include <iostream>
+#include <functional>
+#include <stdint.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "epoller_misc.h"
+#include "socket_misc.h"
+#include "timer_wheel_misc.h"
+#include "session_misc.h"
+
+namespace TinyFix {
+
+template<typename SessionComponentsT>
+class Session;
+
+// Acceptor handler, called on the thread that runs the acceptor's Epoller. Every
+// connection goes to the session factory returns for it, which puts the fd on its
+// Epoller (that has to be the acceptor's) and waits for the Logon. A connection
+// without a free session is logged and closed.
+// A Handler of one's own gets onAccept( acceptor, fd, peer ) with a connected fd that
+// is non blocking, close-on-exec and tuned with the acceptor's socket config; it owns
+// the fd from then on.
+template<typename SessionT>
+struct SessionAcceptorHandler
+{
+    using SessionFactory = std::function<SessionT*( const struct sockaddr_in& )>;
+
+    SessionFactory factory;
+
+    template<typename AcceptorT>
+    void onAccept( AcceptorT& acceptor, int fd, const struct sockaddr_in& peer )
+    {
+        SessionT* session = factory ? factory( peer ) : nullptr;
+        if( session != nullptr && session->getState() == SessionState::Disconnected )
+        {
+            // the session owns fd from here, it closes it if it can't start
+            session->accept( fd, acceptor.getPeerTuning() );
+            return;
+        }
+        char ip[INET_ADDRSTRLEN] = {};
+        ::inet_ntop( AF_INET, &peer.sin_addr, ip, sizeof( ip ) );
+        AcceptorT::out << "acceptor on port " << acceptor.getSocket().getConfig().getPort()
+                       << ": no session for " << ip << ":" << ntohs( peer.sin_port )
+                       << ", refused" << std::endl;
+        ::close( fd );
+    }
+};
+
+class DefaultAcceptorComponents
+{
+public:
+    using SocketComponents = DefaultSocketComponents;
+    using EpollerComponents = DefaultEpollerComponents;
+    using TimerWheelComponents = DefaultTimerWheelComponents;
+    using Handler = SessionAcceptorHandler<Session<DefaultSessionComponents>>;
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // connections taken per wake-up; the listener is level triggered, so whatever is
+    // left fires again after the sessions on the same loop had their turn
+    constexpr static int MAX_ACCEPTS_PER_EVENT = 64;
+    // how long the listener is left alone once accept() runs out of fds or memory
+    constexpr static int ACCEPT_BACKOFF_MILLIS = 100;
+};
+
+} // namespace TinyFix
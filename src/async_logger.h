@@ -0,0 +1,552 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "lockfree_queue.h"
+
+namespace TinyFix {
+
+class DefaultAsyncLoggerComponents
+{
+public:
+    // one log statement, arguments past it are dropped and the line is marked
+    constexpr static size_t RECORD_SIZE = 256;
+    // records buffered per logging thread, a statement is dropped when its ring is full
+    constexpr static size_t RING_SIZE = 1024;
+    // how long the writer thread sleeps once every ring is empty
+    constexpr static int DRAIN_INTERVAL_MICROS = 1000;
+    // size of the text the writer formats into before each write()
+    constexpr static size_t WRITE_BUF_SIZE = 64 * 1024;
+    using QueueComponents = DefaultLockFreeQueueComponents;
+};
+
+// A string that outlives every AsyncLogger, e.g. a literal, logged as a pointer
+// instead of a copy of its bytes: out << LogLiteral( "order sent" ) << ...
+struct LogLiteral
+{
+    template<size_t N>
+    explicit constexpr LogLiteral( const char ( &literal )[N] )
+        : str( literal )
+        , size( N )
+    {
+    }
+
+    const char* str;
+    size_t      size;
+};
+
+// Drop-in for std::cout in the Components' outStream slot:
+//
+//     using OutStreamType = AsyncLogger<>;
+//     constexpr static auto& outStream = asyncLog;
+//
+// A statement "out << a << b << std::endl" is encoded as typed binary arguments into
+// one fixed size record, std::endl hands the record to the calling thread's SPSC
+// ring and returns; nothing is formatted, flushed or written on the logging thread.
+// A background thread drains every ring, formats the records and write()s them out.
+// Everything is stored by value, char arrays included since a stack buffer would be
+// gone by the time the writer gets to it; LogLiteral stores just the pointer.
+// int8_t and uint8_t print as characters, as they do on an ostream.
+// A full ring drops the statement and counts it in getDropped(), the hot path never
+// waits for the writer. The logger must outlive every thread logging through it.
+template<typename AsyncLoggerComponentsT = DefaultAsyncLoggerComponents>
+class AsyncLogger
+{
+public:
+    constexpr static size_t RECORD_SIZE = AsyncLoggerComponentsT::RECORD_SIZE;
+    constexpr static size_t RING_SIZE = AsyncLoggerComponentsT::RING_SIZE;
+    constexpr static int    DRAIN_INTERVAL_MICROS = AsyncLoggerComponentsT::DRAIN_INTERVAL_MICROS;
+    constexpr static size_t WRITE_BUF_SIZE = AsyncLoggerComponentsT::WRITE_BUF_SIZE;
+
+    using Manipulator = std::ostream& (*)( std::ostream& );
+
+    AsyncLogger( const AsyncLogger& ) = delete;
+    AsyncLogger& operator=( const AsyncLogger& ) = delete;
+
+    AsyncLogger( int fd = STDOUT_FILENO )
+        : m_fd( fd )
+        , m_ownsFd( false )
+        , m_buffers( nullptr )
+        , m_running( false )
+        , m_passes( 0 )
+        , m_dropped( 0 )
+    {
+    }
+
+    virtual ~AsyncLogger()
+    {
+        stop();
+        ThreadBuffer* buffer = m_buffers.load( std::memory_order_relaxed );
+        while( buffer != nullptr )
+        {
+            ThreadBuffer* next = buffer->next;
+            delete buffer;
+            buffer = next;
+        }
+        if( m_ownsFd )
+        {
+            ::close( m_fd );
+        }
+    }
+
+    // appends to path instead of stdout; call before anything is logged
+    bool open( const std::string& path )
+    {
+        int fd = ::open( path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+        if( fd == -1 )
+        {
+            return false;
+        }
+        if( m_ownsFd )
+        {
+            ::close( m_fd );
+        }
+        m_fd = fd;
+        m_ownsFd = true;
+        return true;
+    }
+
+    // drains what is left and joins the writer; the next statement ended on any
+    // thread starts it again
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if( m_writer.joinable() )
+        {
+            m_running.store( false, std::memory_order_release );
+            m_writer.join();
+        }
+    }
+
+    // waits until every statement completed before the call is written out
+    void flush()
+    {
+        if( !m_running.load( std::memory_order_acquire ) )
+        {
+            return;
+        }
+        // the pass running now may have missed them, the one after can't
+        uint64_t pass = m_passes.load( std::memory_order_acquire );
+        while( m_passes.load( std::memory_order_acquire ) < pass + 2 &&
+               m_running.load( std::memory_order_acquire ) )
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds( DRAIN_INTERVAL_MICROS ) );
+        }
+    }
+
+    // statements lost to full rings
+    uint64_t getDropped() const
+    {
+        return m_dropped.load( std::memory_order_relaxed );
+    }
+
+    // up to the first NUL, as ostream would print it
+    template<size_t N>
+    AsyncLogger& operator<<( const char ( &str )[N] )
+    {
+        return putString( str, ::strnlen( str, N ) );
+    }
+
+    AsyncLogger& operator<<( LogLiteral literal )
+    {
+        return put( ARG_LITERAL, &literal.str, sizeof( literal.str ), literal.size );
+    }
+
+    // a template so that char arrays prefer the array overload above
+    template<typename T>
+    typename std::enable_if<std::is_same<T, const char*>::value || std::is_same<T, char*>::value,
+                            AsyncLogger&>::type
+    operator<<( T str )
+    {
+        return str != nullptr ? putString( str, ::strlen( str ) ) : putString( "(null)", 6 );
+    }
+
+    AsyncLogger& operator<<( std::string_view str )
+    {
+        return putString( str.data(), str.size() );
+    }
+
+    AsyncLogger& operator<<( const std::string& str )
+    {
+        return putString( str.data(), str.size() );
+    }
+
+    AsyncLogger& operator<<( char c )
+    {
+        return put( ARG_CHAR, &c, sizeof( c ) );
+    }
+
+    AsyncLogger& operator<<( bool value )
+    {
+        int64_t v = value ? 1 : 0;
+        return put( ARG_INT, &v, sizeof( v ) );
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value, AsyncLogger&>::type operator<<( T value )
+    {
+        if( std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value )
+        {
+            char c = static_cast<char>( value );
+            return put( ARG_CHAR, &c, sizeof( c ) );
+        }
+        if( std::is_signed<T>::value )
+        {
+            int64_t v = static_cast<int64_t>( value );
+            return put( ARG_INT, &v, sizeof( v ) );
+        }
+        uint64_t v = static_cast<uint64_t>( value );
+        return put( ARG_UINT, &v, sizeof( v ) );
+    }
+
+    AsyncLogger& operator<<( double value )
+    {
+        return put( ARG_DOUBLE, &value, sizeof( value ) );
+    }
+
+    AsyncLogger& operator<<( const void* ptr )
+    {
+        return put( ARG_POINTER, &ptr, sizeof( ptr ) );
+    }
+
+    // std::endl ends the statement with a newline, std::flush without one
+    AsyncLogger& operator<<( Manipulator manip )
+    {
+        ThreadBuffer& buffer = local();
+        Record&       record = buffer.pending;
+        if( manip == static_cast<Manipulator>( std::endl<char, std::char_traits<char>> ) )
+        {
+            record.newline = true;
+        }
+        else if( manip != static_cast<Manipulator>( std::flush<char, std::char_traits<char>> ) )
+        {
+            // formatting state (std::hex, ...) is not carried over
+            return *this;
+        }
+        if( record.size != 0 || record.newline )
+        {
+            if( !buffer.ring.tryPush( record ) )
+            {
+                m_dropped.fetch_add( 1, std::memory_order_relaxed );
+            }
+            record.size = 0;
+            record.truncated = false;
+            record.newline = false;
+            if( !m_running.load( std::memory_order_acquire ) )
+            {
+                // stopped since this thread attached
+                std::lock_guard<std::mutex> lock( m_mutex );
+                startWriter();
+            }
+        }
+        return *this;
+    }
+
+private:
+    enum ArgType : uint8_t
+    {
+        ARG_LITERAL = 0, // LogLiteral: pointer and array size
+        ARG_STRING,      // uint16 length and the bytes
+        ARG_CHAR,
+        ARG_INT,
+        ARG_UINT,
+        ARG_DOUBLE,
+        ARG_POINTER,
+    };
+
+    struct Record
+    {
+        uint16_t size = 0;
+        bool     truncated = false;
+        bool     newline = false; // ended by std::endl
+        char     data[RECORD_SIZE - 4];
+    };
+
+    // one per logging thread, found again by thread id; a thread id is only reused
+    // once its thread is gone, so every ring keeps a single producer
+    struct ThreadBuffer
+    {
+        ThreadBuffer( std::thread::id id )
+            : owner( id )
+            , ring( RING_SIZE )
+            , next( nullptr )
+        {
+        }
+
+        std::thread::id          owner;
+        SPSCQueue<Record, typename AsyncLoggerComponentsT::QueueComponents> ring;
+        Record                   pending;
+        ThreadBuffer*            next;
+    };
+
+    ThreadBuffer& local()
+    {
+        // one slot per thread and logger type; a thread logging to two loggers of the
+        // same type looks the other one up in the list on every switch
+        thread_local AsyncLogger*   cachedLogger = nullptr;
+        thread_local ThreadBuffer*  cachedBuffer = nullptr;
+        if( cachedLogger != this )
+        {
+            cachedBuffer = attach();
+            cachedLogger = this;
+        }
+        return *cachedBuffer;
+    }
+
+    // finds or creates the calling thread's buffer, the writer is started with the
+    // first one
+    ThreadBuffer* attach()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        std::thread::id             id = std::this_thread::get_id();
+        ThreadBuffer*               buffer = m_buffers.load( std::memory_order_relaxed );
+        while( buffer != nullptr && buffer->owner != id )
+        {
+            buffer = buffer->next;
+        }
+        if( buffer == nullptr )
+        {
+            buffer = new ThreadBuffer( id );
+            // pushed at the front, the writer walks the list without the lock
+            buffer->next = m_buffers.load( std::memory_order_relaxed );
+            m_buffers.store( buffer, std::memory_order_release );
+        }
+        startWriter();
+        return buffer;
+    }
+
+    // called with m_mutex held
+    void startWriter()
+    {
+        if( !m_writer.joinable() )
+        {
+            m_running.store( true, std::memory_order_release );
+            m_writer = std::thread( [this]() { run(); } );
+        }
+    }
+
+    AsyncLogger& put( ArgType type, const void* value, size_t size, size_t extra = 0 )
+    {
+        Record& record = local().pending;
+        size_t  need = 1 + size + ( type == ARG_LITERAL ? sizeof( uint16_t ) : 0 );
+        if( record.size + need > sizeof( record.data ) )
+        {
+            record.truncated = true;
+            return *this;
+        }
+        char* p = record.data + record.size;
+        *p++ = static_cast<char>( type );
+        ::memcpy( p, value, size );
+        p += size;
+        if( type == ARG_LITERAL )
+        {
+            uint16_t n = static_cast<uint16_t>( extra );
+            ::memcpy( p, &n, sizeof( n ) );
+            p += sizeof( n );
+        }
+        record.size = static_cast<uint16_t>( p - record.data );
+        return *this;
+    }
+
+    AsyncLogger& putString( const char* str, size_t len )
+    {
+        Record& record = local().pending;
+        size_t  room = sizeof( record.data ) - record.size;
+        if( room < 1 + sizeof( uint16_t ) + 1 )
+        {
+            record.truncated = true;
+            return *this;
+        }
+        size_t n = len;
+        if( n > room - 1 - sizeof( uint16_t ) )
+        {
+            n = room - 1 - sizeof( uint16_t );
+            record.truncated = true;
+        }
+        char* p = record.data + record.size;
+        *p++ = static_cast<char>( ARG_STRING );
+        uint16_t n16 = static_cast<uint16_t>( n );
+        ::memcpy( p, &n16, sizeof( n16 ) );
+        p += sizeof( n16 );
+        ::memcpy( p, str, n );
+        record.size = static_cast<uint16_t>( p + n - record.data );
+        return *this;
+    }
+
+    void run()
+    {
+        for( ;; )
+        {
+            bool   running = m_running.load( std::memory_order_acquire );
+            size_t count = 0;
+            for( ThreadBuffer* buffer = m_buffers.load( std::memory_order_acquire );
+                 buffer != nullptr;
+                 buffer = buffer->next )
+            {
+                count += buffer->ring.consume( [this]( Record& record ) { format( record ); } );
+            }
+            writeOut();
+            m_passes.fetch_add( 1, std::memory_order_release );
+            if( !running )
+            {
+                // that pass started after stop(), everything logged before is out
+                return;
+            }
+            if( count == 0 )
+            {
+                std::this_thread::sleep_for( std::chrono::microseconds( DRAIN_INTERVAL_MICROS ) );
+            }
+        }
+    }
+
+    void format( const Record& record )
+    {
+        const char* p = record.data;
+        const char* end = record.data + record.size;
+        while( p < end )
+        {
+            ArgType type = static_cast<ArgType>( *p++ );
+            switch( type )
+            {
+                case ARG_LITERAL:
+                {
+                    const char* str;
+                    uint16_t    n;
+                    ::memcpy( &str, p, sizeof( str ) );
+                    ::memcpy( &n, p + sizeof( str ), sizeof( n ) );
+                    p += sizeof( str ) + sizeof( n );
+                    append( str, ::strnlen( str, n ) );
+                    break;
+                }
+                case ARG_STRING:
+                {
+                    uint16_t n;
+                    ::memcpy( &n, p, sizeof( n ) );
+                    append( p + sizeof( n ), n );
+                    p += sizeof( n ) + n;
+                    break;
+                }
+                case ARG_CHAR:
+                    append( p, 1 );
+                    p++;
+                    break;
+                case ARG_INT:
+                case ARG_UINT:
+                {
+                    char     buf[24];
+                    uint64_t value;
+                    ::memcpy( &value, p, sizeof( value ) );
+                    p += sizeof( value );
+                    auto res = type == ARG_INT
+                                   ? std::to_chars( buf, buf + sizeof( buf ),
+                                                    static_cast<int64_t>( value ) )
+                                   : std::to_chars( buf, buf + sizeof( buf ), value );
+                    append( buf, res.ptr - buf );
+                    break;
+                }
+                case ARG_DOUBLE:
+                case ARG_POINTER:
+                {
+                    char buf[32];
+                    int  n;
+                    if( type == ARG_DOUBLE )
+                    {
+                        double value;
+                        ::memcpy( &value, p, sizeof( value ) );
+                        p += sizeof( value );
+                        // what std::ostream prints by default
+                        n = ::snprintf( buf, sizeof( buf ), "%g", value );
+                    }
+                    else
+                    {
+                        const void* value;
+                        ::memcpy( &value, p, sizeof( value ) );
+                        p += sizeof( value );
+                        n = ::snprintf( buf, sizeof( buf ), "%p", value );
+                    }
+                    append( buf, static_cast<size_t>( n ) );
+                    break;
+                }
+                default:
+                    p = end;
+                    break;
+            }
+        }
+        if( record.truncated )
+        {
+            append( " [truncated]", 12 );
+        }
+        if( record.newline )
+        {
+            append( "\n", 1 );
+        }
+    }
+
+    void append( const char* data, size_t size )
+    {
+        if( m_textSize + size > WRITE_BUF_SIZE )
+        {
+            writeOut();
+        }
+        if( size > WRITE_BUF_SIZE )
+        {
+            size = WRITE_BUF_SIZE;
+        }
+        ::memcpy( m_text + m_textSize, data, size );
+        m_textSize += size;
+    }
+
+    void writeOut()
+    {
+        size_t done = 0;
+        while( done < m_textSize )
+        {
+            ssize_t res = ::write( m_fd, m_text + done, m_textSize - done );
+            if( res < 0 )
+            {
+                if( errno == EINTR )
+                {
+                    continue;
+                }
+                // nowhere left to report it
+                break;
+            }
+            done += static_cast<size_t>( res );
+        }
+        m_textSize = 0;
+    }
+
+    int         m_fd;
+    bool        m_ownsFd;
+    std::mutex  m_mutex; // thread registration and start / stop
+    std::thread m_writer;
+
+    std::atomic<ThreadBuffer*> m_buffers;
+    std::atomic<bool>          m_running;
+    std::atomic<uint64_t>      m_passes;
+    std::atomic<uint64_t>      m_dropped;
+
+    // writer thread only
+    char   m_text[WRITE_BUF_SIZE];
+    size_t m_textSize = 0;
+};
+
+// process wide logger for the Components' outStream slot
+inline AsyncLogger<> asyncLog;
+
+} // namespace TinyFix
@@ -1,11 +1,14 @@
 #pragma once
 
 #include <utility>
+#include <algorithm>
 #include <array>
-#include <map>
+#include <vector>
 #include <functional>
+#include <chrono>
 
 #include <sys/epoll.h>
+#include <stdint.h>
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -21,12 +24,24 @@ class Epoller
 public:
     constexpr static int EPOLL_MODE = EpollerComponents::EPOLL_MODE;
     constexpr static int NUM_EVENTS = EpollerComponents::NUM_EVENTS;
+    constexpr static int INITIAL_FD_CAPACITY = EpollerComponents::INITIAL_FD_CAPACITY;
+    // fds are only watched for readiness, every read and write is the caller's syscall
+    constexpr static bool NATIVE_IO = false;
     using EpollerFdCallback = typename EpollerComponents::EpollerFdCallback;
     using OutType = typename EpollerComponents::OutStreamType;
     constexpr static auto& out = EpollerComponents::outStream;
 
-    using FdCallbacks = std::map<const int, const EpollerFdCallback>;
+    struct FdSlot
+    {
+        EpollerFdCallback callback;
+        bool              active = false;
+    };
+    // indexed by fd, fds are small dense integers so this stays compact
+    using FdCallbacks = std::vector<FdSlot>;
+    using PendingAdds = std::vector<std::pair<int, EpollerFdCallback>>;
     using EventArray = std::array<struct epoll_event, NUM_EVENTS>;
+    using Tasks = LoopTasks<EpollerFdCallback>;
+    using Task = typename Tasks::Task;
 
     enum EpollFdOperation : int
     {
@@ -41,7 +56,11 @@ public:
     Epoller( EpollerConfigBase& config )
         : m_epollFd( ::epoll_create( 4096 ) )
         , m_epollWaitMilliSecs( config.getNonBlock() ? 0 : -1 )
+        , m_idleWaitMilliSecs( config.getIdleWaitMillis() )
+        , m_spinNanos( static_cast<int64_t>( config.getSpinMicros() ) * 1000 )
         , m_countReadyFds( 0 )
+        , m_dispatching( false )
+        , m_callbacks( INITIAL_FD_CAPACITY )
     {
     }
 
@@ -53,6 +72,12 @@ public:
     void setWaitSec( int waitSec )
     {
         m_epollWaitMilliSecs = waitSec * 1000;
+        m_idleWaitMilliSecs = waitSec * 1000;
+    }
+
+    void setSpinMicros( int spinMicros )
+    {
+        m_spinNanos = static_cast<int64_t>( spinMicros ) * 1000;
     }
 
     int getEpollerFd() const
@@ -65,6 +90,7 @@ public:
         if( fd < 0 )
         {
             out << "fd error: " << fd << std::endl;
+            return false;
         }
         static EpollFdOperation operation = EpollFdOperation::EPOLL_ADD;
 
@@ -77,8 +103,17 @@ public:
             return false;
         }
         out << "Epoller Add fd success. fd: " << fd << std::endl;
-        m_callbacks.insert( std::pair<const int, const EpollerFdCallback>( fd, callback ) );
-        // m_callbacks[fd] = callback;
+        // a callback may add fds while poll() is running one; growing the table or
+        // overwriting a slot then could destroy the running callback, so the slot is
+        // filled once the ready set is done. The new fd can't fire before then anyway.
+        if( m_dispatching )
+        {
+            m_pendingAdds.emplace_back( fd, callback );
+        }
+        else
+        {
+            setSlot( fd, callback );
+        }
         return true;
     }
 
@@ -87,8 +122,9 @@ public:
         if( fd < 0 )
         {
             out << "fd error: " << fd << std::endl;
+            return false;
         }
-        static EpollFdOperation operation = EPOLL_CTL_DEL;
+        static EpollFdOperation operation = EPOLL_DEL;
 
         struct epoll_event ev;
         ev.data.fd = fd;
@@ -98,13 +134,62 @@ public:
             out << "Epoller remove fd failed. fd: " << fd << std::endl;
             return false;
         }
-        m_callbacks.erase( fd );
+        // the callable itself is left in place, it may be the one running right now;
+        // the next addEvent() on this fd overwrites it
+        if( static_cast<size_t>( fd ) < m_callbacks.size() )
+        {
+            m_callbacks[fd].active = false;
+        }
+        for( auto it = m_pendingAdds.begin(); it != m_pendingAdds.end(); )
+        {
+            it = it->first == fd ? m_pendingAdds.erase( it ) : it + 1;
+        }
+        return true;
+    }
+
+    // changes the events watched on an added fd, e.g. EPOLL_MODE | EPOLLOUT while a
+    // send backlog drains; the fd keeps its callback for both
+    bool modifyEvent( int fd, uint32_t events )
+    {
+        struct epoll_event ev;
+        ev.data.fd = fd;
+        ev.events = events;
+        if( ::epoll_ctl( m_epollFd, static_cast<int>( EPOLL_MOD ), fd, &ev ) == -1 )
+        {
+            out << "Epoller modify fd failed. fd: " << fd << std::endl;
+            return false;
+        }
         return true;
     }
 
+    // Runs task.callback once the ready set being dispatched is done, or, scheduled
+    // outside poll(), before the next poll() waits. Sends from every callback of an
+    // iteration can be flushed together this way.
+    void schedule( Task& task )
+    {
+        m_tasks.schedule( task );
+    }
+
+    void cancel( Task& task )
+    {
+        m_tasks.cancel( task );
+    }
+
     bool poll()
     {
-        m_countReadyFds = ::epoll_wait( m_epollFd, &m_events[0], NUM_EVENTS, m_epollWaitMilliSecs );
+        if( !m_tasks.empty() )
+        {
+            m_tasks.run();
+        }
+        if( m_spinNanos > 0 )
+        {
+            m_countReadyFds = spinWait();
+        }
+        else
+        {
+            m_countReadyFds =
+                ::epoll_wait( m_epollFd, &m_events[0], NUM_EVENTS, m_epollWaitMilliSecs );
+        }
         // std::cout << "m_countReadyFds " << m_countReadyFds << std::endl;
 
         if( m_countReadyFds <= 0 )
@@ -116,36 +201,72 @@ public:
             out << "Exit from epoller: " << errno << " : " << ::strerror( errno ) << std::endl;
             return false;
         }
-        else
+        // dispatch the whole ready set, not just the first fd
+        m_dispatching = true;
+        for( int i = 0; i < m_countReadyFds; i++ )
         {
-            //  std::cout << "m_countReadyFds " << m_countReadyFds << std::endl;
+            const int fd = m_events[i].data.fd;
+            // an earlier callback in this batch may have removed the fd
+            if( static_cast<size_t>( fd ) < m_callbacks.size() && m_callbacks[fd].active )
+            {
+                m_callbacks[fd].callback();
+            }
+        }
+        m_dispatching = false;
 
-            for( int i = 0; i < m_countReadyFds; i++ )
+        if( !m_pendingAdds.empty() )
+        {
+            for( auto& pending : m_pendingAdds )
             {
-                // if( m_events[i].events & EPOLLOUT )
-                // {
-                //     out << m_events[i].data.fd << " : "
-                //         << "EPOLLOUT" << std::endl;
-                // }
-                // if( m_events[i].events & EPOLLIN )
-                // {
-                //     out << m_events[i].data.fd << " : "
-                //         << "EPOLLIN" << std::endl;
-                // }
-                m_callbacks[m_events[i].data.fd]();
-                return true;
+                setSlot( pending.first, pending.second );
             }
+            m_pendingAdds.clear();
         }
-        return false;
+        if( !m_tasks.empty() )
+        {
+            m_tasks.run();
+        }
+        return true;
     }
 
 private:
-    int m_epollFd;
-    int m_epollWaitMilliSecs;
-    int m_countReadyFds;
+    // epoll_wait( 0 ) until something is ready or the budget runs out, then block
+    int spinWait()
+    {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point deadline = Clock::now() + std::chrono::nanoseconds( m_spinNanos );
+        do
+        {
+            int res = ::epoll_wait( m_epollFd, &m_events[0], NUM_EVENTS, 0 );
+            if( res != 0 )
+            {
+                return res;
+            }
+        } while( Clock::now() < deadline );
+        return ::epoll_wait( m_epollFd, &m_events[0], NUM_EVENTS, m_idleWaitMilliSecs );
+    }
+
+    void setSlot( const int fd, const EpollerFdCallback& callback )
+    {
+        if( static_cast<size_t>( fd ) >= m_callbacks.size() )
+        {
+            m_callbacks.resize( std::max( m_callbacks.size() * 2, static_cast<size_t>( fd ) + 1 ) );
+        }
+        m_callbacks[fd].callback = callback;
+        m_callbacks[fd].active = true;
+    }
+
+    int     m_epollFd;
+    int     m_epollWaitMilliSecs;
+    int     m_idleWaitMilliSecs;
+    int64_t m_spinNanos; // 0 disables the spin phase
+    int     m_countReadyFds;
+    bool    m_dispatching;
 
     EventArray  m_events;
     FdCallbacks m_callbacks;
+    PendingAdds m_pendingAdds;
+    Tasks       m_tasks;
 };
 
 } // namespace TinyFix
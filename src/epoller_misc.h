@@ -3,23 +3,114 @@
 #include <iostream>
 #include <sys/epoll.h>
 #include <functional>
+#include <vector>
+#include <stdint.h>
 
 namespace TinyFix {
 
+// the event loop a Components class asks for, see Poller in poller.h
+enum class PollerBackend : uint8_t
+{
+    Epoll = 0,
+    IoUring,
+};
+
 class DefaultEpollerComponents
 {
 public:
+    constexpr static PollerBackend BACKEND = PollerBackend::Epoll;
     constexpr static int   EPOLL_MODE = EPOLLIN;
     constexpr static int   NUM_EVENTS = 8;
+    // initial size of the fd indexed callback table, it grows on demand
+    constexpr static int   INITIAL_FD_CAPACITY = 1024;
     constexpr static auto& outStream = std::cout;
     using OutStreamType = std::ostream;
+    // any default constructible, copyable callable works here; a concrete functor
+    // type instead of std::function lets poll() inline the call
     using EpollerFdCallback = std::function<void( void )>;
 };
 
+// Work a handler wants done once per loop iteration instead of once per event, e.g.
+// flushing a corked send queue after every message of the ready set is handled. The
+// owner keeps the Task alive until it is cancel()ed, as with TimerWheel nodes.
+template<typename CallbackT>
+class LoopTasks
+{
+public:
+    struct Task
+    {
+        CallbackT callback;
+        bool      scheduled = false;
+    };
+
+    // queues task for the next run(), a task already queued is left where it is
+    void schedule( Task& task )
+    {
+        if( !task.scheduled )
+        {
+            task.scheduled = true;
+            m_queued.push_back( &task );
+        }
+    }
+
+    void cancel( Task& task )
+    {
+        if( !task.scheduled )
+        {
+            return;
+        }
+        task.scheduled = false;
+        for( Task*& queued : m_queued )
+        {
+            queued = queued == &task ? nullptr : queued;
+        }
+        for( Task*& running : m_running )
+        {
+            running = running == &task ? nullptr : running;
+        }
+    }
+
+    bool empty() const
+    {
+        return m_queued.empty();
+    }
+
+    // runs what is queued; tasks scheduled from a callback wait for the next run()
+    void run()
+    {
+        m_running.swap( m_queued );
+        for( size_t i = 0; i < m_running.size(); i++ )
+        {
+            Task* task = m_running[i];
+            if( task != nullptr )
+            {
+                task->scheduled = false;
+                task->callback();
+            }
+        }
+        m_running.clear();
+    }
+
+private:
+    std::vector<Task*> m_queued;
+    std::vector<Task*> m_running;
+};
+
 class EpollerConfigBase
 {
 public:
     virtual const bool getNonBlock() = 0;
+    // > 0: poll() spins on a zero timeout epoll_wait for up to this many
+    // microseconds, then falls back to a blocking wait of getIdleWaitMillis()
+    virtual const int getSpinMicros()
+    {
+        return 0;
+    }
+    // blocking wait used once the spin budget is spent, -1 waits forever
+    virtual const int getIdleWaitMillis()
+    {
+        return -1;
+    }
     virtual ~EpollerConfigBase(){};
 };
 
@@ -33,4 +124,32 @@ public:
     virtual ~DefaultEpollerConfig(){};
 };
 
+// spins for a budget on the pinned order path, sleeps in epoll_wait once idle
+class SpinEpollerConfig : public EpollerConfigBase
+{
+public:
+    SpinEpollerConfig( int spinMicros = 50, int idleWaitMillis = -1 )
+        : m_spinMicros( spinMicros )
+        , m_idleWaitMillis( idleWaitMillis )
+    {
+    }
+    virtual const bool getNonBlock()
+    {
+        return false;
+    }
+    virtual const int getSpinMicros()
+    {
+        return m_spinMicros;
+    }
+    virtual const int getIdleWaitMillis()
+    {
+        return m_idleWaitMillis;
+    }
+    virtual ~SpinEpollerConfig(){};
+
+private:
+    const int m_spinMicros;
+    const int m_idleWaitMillis;
+};
+
 } // namespace TinyFix
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+
+#include "poller.h"
+#include "socket.h"
+#include "feed_arbitrator_misc.h"
+
+namespace TinyFix {
+
+// A/B arbitration of one multicast channel published on two redundant feeds.
+// Every packet goes through onPacket(): the first copy of a seq num is handed to the
+// Handler straight away, the copy from the other feed is dropped by a bit test in a
+// sliding window of WINDOW_SIZE seq nums. A seq num both feeds have moved past
+// without delivering is reported once as part of a gap. Packets are not held back,
+// so around a loss on one feed they can reach the Handler out of order.
+// A feed that stops holds gap reports back until the window is full.
+// Nothing on the packet path allocates.
+template<typename FeedArbitratorComponentsT = DefaultFeedArbitratorComponents>
+class FeedArbitrator
+{
+public:
+    using SocketType = MulticastSocket<typename FeedArbitratorComponentsT::SocketComponents>;
+    using BatchType = DatagramBatch<typename FeedArbitratorComponentsT::SocketComponents>;
+    using EpollerType = Poller<typename FeedArbitratorComponentsT::EpollerComponents>;
+    using Handler = typename FeedArbitratorComponentsT::Handler;
+    using OutType = typename FeedArbitratorComponentsT::OutStreamType;
+    constexpr static auto&  out = FeedArbitratorComponentsT::outStream;
+    constexpr static size_t WINDOW_SIZE = FeedArbitratorComponentsT::WINDOW_SIZE;
+    constexpr static size_t WINDOW_WORDS = WINDOW_SIZE / 64;
+
+    static_assert( ( WINDOW_SIZE & ( WINDOW_SIZE - 1 ) ) == 0 && WINDOW_SIZE >= 64,
+                   "WINDOW_SIZE must be a power of two of at least 64" );
+
+    FeedArbitrator( FeedArbitrator& ) = delete;
+    FeedArbitrator& operator=( FeedArbitrator& ) = delete;
+
+    FeedArbitrator( MulticastSocketConfigBase& configA,
+                    MulticastSocketConfigBase& configB,
+                    EpollerType&               epoller,
+                    Handler&                   handler )
+        : m_sockets{ std::make_unique<SocketType>( configA ),
+                     std::make_unique<SocketType>( configB ) }
+        , m_batch( std::make_unique<BatchType>() )
+        , m_epoller( epoller )
+        , m_handler( handler )
+    {
+        reset();
+    }
+
+    virtual ~FeedArbitrator()
+    {
+        stop();
+    }
+
+    // joins both feeds and starts reading them on the Epoller
+    bool start()
+    {
+        for( int feed = FEED_A; feed < FeedSide_Count; feed++ )
+        {
+            SocketType& socket = *m_sockets[feed];
+            if( !socket.create() || !socket.setSockaddrIn() || !socket.bind() ||
+                !socket.joinMulticastGroup() || !socket.setNonBlock() ||
+                !m_epoller.addEvent( socket.getFd(), [this, feed]() {
+                    onReadable( static_cast<FeedSide>( feed ) );
+                } ) )
+            {
+                out << "feed " << static_cast<char>( 'A' + feed ) << " start failed" << std::endl;
+                stop();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        for( auto& socket : m_sockets )
+        {
+            if( socket->getFd() != -1 )
+            {
+                m_epoller.removeEvent( socket->getFd() );
+                socket->release();
+            }
+        }
+    }
+
+    // forgets every seq num seen, e.g. after the venue restarts its sequence
+    void reset()
+    {
+        std::fill( std::begin( m_window ), std::end( m_window ), 0 );
+        m_nextSeq = 0;
+        m_highSeq[FEED_A] = 0;
+        m_highSeq[FEED_B] = 0;
+        m_started = false;
+        m_duplicates = 0;
+        m_gaps = 0;
+        m_missed = 0;
+    }
+
+    // Arbitrates one packet from feed. Public so packets read elsewhere, e.g. by a
+    // recorder replay, can go through the same path.
+    void onPacket( FeedSide feed, const char* data, size_t size )
+    {
+        uint64_t seq;
+        if( !FeedArbitratorComponentsT::sequenceOf( data, size, seq ) )
+        {
+            return;
+        }
+        if( !m_started )
+        {
+            // nothing before the first packet is reported missing
+            m_started = true;
+            m_nextSeq = seq;
+        }
+        // packets arrive in order on each feed, so below the lower of the two
+        // highest seq nums nothing else is coming
+        m_highSeq[feed] = std::max( m_highSeq[feed], seq );
+        if( seq < m_nextSeq || ( seq - m_nextSeq < WINDOW_SIZE && test( seq ) ) )
+        {
+            m_duplicates++;
+            resolve( std::min( m_highSeq[FEED_A], m_highSeq[FEED_B] ) + 1 );
+            return;
+        }
+        if( seq - m_nextSeq >= WINDOW_SIZE )
+        {
+            // the window can't stretch that far: whatever is still missing at its
+            // start is given up on
+            resolve( seq - WINDOW_SIZE + 1 );
+        }
+        set( seq );
+        m_handler.onPacket( *this, data, size, seq, feed );
+        resolve( std::min( m_highSeq[FEED_A], m_highSeq[FEED_B] ) + 1 );
+    }
+
+    SocketType& getSocket( FeedSide feed )
+    {
+        return *m_sockets[feed];
+    }
+
+    // oldest seq num not yet delivered or reported missing
+    uint64_t getNextSeq() const
+    {
+        return m_nextSeq;
+    }
+
+    uint64_t getDuplicates() const
+    {
+        return m_duplicates;
+    }
+
+    uint64_t getGaps() const
+    {
+        return m_gaps;
+    }
+
+    // seq nums reported missing, over all gaps
+    uint64_t getMissed() const
+    {
+        return m_missed;
+    }
+
+private:
+    void onReadable( FeedSide feed )
+    {
+        SocketType& socket = *m_sockets[feed];
+        int         count;
+        do
+        {
+            count = socket.recvBatch( *m_batch );
+            for( int i = 0; i < count; i++ )
+            {
+                const auto& datagram = m_batch->at( i );
+                onPacket( feed, datagram.data, datagram.size );
+            }
+        } while( count == BatchType::BATCH_SIZE );
+    }
+
+    bool test( uint64_t seq ) const
+    {
+        size_t bit = seq & ( WINDOW_SIZE - 1 );
+        return ( m_window[bit / 64] >> ( bit % 64 ) ) & 1;
+    }
+
+    void set( uint64_t seq )
+    {
+        size_t bit = seq & ( WINDOW_SIZE - 1 );
+        m_window[bit / 64] |= uint64_t( 1 ) << ( bit % 64 );
+    }
+
+    // Settles every seq num below upTo: delivered ones leave the window, runs of
+    // missing ones are reported as gaps. Each seq num is settled once. Nothing from
+    // a full window past m_nextSeq on can have been delivered, so a jump further than
+    // that costs one window scan and one gap however far it goes.
+    void resolve( uint64_t upTo )
+    {
+        uint64_t windowEnd = upTo - m_nextSeq > WINDOW_SIZE ? m_nextSeq + WINDOW_SIZE : upTo;
+        while( m_nextSeq < upTo )
+        {
+            size_t    bit = m_nextSeq & ( WINDOW_SIZE - 1 );
+            uint64_t& word = m_window[bit / 64];
+            // a whole word delivered, the common case when the feeds are healthy
+            if( bit % 64 == 0 && upTo - m_nextSeq >= 64 && word == ~uint64_t( 0 ) )
+            {
+                word = 0;
+                m_nextSeq += 64;
+                continue;
+            }
+            if( ( word >> ( bit % 64 ) ) & 1 )
+            {
+                word &= ~( uint64_t( 1 ) << ( bit % 64 ) );
+                m_nextSeq++;
+                continue;
+            }
+            uint64_t begin = m_nextSeq;
+            while( m_nextSeq < windowEnd && !test( m_nextSeq ) )
+            {
+                m_nextSeq++;
+            }
+            if( m_nextSeq == windowEnd )
+            {
+                m_nextSeq = upTo;
+            }
+            m_gaps++;
+            m_missed += m_nextSeq - begin;
+            m_handler.onGap( *this, begin, m_nextSeq - 1 );
+        }
+    }
+
+    std::unique_ptr<SocketType> m_sockets[FeedSide_Count];
+    // recvmmsg slots shared by both feeds, they are read one at a time
+    std::unique_ptr<BatchType>  m_batch;
+    EpollerType&                m_epoller;
+    Handler&                    m_handler;
+
+    uint64_t m_window[WINDOW_WORDS];
+    uint64_t m_nextSeq;
+    uint64_t m_highSeq[FeedSide_Count];
+    bool     m_started;
+    uint64_t m_duplicates;
+    uint64_t m_gaps;
+    uint64_t m_missed;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+
+#include "epoller_misc.h"
+#include "socket_misc.h"
+
+namespace TinyFix {
+
+enum FeedSide : uint8_t
+{
+    FEED_A = 0,
+    FEED_B,
+
+    FeedSide_Count
+};
+
+// Arbitrator callbacks, called on the thread that runs the Epoller.
+// data is only valid during the call.
+struct DefaultFeedHandler
+{
+    // first copy of seq, from whichever feed had it first
+    template<typename ArbitratorT>
+    void onPacket( ArbitratorT&, const char*, size_t, uint64_t, FeedSide )
+    {
+    }
+
+    // [begin, end] was missed on both feeds
+    template<typename ArbitratorT>
+    void onGap( ArbitratorT&, uint64_t, uint64_t )
+    {
+    }
+};
+
+class DefaultFeedArbitratorComponents
+{
+public:
+    using SocketComponents = DefaultSocketComponents;
+    using EpollerComponents = DefaultEpollerComponents;
+    using Handler = DefaultFeedHandler;
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // seq nums tracked past the oldest unresolved one, a power of two; 64K bits is
+    // 8KB of bitmap and covers a feed lagging the other by that many packets
+    constexpr static size_t WINDOW_SIZE = 64 * 1024;
+
+    // packet sequence number, here a little endian uint64 at the front of the packet;
+    // venue formats override this
+    static bool sequenceOf( const char* data, size_t size, uint64_t& seq )
+    {
+        if( size < sizeof( seq ) )
+        {
+            return false;
+        }
+        ::memcpy( &seq, data, sizeof( seq ) );
+        return true;
+    }
+};
+
+} // namespace TinyFix
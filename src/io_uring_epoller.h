@@ -0,0 +1,1095 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "io_uring_epoller_misc.h"
+
+namespace TinyFix {
+
+// io_uring event loop with Epoller's registration surface, so Session, Acceptor,
+// TimerWheel and Reactor run on it unchanged; see Poller in poller.h.
+// addEvent() fds are watched with one-shot POLL_ADDs re-armed after every callback,
+// which keeps epoll's level triggered behaviour. On top of that:
+//   addRecv():  multishot recv into a provided buffer ring, the data is handed to
+//               the callback and no read syscall is made at all
+//   send():     copied into a registered buffer and queued behind fd's other sends
+// Every fd below MAX_FIXED_FILES is a fixed file. Queued work is submitted by the
+// same io_uring_enter that waits for completions, so a loop iteration costs one
+// syscall however many sessions it serves. The kernel parks a write to a full socket
+// and retries it later, so writes to one fd would complete out of order or short if
+// several were in flight. Each fd has at most one: a WRITE_FIXED, or a WRITEV over
+// everything queued behind it since; a short write is resumed where it stopped.
+template<typename IoUringEpollerComponentsT = DefaultIoUringEpollerComponents>
+class IoUringEpoller
+{
+public:
+    constexpr static int      EPOLL_MODE = IoUringEpollerComponentsT::EPOLL_MODE;
+    constexpr static int      INITIAL_FD_CAPACITY = IoUringEpollerComponentsT::INITIAL_FD_CAPACITY;
+    constexpr static unsigned RING_ENTRIES = IoUringEpollerComponentsT::RING_ENTRIES;
+    constexpr static unsigned SETUP_FLAGS = IoUringEpollerComponentsT::SETUP_FLAGS;
+    constexpr static int      MAX_FIXED_FILES = IoUringEpollerComponentsT::MAX_FIXED_FILES;
+    constexpr static unsigned RECV_BUF_COUNT = IoUringEpollerComponentsT::RECV_BUF_COUNT;
+    constexpr static unsigned RECV_BUF_SIZE = IoUringEpollerComponentsT::RECV_BUF_SIZE;
+    constexpr static unsigned SEND_SLOTS = IoUringEpollerComponentsT::SEND_SLOTS;
+    constexpr static unsigned SEND_SLOT_SIZE = IoUringEpollerComponentsT::SEND_SLOT_SIZE;
+    constexpr static unsigned SEND_IOV_MAX = IoUringEpollerComponentsT::SEND_IOV_MAX;
+    // addRecv() and send() are there, Session uses them instead of its own syscalls
+    constexpr static bool NATIVE_IO = true;
+    using EpollerFdCallback = typename IoUringEpollerComponentsT::EpollerFdCallback;
+    using RecvCallback = typename IoUringEpollerComponentsT::RecvCallback;
+    using Tasks = LoopTasks<EpollerFdCallback>;
+    using Task = typename Tasks::Task;
+    using OutType = typename IoUringEpollerComponentsT::OutStreamType;
+    constexpr static auto& out = IoUringEpollerComponentsT::outStream;
+
+    static_assert( ( RECV_BUF_COUNT & ( RECV_BUF_COUNT - 1 ) ) == 0 && RECV_BUF_COUNT <= 32768,
+                   "RECV_BUF_COUNT must be a power of two up to 32768" );
+    static_assert( SEND_SLOTS < 0xFFFF, "SEND_SLOTS must fit in 16 bits" );
+    static_assert( SEND_IOV_MAX > 0, "SEND_IOV_MAX must be at least 1" );
+
+private:
+    // user_data: generation << 32 | fd << 8 | op for fd ops, first slot << 8 | op for sends
+    enum Op : uint8_t
+    {
+        OP_POLL = 1,
+        OP_RECV,
+        OP_SEND,
+        OP_CANCEL,
+    };
+
+    constexpr static uint16_t NO_SLOT = 0xFFFF;
+
+    struct FdSlot
+    {
+        EpollerFdCallback callback;
+        RecvCallback      recv;
+        uint32_t          generation = 0;
+        // what the poll watches; EPOLLIN is left to the recv on addRecv() fds
+        uint32_t          events = 0;
+        bool              active = false;
+        bool              native = false;
+        bool              pollArmed = false;
+        bool              recvArmed = false;
+        // send slots queued for fd in order, the first sendBatch of them are in the
+        // write in flight; sendOffset bytes of the first one are written already
+        uint16_t          sendHead = NO_SLOT;
+        uint16_t          sendTail = NO_SLOT;
+        uint16_t          sendBatch = 0;
+        uint32_t          sendOffset = 0;
+        bool              sendReady = false;     // in m_sendReady
+        bool              sendPollFirst = false; // the last write came back -EAGAIN
+        bool              notifyDrained = false; // see sendPending()
+        struct iovec      sendIov[SEND_IOV_MAX];
+    };
+
+    struct PendingCallbacks
+    {
+        int               fd;
+        uint32_t          generation;
+        EpollerFdCallback callback;
+        RecvCallback      recv;
+    };
+
+    // a queued send, next links it into its fd's queue or into the free list
+    struct SendSlot
+    {
+        int      fd;
+        uint32_t generation;
+        uint32_t size;
+        uint16_t next;
+    };
+
+    struct SendReady
+    {
+        int      fd;
+        uint32_t generation;
+    };
+
+public:
+    IoUringEpoller( IoUringEpoller& ) = delete;
+    IoUringEpoller& operator=( IoUringEpoller& ) = delete;
+
+    IoUringEpoller( EpollerConfigBase& config )
+        : m_ringFd( -1 )
+        , m_waitMilliSecs( config.getNonBlock() ? 0 : -1 )
+        , m_idleWaitMilliSecs( config.getIdleWaitMillis() )
+        , m_spinNanos( static_cast<int64_t>( config.getSpinMicros() ) * 1000 )
+        , m_ringMem( nullptr )
+        , m_ringSize( 0 )
+        , m_sqes( nullptr )
+        , m_sqTail( 0 )
+        , m_recvBufs( nullptr )
+        , m_bufRing( nullptr )
+        , m_bufTail( 0 )
+        , m_sendBufs( nullptr )
+        , m_freeSend( NO_SLOT )
+        , m_fixedFiles( false )
+        , m_dispatching( false )
+    {
+        m_fds.resize( INITIAL_FD_CAPACITY );
+        if( !setup() )
+        {
+            teardown();
+        }
+    }
+
+    virtual ~IoUringEpoller()
+    {
+        teardown();
+    }
+
+    void setWaitSec( int waitSec )
+    {
+        m_waitMilliSecs = waitSec * 1000;
+        m_idleWaitMilliSecs = waitSec * 1000;
+    }
+
+    void setSpinMicros( int spinMicros )
+    {
+        m_spinNanos = static_cast<int64_t>( spinMicros ) * 1000;
+    }
+
+    // the ring's fd, there is no epoll instance
+    int getEpollerFd() const
+    {
+        return m_ringFd;
+    }
+
+    bool addEvent( const int fd, const EpollerFdCallback& callback )
+    {
+        return addFd( fd, callback, RecvCallback(), EPOLL_MODE );
+    }
+
+    // io_uring only: fd's bytes arrive in recv, read by a multishot recv into the
+    // provided buffer ring. callback runs for whatever modifyEvent() adds on top,
+    // e.g. EPOLLOUT while a send backlog drains.
+    bool addRecv( const int fd, const RecvCallback& recv, const EpollerFdCallback& callback )
+    {
+        return addFd( fd, callback, recv, 0 );
+    }
+
+    bool removeEvent( int fd )
+    {
+        if( !registered( fd ) )
+        {
+            out << "IoUringEpoller remove fd failed. fd: " << fd << std::endl;
+            return false;
+        }
+        FdSlot& slot = *m_fds[fd];
+        dropSends( fd, slot );
+        // the last write leaves before fd's fixed file slot can be reused
+        submit();
+        slot.active = false;
+        if( slot.pollArmed )
+        {
+            cancel( fdUserData( fd, slot.generation, OP_POLL ) );
+            slot.pollArmed = false;
+        }
+        if( slot.recvArmed )
+        {
+            cancel( fdUserData( fd, slot.generation, OP_RECV ) );
+            slot.recvArmed = false;
+        }
+        updateFixedFile( fd, -1 );
+        for( auto it = m_pendingCallbacks.begin(); it != m_pendingCallbacks.end(); )
+        {
+            it = it->fd == fd ? m_pendingCallbacks.erase( it ) : it + 1;
+        }
+        return true;
+    }
+
+    // replaces the events watched on fd, e.g. EPOLL_MODE | EPOLLOUT while a send
+    // backlog drains; on addRecv() fds EPOLLIN stays with the recv
+    bool modifyEvent( int fd, uint32_t events )
+    {
+        if( !registered( fd ) )
+        {
+            out << "IoUringEpoller modify fd failed. fd: " << fd << std::endl;
+            return false;
+        }
+        FdSlot& slot = *m_fds[fd];
+        slot.events = slot.native ? events & ~static_cast<uint32_t>( EPOLLIN ) : events;
+        if( slot.pollArmed )
+        {
+            // the poll completes with -ECANCELED and is re-armed with the new mask
+            struct io_uring_sqe* sqe = getSqe();
+            if( sqe == nullptr )
+            {
+                return false;
+            }
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = fdUserData( fd, slot.generation, OP_POLL );
+            sqe->user_data = OP_CANCEL;
+            return true;
+        }
+        return slot.events == 0 || armPoll( fd, slot );
+    }
+
+    // io_uring only: copies data into a registered buffer and queues it behind fd's
+    // other sends, written with the next poll() or flush(). False if it is larger
+    // than a slot, every slot is taken or fd isn't registered; the caller then keeps
+    // the bytes itself and writes them once sendPending() says fd's queue is empty.
+    // A failed write is reported to fd's recv callback later on.
+    bool send( int fd, const char* data, size_t size )
+    {
+        if( size > SEND_SLOT_SIZE || m_freeSend == NO_SLOT || !registered( fd ) )
+        {
+            return false;
+        }
+        FdSlot&   fdSlot = *m_fds[fd];
+        uint16_t  index = m_freeSend;
+        SendSlot& slot = m_sendSlots[index];
+        m_freeSend = slot.next;
+        slot.fd = fd;
+        slot.generation = fdSlot.generation;
+        slot.size = static_cast<uint32_t>( size );
+        slot.next = NO_SLOT;
+        ::memcpy( sendBuf( index ), data, size );
+        if( fdSlot.sendHead == NO_SLOT )
+        {
+            fdSlot.sendHead = index;
+        }
+        else
+        {
+            m_sendSlots[fdSlot.sendTail].next = index;
+        }
+        fdSlot.sendTail = index;
+        markSendReady( fd, fdSlot );
+        return true;
+    }
+
+    // io_uring only: true while sends queued for fd are not all written. fd's
+    // callback then runs once they are, so whatever the caller writes to the socket
+    // directly can wait for it and still go out in order.
+    bool sendPending( int fd )
+    {
+        if( !registered( fd ) || m_fds[fd]->sendHead == NO_SLOT )
+        {
+            return false;
+        }
+        m_fds[fd]->notifyDrained = true;
+        return true;
+    }
+
+    // as Epoller::schedule(), the task runs before the queued work is submitted
+    void schedule( Task& task )
+    {
+        m_tasks.schedule( task );
+    }
+
+    void cancel( Task& task )
+    {
+        m_tasks.cancel( task );
+    }
+
+    // submits everything queued now
+    bool flush()
+    {
+        issueSends();
+        return submit() >= 0;
+    }
+
+    bool poll()
+    {
+        if( m_ringFd == -1 )
+        {
+            return false;
+        }
+        if( !m_tasks.empty() )
+        {
+            m_tasks.run();
+        }
+        issueSends();
+        int res = 0;
+        if( cqReady() == 0 )
+        {
+            res = m_spinNanos > 0 ? spinWait() : wait( m_waitMilliSecs );
+        }
+        else
+        {
+            // completions are waiting already, the queued work still goes out now
+            res = submit();
+        }
+        if( res < 0 && res != -EINTR && res != -ETIME && res != -EAGAIN && res != -EBUSY )
+        {
+            out << "Exit from io_uring epoller: " << -res << " : " << ::strerror( -res )
+                << std::endl;
+            return false;
+        }
+        dispatch();
+        if( !m_tasks.empty() )
+        {
+            m_tasks.run();
+        }
+        return true;
+    }
+
+private:
+    bool registered( int fd ) const
+    {
+        return fd >= 0 && static_cast<size_t>( fd ) < m_fds.size() && m_fds[fd] &&
+               m_fds[fd]->active;
+    }
+
+    static uint64_t fdUserData( int fd, uint32_t generation, Op op )
+    {
+        return static_cast<uint64_t>( generation ) << 32 | static_cast<uint64_t>( fd ) << 8 | op;
+    }
+
+    bool addFd( int                      fd,
+                const EpollerFdCallback& callback,
+                const RecvCallback&      recv,
+                uint32_t                 events )
+    {
+        if( fd < 0 || fd >= ( 1 << 24 ) || m_ringFd == -1 )
+        {
+            out << "fd error: " << fd << std::endl;
+            return false;
+        }
+        if( static_cast<size_t>( fd ) >= m_fds.size() )
+        {
+            m_fds.resize( std::max( m_fds.size() * 2, static_cast<size_t>( fd ) + 1 ) );
+        }
+        if( !m_fds[fd] )
+        {
+            m_fds[fd] = std::make_unique<FdSlot>();
+        }
+        FdSlot& slot = *m_fds[fd];
+        if( slot.active )
+        {
+            out << "IoUringEpoller Add fd failed. fd: " << fd << std::endl;
+            return false;
+        }
+        updateFixedFile( fd, fd );
+        slot.generation++;
+        slot.active = true;
+        slot.native = static_cast<bool>( recv );
+        slot.events = events;
+        slot.pollArmed = false;
+        slot.recvArmed = false;
+        slot.sendHead = NO_SLOT;
+        slot.sendTail = NO_SLOT;
+        slot.sendBatch = 0;
+        slot.sendOffset = 0;
+        slot.sendReady = false;
+        slot.sendPollFirst = false;
+        slot.notifyDrained = false;
+        // a callback may re-add the fd it runs for, its callable is swapped in once
+        // the completions are done. Nothing for the fd completes before then anyway.
+        if( m_dispatching )
+        {
+            m_pendingCallbacks.push_back( { fd, slot.generation, callback, recv } );
+        }
+        else
+        {
+            slot.callback = callback;
+            slot.recv = recv;
+        }
+        if( ( slot.native && !armRecv( fd, slot ) ) || ( events != 0 && !armPoll( fd, slot ) ) )
+        {
+            slot.active = false;
+            updateFixedFile( fd, -1 );
+            return false;
+        }
+        out << "IoUringEpoller Add fd success. fd: " << fd << std::endl;
+        return true;
+    }
+
+    bool armPoll( int fd, FdSlot& slot )
+    {
+        struct io_uring_sqe* sqe = getSqe();
+        if( sqe == nullptr )
+        {
+            return false;
+        }
+        sqe->opcode = IORING_OP_POLL_ADD;
+        setFile( sqe, fd );
+        sqe->poll32_events = slot.events;
+        sqe->user_data = fdUserData( fd, slot.generation, OP_POLL );
+        slot.pollArmed = true;
+        return true;
+    }
+
+    bool armRecv( int fd, FdSlot& slot )
+    {
+        struct io_uring_sqe* sqe = getSqe();
+        if( sqe == nullptr )
+        {
+            return false;
+        }
+        sqe->opcode = IORING_OP_RECV;
+        setFile( sqe, fd );
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->user_data = fdUserData( fd, slot.generation, OP_RECV );
+        slot.recvArmed = true;
+        return true;
+    }
+
+    void cancel( uint64_t userData )
+    {
+        struct io_uring_sqe* sqe = getSqe();
+        if( sqe != nullptr )
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = userData;
+            sqe->user_data = OP_CANCEL;
+        }
+    }
+
+    void setFile( struct io_uring_sqe* sqe, int fd )
+    {
+        if( m_fixedFiles && fd < MAX_FIXED_FILES )
+        {
+            sqe->fd = fd;
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+        else
+        {
+            sqe->fd = fd;
+        }
+    }
+
+    void updateFixedFile( int fd, int file )
+    {
+        if( !m_fixedFiles || fd >= MAX_FIXED_FILES )
+        {
+            return;
+        }
+        struct io_uring_files_update update;
+        ::memset( &update, 0, sizeof( update ) );
+        update.offset = static_cast<uint32_t>( fd );
+        update.fds = reinterpret_cast<uint64_t>( &file );
+        if( registerRing( IORING_REGISTER_FILES_UPDATE, &update, 1 ) < 0 )
+        {
+            out << "io_uring fixed file update failed. fd: " << fd << " : " << ::strerror( errno )
+                << std::endl;
+        }
+    }
+
+    // next free submission entry, zeroed; submits what is queued when the ring is full
+    struct io_uring_sqe* getSqe()
+    {
+        if( m_ringFd == -1 )
+        {
+            return nullptr;
+        }
+        if( m_sqTail - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE ) >= m_sqEntries )
+        {
+            submit();
+            if( m_sqTail - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE ) >= m_sqEntries )
+            {
+                out << "io_uring submission queue full" << std::endl;
+                return nullptr;
+            }
+        }
+        struct io_uring_sqe* sqe = &m_sqes[m_sqTail & m_sqMask];
+        ::memset( sqe, 0, sizeof( *sqe ) );
+        m_sqTail++;
+        return sqe;
+    }
+
+    unsigned sqPending() const
+    {
+        return m_sqTail - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE );
+    }
+
+    unsigned cqReady() const
+    {
+        return __atomic_load_n( m_cqTail, __ATOMIC_ACQUIRE ) - *m_cqHead;
+    }
+
+    // one io_uring_enter: submits what is queued and waits for a completion up to
+    // timeoutMillis, 0 doesn't wait, -1 waits forever. -errno on failure.
+    int enter( bool wait, int timeoutMillis )
+    {
+        unsigned toSubmit = sqPending();
+        if( toSubmit == 0 && !wait )
+        {
+            return 0;
+        }
+        __atomic_store_n( m_sqTailPtr, m_sqTail, __ATOMIC_RELEASE );
+        unsigned                       flags = wait ? IORING_ENTER_GETEVENTS : 0;
+        struct __kernel_timespec       ts;
+        struct io_uring_getevents_arg  arg;
+        void*                          argp = nullptr;
+        size_t                         argSize = _NSIG / 8;
+        if( wait && timeoutMillis >= 0 )
+        {
+            ts.tv_sec = timeoutMillis / 1000;
+            ts.tv_nsec = static_cast<long long>( timeoutMillis % 1000 ) * 1000000;
+            ::memset( &arg, 0, sizeof( arg ) );
+            arg.ts = reinterpret_cast<uint64_t>( &ts );
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof( arg );
+        }
+        long res = ::syscall(
+            __NR_io_uring_enter, m_ringFd, toSubmit, wait ? 1 : 0, flags, argp, argSize );
+        return res < 0 ? -errno : static_cast<int>( res );
+    }
+
+    int submit()
+    {
+        return enter( false, 0 );
+    }
+
+    int wait( int timeoutMillis )
+    {
+        return enter( timeoutMillis != 0, timeoutMillis );
+    }
+
+    // non blocking enters until something completes or the budget runs out, then block
+    int spinWait()
+    {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point deadline = Clock::now() + std::chrono::nanoseconds( m_spinNanos );
+        do
+        {
+            int res = wait( 0 );
+            if( res < 0 || cqReady() != 0 )
+            {
+                return res;
+            }
+        } while( Clock::now() < deadline );
+        return wait( m_idleWaitMilliSecs );
+    }
+
+    void dispatch()
+    {
+        m_dispatching = true;
+        // bounded, completions posted while this runs wait for the next loop
+        for( unsigned ready = cqReady(); ready > 0; ready-- )
+        {
+            struct io_uring_cqe cqe = m_cqes[*m_cqHead & m_cqMask];
+            __atomic_store_n( m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE );
+            onCompletion( cqe );
+        }
+        m_dispatching = false;
+
+        for( auto& pending : m_pendingCallbacks )
+        {
+            FdSlot& slot = *m_fds[pending.fd];
+            if( slot.active && slot.generation == pending.generation )
+            {
+                slot.callback = std::move( pending.callback );
+                slot.recv = std::move( pending.recv );
+            }
+        }
+        m_pendingCallbacks.clear();
+    }
+
+    void onCompletion( const struct io_uring_cqe& cqe )
+    {
+        Op op = static_cast<Op>( cqe.user_data & 0xFF );
+        if( op == OP_SEND )
+        {
+            onSendComplete( cqe );
+            return;
+        }
+        if( op != OP_POLL && op != OP_RECV )
+        {
+            return;
+        }
+        int      fd = static_cast<int>( ( cqe.user_data >> 8 ) & 0xFFFFFF );
+        uint32_t generation = static_cast<uint32_t>( cqe.user_data >> 32 );
+        FdSlot&  slot = *m_fds[fd];
+        bool     current = slot.active && slot.generation == generation;
+        if( op == OP_POLL )
+        {
+            if( !current )
+            {
+                return;
+            }
+            slot.pollArmed = false;
+            if( cqe.res != -ECANCELED )
+            {
+                slot.callback();
+            }
+            // the callback may have removed, re-added or modified the fd
+            if( slot.active && slot.generation == generation && !slot.pollArmed &&
+                slot.events != 0 )
+            {
+                armPoll( fd, slot );
+            }
+            return;
+        }
+
+        bool more = ( cqe.flags & IORING_CQE_F_MORE ) != 0;
+        int  bufferId = ( cqe.flags & IORING_CQE_F_BUFFER ) != 0
+                            ? static_cast<int>( cqe.flags >> IORING_CQE_BUFFER_SHIFT )
+                            : -1;
+        if( current )
+        {
+            if( !more )
+            {
+                slot.recvArmed = false;
+            }
+            if( cqe.res > 0 && bufferId >= 0 )
+            {
+                slot.recv( m_recvBufs + static_cast<size_t>( bufferId ) * RECV_BUF_SIZE, cqe.res );
+            }
+            else if( cqe.res == 0 || ( cqe.res != -ENOBUFS && cqe.res != -ECANCELED ) )
+            {
+                slot.recv( nullptr, cqe.res );
+            }
+        }
+        if( bufferId >= 0 )
+        {
+            recycle( static_cast<unsigned>( bufferId ) );
+        }
+        // a multishot recv stops when the buffers run out, it carries on once they're back
+        if( current && slot.active && slot.generation == generation && !slot.recvArmed &&
+            ( cqe.res > 0 || cqe.res == -ENOBUFS ) )
+        {
+            armRecv( fd, slot );
+        }
+    }
+
+    void onSendComplete( const struct io_uring_cqe& cqe )
+    {
+        uint16_t  head = static_cast<uint16_t>( cqe.user_data >> 8 );
+        int       fd = m_sendSlots[head].fd;
+        uint32_t  generation = m_sendSlots[head].generation;
+        FdSlot&   slot = *m_fds[fd];
+        if( !slot.active || slot.generation != generation )
+        {
+            // fd was removed while this was in flight, dropSends() left just the batch
+            freeSends( head );
+            return;
+        }
+        slot.sendBatch = 0;
+        if( cqe.res == -EAGAIN || cqe.res == -EINTR )
+        {
+            // kernels that honour O_NONBLOCK here: the retry waits for POLLOUT first
+            slot.sendPollFirst = cqe.res == -EAGAIN;
+            markSendReady( fd, slot );
+            return;
+        }
+        slot.sendPollFirst = false;
+        if( cqe.res <= 0 )
+        {
+            freeSends( slot.sendHead );
+            slot.sendHead = NO_SLOT;
+            slot.sendTail = NO_SLOT;
+            slot.sendOffset = 0;
+            slot.notifyDrained = false;
+            int res = cqe.res < 0 ? cqe.res : -EIO;
+            if( slot.recv )
+            {
+                slot.recv( nullptr, res );
+            }
+            else
+            {
+                out << "io_uring send failed. fd: " << fd << " res: " << res << std::endl;
+            }
+            return;
+        }
+        // frees what was written whole, a short write carries on from where it stopped
+        uint32_t written = static_cast<uint32_t>( cqe.res );
+        while( slot.sendHead != NO_SLOT &&
+               written >= m_sendSlots[slot.sendHead].size - slot.sendOffset )
+        {
+            uint16_t index = slot.sendHead;
+            written -= m_sendSlots[index].size - slot.sendOffset;
+            slot.sendHead = m_sendSlots[index].next;
+            slot.sendOffset = 0;
+            m_sendSlots[index].next = m_freeSend;
+            m_freeSend = index;
+        }
+        if( slot.sendHead != NO_SLOT )
+        {
+            slot.sendOffset += written;
+            markSendReady( fd, slot );
+            return;
+        }
+        slot.sendTail = NO_SLOT;
+        if( slot.notifyDrained )
+        {
+            slot.notifyDrained = false;
+            slot.callback();
+        }
+    }
+
+    char* sendBuf( uint16_t index )
+    {
+        return m_sendBufs + static_cast<size_t>( index ) * SEND_SLOT_SIZE;
+    }
+
+    // fd has sends queued and maybe none in flight, looked at before the next submit
+    void markSendReady( int fd, FdSlot& slot )
+    {
+        if( !slot.sendReady )
+        {
+            slot.sendReady = true;
+            m_sendReady.push_back( { fd, slot.generation } );
+        }
+    }
+
+    void issueSends()
+    {
+        for( size_t i = 0; i < m_sendReady.size(); i++ )
+        {
+            int fd = m_sendReady[i].fd;
+            if( registered( fd ) && m_fds[fd]->generation == m_sendReady[i].generation )
+            {
+                m_fds[fd]->sendReady = false;
+                issueSend( fd, *m_fds[fd] );
+            }
+        }
+        m_sendReady.clear();
+    }
+
+    // One write for what is queued for fd, unless one is in flight already: the
+    // first slot from sendOffset on as a WRITE_FIXED, or up to SEND_IOV_MAX slots as
+    // a WRITEV. The kernel has copied the iovecs once it is submitted.
+    void issueSend( int fd, FdSlot& slot )
+    {
+        if( slot.sendBatch != 0 || slot.sendHead == NO_SLOT )
+        {
+            return;
+        }
+        if( slot.sendPollFirst && m_sqEntries - sqPending() < 2 )
+        {
+            // a link can't be split over two submits
+            submit();
+        }
+        struct io_uring_sqe* poll = slot.sendPollFirst ? getSqe() : nullptr;
+        struct io_uring_sqe* sqe = getSqe();
+        if( sqe == nullptr )
+        {
+            markSendReady( fd, slot );
+            return;
+        }
+        if( poll != nullptr )
+        {
+            poll->opcode = IORING_OP_POLL_ADD;
+            setFile( poll, fd );
+            poll->poll32_events = EPOLLOUT;
+            poll->flags |= IOSQE_IO_LINK;
+            poll->user_data = OP_CANCEL;
+        }
+        unsigned count = 0;
+        for( uint16_t index = slot.sendHead; index != NO_SLOT && count < SEND_IOV_MAX;
+             index = m_sendSlots[index].next )
+        {
+            uint32_t skip = count == 0 ? slot.sendOffset : 0;
+            slot.sendIov[count].iov_base = sendBuf( index ) + skip;
+            slot.sendIov[count].iov_len = m_sendSlots[index].size - skip;
+            count++;
+        }
+        if( count == 1 )
+        {
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = reinterpret_cast<uint64_t>( slot.sendIov[0].iov_base );
+            sqe->len = static_cast<uint32_t>( slot.sendIov[0].iov_len );
+            sqe->buf_index = 0;
+        }
+        else
+        {
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr = reinterpret_cast<uint64_t>( slot.sendIov );
+            sqe->len = count;
+        }
+        setFile( sqe, fd );
+        sqe->user_data = static_cast<uint64_t>( slot.sendHead ) << 8 | OP_SEND;
+        slot.sendBatch = static_cast<uint16_t>( count );
+    }
+
+    // Before fd is removed: what is queued goes out in one last write if none is in
+    // flight, e.g. the Logout just sent, anything past the write in flight is freed.
+    // The write keeps its slots until it completes.
+    void dropSends( int fd, FdSlot& slot )
+    {
+        issueSend( fd, slot );
+        if( slot.sendBatch == 0 )
+        {
+            freeSends( slot.sendHead );
+            slot.sendHead = NO_SLOT;
+        }
+        uint16_t index = slot.sendHead;
+        for( uint16_t i = 1; index != NO_SLOT && i < slot.sendBatch; i++ )
+        {
+            index = m_sendSlots[index].next;
+        }
+        if( index != NO_SLOT )
+        {
+            freeSends( m_sendSlots[index].next );
+            m_sendSlots[index].next = NO_SLOT;
+        }
+        slot.sendHead = NO_SLOT;
+        slot.sendTail = NO_SLOT;
+        slot.sendBatch = 0;
+        slot.sendOffset = 0;
+        slot.notifyDrained = false;
+    }
+
+    // puts the chain of slots from index on back on the free list
+    void freeSends( uint16_t index )
+    {
+        while( index != NO_SLOT )
+        {
+            uint16_t next = m_sendSlots[index].next;
+            m_sendSlots[index].next = m_freeSend;
+            m_freeSend = index;
+            index = next;
+        }
+    }
+
+    // hands a recv buffer back to the kernel
+    void recycle( unsigned bufferId )
+    {
+        struct io_uring_buf* buf = &m_bufRing[m_bufTail & ( RECV_BUF_COUNT - 1 )];
+        buf->addr = reinterpret_cast<uint64_t>( m_recvBufs +
+                                                static_cast<size_t>( bufferId ) * RECV_BUF_SIZE );
+        buf->len = RECV_BUF_SIZE;
+        buf->bid = static_cast<uint16_t>( bufferId );
+        m_bufTail++;
+        publishBufTail();
+    }
+
+    // the ring's tail shares its 16 bits with the first entry's resv field
+    void publishBufTail()
+    {
+        uint16_t* tail = reinterpret_cast<uint16_t*>( reinterpret_cast<char*>( m_bufRing ) +
+                                                      offsetof( struct io_uring_buf, resv ) );
+        __atomic_store_n( tail, m_bufTail, __ATOMIC_RELEASE );
+    }
+
+    long registerRing( unsigned opcode, void* arg, unsigned count )
+    {
+        return ::syscall( __NR_io_uring_register, m_ringFd, opcode, arg, count );
+    }
+
+    static char* mapAnonymous( size_t size )
+    {
+        void* res = ::mmap( nullptr,
+                            size,
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                            -1,
+                            0 );
+        return res == MAP_FAILED ? nullptr : static_cast<char*>( res );
+    }
+
+    bool setup()
+    {
+        struct io_uring_params params;
+        ::memset( &params, 0, sizeof( params ) );
+        params.flags = SETUP_FLAGS;
+        m_ringFd = static_cast<int>( ::syscall( __NR_io_uring_setup, RING_ENTRIES, &params ) );
+        if( m_ringFd == -1 && errno == EINVAL && SETUP_FLAGS != 0 )
+        {
+            ::memset( &params, 0, sizeof( params ) );
+            m_ringFd = static_cast<int>( ::syscall( __NR_io_uring_setup, RING_ENTRIES, &params ) );
+        }
+        if( m_ringFd == -1 )
+        {
+            out << "io_uring_setup failed: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                << std::endl;
+            return false;
+        }
+        if( !( params.features & IORING_FEAT_SINGLE_MMAP ) ||
+            !( params.features & IORING_FEAT_EXT_ARG ) )
+        {
+            out << "io_uring: kernel too old, needs single mmap and ext arg" << std::endl;
+            return false;
+        }
+
+        m_ringSize = std::max( params.sq_off.array + params.sq_entries * sizeof( uint32_t ),
+                               params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe ) );
+        void* ring = ::mmap( nullptr,
+                             m_ringSize,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             m_ringFd,
+                             IORING_OFF_SQ_RING );
+        void* sqes = ::mmap( nullptr,
+                             params.sq_entries * sizeof( struct io_uring_sqe ),
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             m_ringFd,
+                             IORING_OFF_SQES );
+        if( ring == MAP_FAILED || sqes == MAP_FAILED )
+        {
+            out << "io_uring mmap failed: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                << std::endl;
+            if( ring != MAP_FAILED )
+            {
+                ::munmap( ring, m_ringSize );
+            }
+            return false;
+        }
+        m_ringMem = static_cast<char*>( ring );
+        m_sqes = static_cast<struct io_uring_sqe*>( sqes );
+        m_sqEntries = params.sq_entries;
+        m_sqHead = reinterpret_cast<unsigned*>( m_ringMem + params.sq_off.head );
+        m_sqTailPtr = reinterpret_cast<unsigned*>( m_ringMem + params.sq_off.tail );
+        m_sqMask = *reinterpret_cast<unsigned*>( m_ringMem + params.sq_off.ring_mask );
+        m_sqTail = *m_sqTailPtr;
+        m_cqHead = reinterpret_cast<unsigned*>( m_ringMem + params.cq_off.head );
+        m_cqTail = reinterpret_cast<unsigned*>( m_ringMem + params.cq_off.tail );
+        m_cqMask = *reinterpret_cast<unsigned*>( m_ringMem + params.cq_off.ring_mask );
+        m_cqes = reinterpret_cast<struct io_uring_cqe*>( m_ringMem + params.cq_off.cqes );
+        // entry i always submits sqe i
+        unsigned* array = reinterpret_cast<unsigned*>( m_ringMem + params.sq_off.array );
+        for( unsigned i = 0; i < m_sqEntries; i++ )
+        {
+            array[i] = i;
+        }
+        return setupRecvBuffers() && setupSendBuffers() && setupFixedFiles();
+    }
+
+    bool setupRecvBuffers()
+    {
+        m_recvBufs = mapAnonymous( static_cast<size_t>( RECV_BUF_COUNT ) * RECV_BUF_SIZE );
+        m_bufRing = reinterpret_cast<struct io_uring_buf*>(
+            mapAnonymous( RECV_BUF_COUNT * sizeof( struct io_uring_buf ) ) );
+        if( m_recvBufs == nullptr || m_bufRing == nullptr )
+        {
+            out << "io_uring recv buffer mmap failed: " << ::strerror( errno ) << std::endl;
+            return false;
+        }
+        struct io_uring_buf_reg reg;
+        ::memset( &reg, 0, sizeof( reg ) );
+        reg.ring_addr = reinterpret_cast<uint64_t>( m_bufRing );
+        reg.ring_entries = RECV_BUF_COUNT;
+        reg.bgid = 0;
+        if( registerRing( IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 )
+        {
+            out << "io_uring provided buffer ring registration failed: " << ::strerror( errno )
+                << ". (errno: " << errno << ")" << std::endl;
+            return false;
+        }
+        for( unsigned i = 0; i < RECV_BUF_COUNT; i++ )
+        {
+            recycle( i );
+        }
+        return true;
+    }
+
+    bool setupSendBuffers()
+    {
+        size_t size = static_cast<size_t>( SEND_SLOTS ) * SEND_SLOT_SIZE;
+        m_sendBufs = mapAnonymous( size );
+        if( m_sendBufs == nullptr )
+        {
+            out << "io_uring send buffer mmap failed: " << ::strerror( errno ) << std::endl;
+            return false;
+        }
+        struct iovec iov;
+        iov.iov_base = m_sendBufs;
+        iov.iov_len = size;
+        if( registerRing( IORING_REGISTER_BUFFERS, &iov, 1 ) < 0 )
+        {
+            out << "io_uring buffer registration failed: " << ::strerror( errno )
+                << ". (errno: " << errno << ")" << std::endl;
+            return false;
+        }
+        m_sendSlots.resize( SEND_SLOTS );
+        for( unsigned i = SEND_SLOTS; i-- > 0; )
+        {
+            m_sendSlots[i].next = m_freeSend;
+            m_freeSend = static_cast<uint16_t>( i );
+        }
+        return true;
+    }
+
+    // a sparse table, fds are put in their own slot as they are added; without it
+    // (RLIMIT_NOFILE below MAX_FIXED_FILES, say) fds are used as they are
+    bool setupFixedFiles()
+    {
+        std::vector<int> files( MAX_FIXED_FILES, -1 );
+        m_fixedFiles = registerRing( IORING_REGISTER_FILES, files.data(), MAX_FIXED_FILES ) == 0;
+        if( !m_fixedFiles )
+        {
+            out << "io_uring fixed files unavailable, using plain fds: " << ::strerror( errno )
+                << std::endl;
+        }
+        return true;
+    }
+
+    void teardown()
+    {
+        if( m_ringFd != -1 )
+        {
+            ::close( m_ringFd );
+            m_ringFd = -1;
+        }
+        if( m_ringMem != nullptr )
+        {
+            ::munmap( m_ringMem, m_ringSize );
+            ::munmap( m_sqes, m_sqEntries * sizeof( struct io_uring_sqe ) );
+            m_ringMem = nullptr;
+        }
+        if( m_recvBufs != nullptr )
+        {
+            ::munmap( m_recvBufs, static_cast<size_t>( RECV_BUF_COUNT ) * RECV_BUF_SIZE );
+            m_recvBufs = nullptr;
+        }
+        if( m_bufRing != nullptr )
+        {
+            ::munmap( m_bufRing, RECV_BUF_COUNT * sizeof( struct io_uring_buf ) );
+            m_bufRing = nullptr;
+        }
+        if( m_sendBufs != nullptr )
+        {
+            ::munmap( m_sendBufs, static_cast<size_t>( SEND_SLOTS ) * SEND_SLOT_SIZE );
+            m_sendBufs = nullptr;
+        }
+    }
+
+    int     m_ringFd;
+    int     m_waitMilliSecs;
+    int     m_idleWaitMilliSecs;
+    int64_t m_spinNanos; // 0 disables the spin phase
+
+    // rings shared with the kernel
+    char*                m_ringMem;
+    size_t               m_ringSize;
+    struct io_uring_sqe* m_sqes;
+    struct io_uring_cqe* m_cqes;
+    unsigned*            m_sqHead;
+    unsigned*            m_sqTailPtr;
+    unsigned*            m_cqHead;
+    unsigned*            m_cqTail;
+    unsigned             m_sqEntries;
+    unsigned             m_sqMask;
+    unsigned             m_cqMask;
+    // entries queued locally, published to the kernel on enter
+    unsigned             m_sqTail;
+
+    char*                m_recvBufs;
+    struct io_uring_buf* m_bufRing;
+    uint16_t             m_bufTail;
+    char*                m_sendBufs;
+    std::vector<SendSlot> m_sendSlots;
+    uint16_t             m_freeSend;
+    bool                 m_fixedFiles;
+    bool                 m_dispatching;
+
+    // indexed by fd, a slot outlives table growth while its callback runs
+    std::vector<std::unique_ptr<FdSlot>> m_fds;
+    std::vector<PendingCallbacks>        m_pendingCallbacks;
+    std::vector<SendReady>               m_sendReady;
+    Tasks                                m_tasks;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <iostream>
+#include <functional>
+#include <stdint.h>
+
+#include <linux/io_uring.h>
+
+#include "epoller_misc.h"
+
+namespace TinyFix {
+
+// Selects IoUringEpoller wherever a Components class takes EpollerComponents, e.g.
+// DefaultSessionComponents::EpollerComponents. Needs Linux 6.0 for multishot recv.
+class DefaultIoUringEpollerComponents : public DefaultEpollerComponents
+{
+public:
+    constexpr static PollerBackend BACKEND = PollerBackend::IoUring;
+    // submission queue entries, the kernel sizes the completion queue at twice that
+    constexpr static unsigned RING_ENTRIES = 1024;
+    // completions are posted when the loop enters the kernel anyway instead of
+    // interrupting it; the ring is set up without flags on kernels that lack them
+    constexpr static unsigned SETUP_FLAGS = IORING_SETUP_COOP_TASKRUN;
+    // fds below this are registered as fixed files under their own number
+    constexpr static int MAX_FIXED_FILES = 4096;
+    // provided buffer ring that multishot recv fills, RECV_BUF_COUNT a power of two
+    constexpr static unsigned RECV_BUF_COUNT = 512;
+    constexpr static unsigned RECV_BUF_SIZE = 8192;
+    // registered buffers sends are copied into, one slot per queued send; once they
+    // are all taken send() refuses and the caller queues the bytes itself
+    constexpr static unsigned SEND_SLOTS = 256;
+    constexpr static unsigned SEND_SLOT_SIZE = 4096;
+    // queued sends one WRITEV to an fd covers at most
+    constexpr static unsigned SEND_IOV_MAX = 64;
+    // data is only valid during the call; res is the byte count, 0 when the peer
+    // closed, or -errno of a failed recv or send on the fd
+    using RecvCallback = std::function<void( const char* data, int res )>;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <thread>
+#include <stdint.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+namespace TinyFix {
+
+// Raw cycle counter, an invariant TSC on anything recent. Elsewhere it falls back to
+// the monotonic clock in nanoseconds.
+inline uint64_t readTsc()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now().time_since_epoch() )
+                                      .count() );
+#endif
+}
+
+// nanoseconds per readTsc() tick, measured once against the monotonic clock
+inline double tscNanosPerTick()
+{
+    static const double nanosPerTick = []() {
+#if defined( __x86_64__ ) || defined( __i386__ )
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point start = Clock::now();
+        uint64_t          tscStart = readTsc();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+        uint64_t          tscEnd = readTsc();
+        Clock::time_point end = Clock::now();
+        double            nanos =
+            std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count();
+        return nanos / static_cast<double>( tscEnd - tscStart );
+#else
+        return 1.0;
+#endif
+    }();
+    return nanosPerTick;
+}
+
+struct LatencySnapshot
+{
+    uint64_t count = 0;
+    // nanoseconds
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double max = 0;
+};
+
+// HDR style log-linear histogram of tick counts: exact below 2^SUB_BITS, above that
+// every power of two is split into 2^(SUB_BITS-1) buckets, so a recorded value is
+// off by at most 1 / 2^(SUB_BITS-1). Values from 2^MAX_BITS up land in the last bucket.
+// One thread records, any thread may snapshot() at the same time; counters are
+// relaxed atomics the writer bumps without a locked instruction, so a snapshot can
+// be a few samples behind but never blocks or tears.
+template<int SUB_BITS = 5, int MAX_BITS = 36>
+class LatencyHistogram
+{
+public:
+    constexpr static uint64_t SUB_COUNT = uint64_t( 1 ) << SUB_BITS;
+    constexpr static uint64_t HALF_COUNT = SUB_COUNT / 2;
+    constexpr static size_t   NUM_BUCKETS = SUB_COUNT + ( MAX_BITS - SUB_BITS ) * HALF_COUNT;
+
+    LatencyHistogram( const LatencyHistogram& ) = delete;
+    LatencyHistogram& operator=( const LatencyHistogram& ) = delete;
+
+    LatencyHistogram()
+    {
+        reset();
+    }
+
+    // writer thread
+    void record( uint64_t ticks )
+    {
+        bump( m_counts[bucketOf( ticks )] );
+        if( ticks > m_max.load( std::memory_order_relaxed ) )
+        {
+            m_max.store( ticks, std::memory_order_relaxed );
+        }
+    }
+
+    // writer thread
+    void reset()
+    {
+        for( auto& count : m_counts )
+        {
+            count.store( 0, std::memory_order_relaxed );
+        }
+        m_max.store( 0, std::memory_order_relaxed );
+    }
+
+    // any thread
+    LatencySnapshot snapshot() const
+    {
+        LatencySnapshot res;
+        const double    nanosPerTick = tscNanosPerTick();
+        uint64_t        total = 0;
+        for( const auto& count : m_counts )
+        {
+            total += count.load( std::memory_order_relaxed );
+        }
+        res.count = total;
+        uint64_t max = m_max.load( std::memory_order_relaxed );
+        res.max = max * nanosPerTick;
+        if( total == 0 )
+        {
+            return res;
+        }
+        // the sample at each rank, ranks rounded up so p99.9 of 10 samples is the max
+        const uint64_t ranks[] = { ( total * 500 + 999 ) / 1000,
+                                   ( total * 990 + 999 ) / 1000,
+                                   ( total * 999 + 999 ) / 1000 };
+        double*        values[] = { &res.p50, &res.p99, &res.p999 };
+        uint64_t       seen = 0;
+        size_t         next = 0;
+        for( size_t i = 0; i < NUM_BUCKETS && next < 3; i++ )
+        {
+            seen += m_counts[i].load( std::memory_order_relaxed );
+            while( next < 3 && seen >= ranks[next] )
+            {
+                // a bucket's top can lie past the largest sample in it
+                *values[next++] = std::min( bucketValue( i ), max ) * nanosPerTick;
+            }
+        }
+        return res;
+    }
+
+    static size_t bucketOf( uint64_t ticks )
+    {
+        if( ticks < SUB_COUNT )
+        {
+            return static_cast<size_t>( ticks );
+        }
+        int msb = 63 - __builtin_clzll( ticks );
+        if( msb >= MAX_BITS )
+        {
+            return NUM_BUCKETS - 1;
+        }
+        int shift = msb - SUB_BITS + 1;
+        return static_cast<size_t>( shift * HALF_COUNT + ( ticks >> shift ) );
+    }
+
+    // highest value that lands in bucket, what percentiles report
+    static uint64_t bucketValue( size_t bucket )
+    {
+        if( bucket < SUB_COUNT )
+        {
+            return bucket;
+        }
+        uint64_t shift = ( bucket - SUB_COUNT ) / HALF_COUNT + 1;
+        uint64_t sub = bucket - shift * HALF_COUNT;
+        return ( ( sub + 1 ) << shift ) - 1;
+    }
+
+private:
+    static void bump( std::atomic<uint64_t>& counter )
+    {
+        counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+
+    std::atomic<uint64_t> m_counts[NUM_BUCKETS];
+    std::atomic<uint64_t> m_max;
+};
+
+enum ProbePoint : uint8_t
+{
+    // inbound chain, each one timed from the one before
+    PROBE_RECV = 0, // the recv() call, tick to trade counts from its return
+    PROBE_FRAME,    // messages found in the read
+    PROBE_PARSE,    // one message parsed
+    PROBE_DISPATCH, // the message handled, application callback included
+    // outbound chain
+    PROBE_ENCODE,   // starts at send(), ends with the message encoded
+    PROBE_SEND,     // encoded to queued for the socket
+    // PROBE_RECV to PROBE_SEND for a message sent while an inbound read is handled
+    PROBE_TICK_TO_TRADE,
+
+    ProbePoint_Count
+};
+
+// Probes off: every call is empty and inlines away. Selected through the
+// Components' Probes type, e.g. DefaultSessionComponents::Probes.
+class NullLatencyProbes
+{
+public:
+    void start( ProbePoint )
+    {
+    }
+    void mark( ProbePoint )
+    {
+    }
+    void end()
+    {
+    }
+    LatencySnapshot snapshot( ProbePoint ) const
+    {
+        return LatencySnapshot();
+    }
+    template<typename OutT>
+    void print( OutT& ) const
+    {
+    }
+};
+
+// Probes on: readTsc() at every probe point, the time since the previous point of
+// the same chain goes into that point's histogram. One set per session, so a
+// session's reactor thread is the only writer; snapshot() and print() can run on a
+// monitoring thread at any time.
+template<int SUB_BITS = 5, int MAX_BITS = 36>
+class LatencyProbes
+{
+public:
+    using Histogram = LatencyHistogram<SUB_BITS, MAX_BITS>;
+
+    LatencyProbes()
+        : m_inLast( 0 )
+        , m_outLast( 0 )
+        , m_recvStamp( 0 )
+        , m_inbound( false )
+    {
+    }
+
+    // begins the inbound (PROBE_RECV) or outbound (PROBE_ENCODE) chain
+    void start( ProbePoint point )
+    {
+        ( point >= PROBE_ENCODE ? m_outLast : m_inLast ) = readTsc();
+    }
+
+    void mark( ProbePoint point )
+    {
+        uint64_t  now = readTsc();
+        uint64_t& last = point >= PROBE_ENCODE ? m_outLast : m_inLast;
+        m_histograms[point].record( now - last );
+        last = now;
+        if( point == PROBE_RECV )
+        {
+            m_recvStamp = now;
+            m_inbound = true;
+        }
+        else if( point == PROBE_SEND && m_inbound )
+        {
+            m_histograms[PROBE_TICK_TO_TRADE].record( now - m_recvStamp );
+        }
+    }
+
+    // the inbound read is handled, later sends are not tick to trade
+    void end()
+    {
+        m_inbound = false;
+    }
+
+    LatencySnapshot snapshot( ProbePoint point ) const
+    {
+        return m_histograms[point].snapshot();
+    }
+
+    template<typename OutT>
+    void print( OutT& out ) const
+    {
+        static const char* names[] = { "recv",   "frame", "parse",        "dispatch",
+                                       "encode", "send",  "tick-to-trade" };
+        for( int point = 0; point < ProbePoint_Count; point++ )
+        {
+            LatencySnapshot snap = snapshot( static_cast<ProbePoint>( point ) );
+            if( snap.count == 0 )
+            {
+                continue;
+            }
+            out << names[point] << ": n " << snap.count << " p50 " << snap.p50 << "ns p99 "
+                << snap.p99 << "ns p99.9 " << snap.p999 << "ns max " << snap.max << "ns"
+                << std::endl;
+        }
+    }
+
+private:
+    Histogram m_histograms[ProbePoint_Count];
+    uint64_t  m_inLast;
+    uint64_t  m_outLast;
+    uint64_t  m_recvStamp;
+    bool      m_inbound;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <stdint.h>
+
+#include "lockfree_queue_misc.h"
+
+namespace TinyFix {
+
+inline size_t roundUpPowerOfTwo( size_t value )
+{
+    size_t res = 1;
+    while( res < value )
+    {
+        res <<= 1;
+    }
+    return res;
+}
+
+// Bounded single producer / single consumer ring.
+// Head and tail sit on their own cache lines, each side also keeps a cached copy of
+// the other's index next to its own so the shared line is only read when the cached
+// one says the ring is full (producer) or empty (consumer). Batched calls publish
+// once per batch. Slots are allocated once in the constructor.
+template<typename T, typename LockFreeQueueComponentsT = DefaultLockFreeQueueComponents>
+class SPSCQueue
+{
+public:
+    constexpr static size_t CACHE_LINE_SIZE = LockFreeQueueComponentsT::CACHE_LINE_SIZE;
+    using WaitStrategy = typename LockFreeQueueComponentsT::WaitStrategy;
+
+    SPSCQueue( const SPSCQueue& ) = delete;
+    SPSCQueue& operator=( const SPSCQueue& ) = delete;
+
+    // capacity is rounded up to a power of two
+    SPSCQueue( size_t capacity )
+        : m_capacity( roundUpPowerOfTwo( capacity ) )
+        , m_mask( m_capacity - 1 )
+        , m_slots( new T[m_capacity] )
+    {
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    // approximate unless called from one of the two threads with the other idle
+    size_t size() const
+    {
+        return m_tail.value.load( std::memory_order_acquire ) -
+               m_head.value.load( std::memory_order_acquire );
+    }
+
+    // producer
+    template<typename U>
+    bool tryPush( U&& item )
+    {
+        uint64_t tail = m_tail.value.load( std::memory_order_relaxed );
+        if( tail - m_tail.cached == m_capacity )
+        {
+            m_tail.cached = m_head.value.load( std::memory_order_acquire );
+            if( tail - m_tail.cached == m_capacity )
+            {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::forward<U>( item );
+        m_tail.value.store( tail + 1, std::memory_order_release );
+        m_notEmpty.notify();
+        return true;
+    }
+
+    // producer, copies up to count items and returns how many fit
+    size_t tryPush( const T* items, size_t count )
+    {
+        uint64_t tail = m_tail.value.load( std::memory_order_relaxed );
+        size_t   free = m_capacity - static_cast<size_t>( tail - m_tail.cached );
+        if( free < count )
+        {
+            m_tail.cached = m_head.value.load( std::memory_order_acquire );
+            free = m_capacity - static_cast<size_t>( tail - m_tail.cached );
+        }
+        size_t n = count < free ? count : free;
+        for( size_t i = 0; i < n; i++ )
+        {
+            m_slots[( tail + i ) & m_mask] = items[i];
+        }
+        if( n != 0 )
+        {
+            m_tail.value.store( tail + n, std::memory_order_release );
+            m_notEmpty.notify();
+        }
+        return n;
+    }
+
+    // producer, waits for room
+    template<typename U>
+    void push( U&& item )
+    {
+        while( !tryPush( std::forward<U>( item ) ) )
+        {
+            uint32_t seq = m_notFull.prepare();
+            if( full() )
+            {
+                m_notFull.wait( seq );
+            }
+        }
+    }
+
+    // consumer
+    bool tryPop( T& item )
+    {
+        return consume( [&item]( T& slot ) { item = std::move( slot ); }, 1 ) == 1;
+    }
+
+    // consumer, moves up to max items out and returns how many there were
+    size_t tryPop( T* items, size_t max )
+    {
+        size_t i = 0;
+        return consume( [items, &i]( T& slot ) { items[i++] = std::move( slot ); }, max );
+    }
+
+    // consumer, calls fn( T& ) on up to max items in place and releases them together
+    template<typename Fn>
+    size_t consume( Fn&& fn, size_t max = SIZE_MAX )
+    {
+        uint64_t head = m_head.value.load( std::memory_order_relaxed );
+        if( m_head.cached == head )
+        {
+            m_head.cached = m_tail.value.load( std::memory_order_acquire );
+            if( m_head.cached == head )
+            {
+                return 0;
+            }
+        }
+        size_t available = static_cast<size_t>( m_head.cached - head );
+        size_t n = available < max ? available : max;
+        for( size_t i = 0; i < n; i++ )
+        {
+            fn( m_slots[( head + i ) & m_mask] );
+        }
+        m_head.value.store( head + n, std::memory_order_release );
+        m_notFull.notify();
+        return n;
+    }
+
+    // consumer, waits for an item
+    void pop( T& item )
+    {
+        while( !tryPop( item ) )
+        {
+            uint32_t seq = m_notEmpty.prepare();
+            if( empty() )
+            {
+                m_notEmpty.wait( seq );
+            }
+        }
+    }
+
+    bool empty() const
+    {
+        return m_head.value.load( std::memory_order_acquire ) ==
+               m_tail.value.load( std::memory_order_acquire );
+    }
+
+    bool full() const
+    {
+        return size() >= m_capacity;
+    }
+
+private:
+    // an index with the owner's cached view of the other side
+    struct alignas( CACHE_LINE_SIZE ) Index
+    {
+        std::atomic<uint64_t> value{ 0 };
+        uint64_t              cached = 0;
+    };
+
+    const size_t         m_capacity;
+    const size_t         m_mask;
+    std::unique_ptr<T[]> m_slots;
+    Index                m_head; // consumer side, cached is the last tail seen
+    Index                m_tail; // producer side, cached is the last head seen
+    alignas( CACHE_LINE_SIZE ) WaitStrategy m_notEmpty;
+    alignas( CACHE_LINE_SIZE ) WaitStrategy m_notFull;
+};
+
+// Bounded multi producer / single consumer ring.
+// Producers claim slots with a CAS on the tail, a batch claims its whole range in
+// one CAS; every slot carries the position it was last written for, so the consumer
+// sees a slot only once its producer has published it, in claim order.
+template<typename T, typename LockFreeQueueComponentsT = DefaultLockFreeQueueComponents>
+class MPSCQueue
+{
+public:
+    constexpr static size_t CACHE_LINE_SIZE = LockFreeQueueComponentsT::CACHE_LINE_SIZE;
+    using WaitStrategy = typename LockFreeQueueComponentsT::WaitStrategy;
+
+    MPSCQueue( const MPSCQueue& ) = delete;
+    MPSCQueue& operator=( const MPSCQueue& ) = delete;
+
+    // capacity is rounded up to a power of two
+    MPSCQueue( size_t capacity )
+        : m_capacity( roundUpPowerOfTwo( capacity ) )
+        , m_mask( m_capacity - 1 )
+        , m_slots( new Slot[m_capacity] )
+    {
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t size() const
+    {
+        return m_tail.load( std::memory_order_acquire ) - m_head.load( std::memory_order_acquire );
+    }
+
+    // any producer
+    template<typename U>
+    bool tryPush( U&& item )
+    {
+        uint64_t pos;
+        if( claim( 1, pos ) == 0 )
+        {
+            return false;
+        }
+        Slot& slot = m_slots[pos & m_mask];
+        slot.value = std::forward<U>( item );
+        slot.seq.store( pos + 1, std::memory_order_release );
+        m_notEmpty.notify();
+        return true;
+    }
+
+    // any producer, copies up to count items and returns how many fit
+    size_t tryPush( const T* items, size_t count )
+    {
+        uint64_t pos;
+        size_t   n = claim( count, pos );
+        for( size_t i = 0; i < n; i++ )
+        {
+            Slot& slot = m_slots[( pos + i ) & m_mask];
+            slot.value = items[i];
+            slot.seq.store( pos + i + 1, std::memory_order_release );
+        }
+        if( n != 0 )
+        {
+            m_notEmpty.notify();
+        }
+        return n;
+    }
+
+    // any producer, waits for room
+    template<typename U>
+    void push( U&& item )
+    {
+        while( !tryPush( std::forward<U>( item ) ) )
+        {
+            uint32_t seq = m_notFull.prepare();
+            if( size() >= m_capacity )
+            {
+                m_notFull.wait( seq );
+            }
+        }
+    }
+
+    // consumer
+    bool tryPop( T& item )
+    {
+        return consume( [&item]( T& slot ) { item = std::move( slot ); }, 1 ) == 1;
+    }
+
+    // consumer, moves up to max items out and returns how many there were
+    size_t tryPop( T* items, size_t max )
+    {
+        size_t i = 0;
+        return consume( [items, &i]( T& slot ) { items[i++] = std::move( slot ); }, max );
+    }
+
+    // consumer, calls fn( T& ) on up to max published items in order and releases
+    // them together; stops at the first slot still being written
+    template<typename Fn>
+    size_t consume( Fn&& fn, size_t max = SIZE_MAX )
+    {
+        uint64_t head = m_head.load( std::memory_order_relaxed );
+        size_t   n = 0;
+        while( n < max )
+        {
+            Slot& slot = m_slots[( head + n ) & m_mask];
+            if( slot.seq.load( std::memory_order_acquire ) != head + n + 1 )
+            {
+                break;
+            }
+            fn( slot.value );
+            n++;
+        }
+        if( n != 0 )
+        {
+            m_head.store( head + n, std::memory_order_release );
+            m_notFull.notify();
+        }
+        return n;
+    }
+
+    // consumer, waits for an item
+    void pop( T& item )
+    {
+        while( !tryPop( item ) )
+        {
+            uint32_t seq = m_notEmpty.prepare();
+            if( empty() )
+            {
+                m_notEmpty.wait( seq );
+            }
+        }
+    }
+
+    // consumer; a claimed slot that is not written yet counts as empty
+    bool empty() const
+    {
+        uint64_t head = m_head.load( std::memory_order_relaxed );
+        return m_slots[head & m_mask].seq.load( std::memory_order_acquire ) != head + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> seq{ 0 };
+        T                     value;
+    };
+
+    // claims up to count slots from pos on, 0 when the ring is full
+    size_t claim( size_t count, uint64_t& pos )
+    {
+        pos = m_tail.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            size_t free =
+                m_capacity - static_cast<size_t>( pos - m_head.load( std::memory_order_acquire ) );
+            size_t n = count < free ? count : free;
+            if( n == 0 )
+            {
+                return 0;
+            }
+            if( m_tail.compare_exchange_weak(
+                    pos, pos + n, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+            {
+                return n;
+            }
+            cpuRelax();
+        }
+    }
+
+    const size_t            m_capacity;
+    const size_t            m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas( CACHE_LINE_SIZE ) std::atomic<uint64_t> m_head{ 0 };
+    alignas( CACHE_LINE_SIZE ) std::atomic<uint64_t> m_tail{ 0 };
+    alignas( CACHE_LINE_SIZE ) WaitStrategy m_notEmpty;
+    alignas( CACHE_LINE_SIZE ) WaitStrategy m_notFull;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#endif
+
+namespace TinyFix {
+
+inline void cpuRelax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    _mm_pause();
+#else
+    std::atomic_signal_fence( std::memory_order_seq_cst );
+#endif
+}
+
+// Wait strategies: a queue keeps one per direction (not empty, not full).
+// A waiter takes prepare(), re-checks the queue and calls wait() with it; the other
+// side calls notify() after every change. wait() may return spuriously, callers loop.
+
+// burns the core, lowest latency for a pinned consumer
+class SpinWaitStrategy
+{
+public:
+    uint32_t prepare() const
+    {
+        return 0;
+    }
+    void wait( uint32_t )
+    {
+        cpuRelax();
+    }
+    void notify()
+    {
+    }
+};
+
+// gives the core away between checks, for threads that share a core
+class YieldWaitStrategy
+{
+public:
+    uint32_t prepare() const
+    {
+        return 0;
+    }
+    void wait( uint32_t )
+    {
+        std::this_thread::yield();
+    }
+    void notify()
+    {
+    }
+};
+
+// Sleeps in the kernel until notified, for consumers that are idle most of the time.
+// notify() is an atomic increment plus a load while nobody sleeps.
+class FutexWaitStrategy
+{
+public:
+    uint32_t prepare() const
+    {
+        return m_seq.load( std::memory_order_seq_cst );
+    }
+
+    void wait( uint32_t seq )
+    {
+        m_waiters.fetch_add( 1, std::memory_order_seq_cst );
+        // returns at once if a notify() moved m_seq since prepare()
+        ::syscall( SYS_futex, &m_seq, FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0 );
+        m_waiters.fetch_sub( 1, std::memory_order_relaxed );
+    }
+
+    void notify()
+    {
+        m_seq.fetch_add( 1, std::memory_order_seq_cst );
+        if( m_waiters.load( std::memory_order_seq_cst ) != 0 )
+        {
+            ::syscall( SYS_futex, &m_seq, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0 );
+        }
+    }
+
+private:
+    std::atomic<uint32_t> m_seq{ 0 };
+    std::atomic<uint32_t> m_waiters{ 0 };
+};
+
+class DefaultLockFreeQueueComponents
+{
+public:
+    constexpr static size_t CACHE_LINE_SIZE = 64;
+    using WaitStrategy = SpinWaitStrategy;
+};
+
+} // namespace TinyFix
@@ -3,13 +3,777 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
 
-#include "epoller.h"
+#include "poller.h"
 #include "socket.h"
+#include "acceptor.h"
+#include "session.h"
+#include "latency_probe.h"
 
-int main (int argc, char* argv[])
+// Loopback FIX counterparty simulator for load and soak tests.
+//
+//   venue:    accepts up to --sessions connections and answers every NewOrderSingle
+//             with an ExecutionReport (and a fill with --fill), cancels with a
+//             cancel report
+//   client:   connects --sessions sessions and sends NewOrderSingles at --rate per
+//             session per second, timing each order to its first ExecutionReport
+//   loopback: both in one process, the venue on this thread, the clients on another
+//
+// Gaps, ResendRequests and disconnects are injected every N application messages
+// with --gap-every / --resend-every / --disconnect-every, or on demand by typing
+// "gap|resend|disconnect|logout [session]", "stats" or "quit" on stdin. Clients
+// reconnect --reconnect-ms after losing their session. --io-uring runs both sides on
+// IoUringEpoller instead of epoll. With --journal every session keeps its outbound
+// messages in DIR and answers ResendRequests by replaying them, --zerocopy sends
+// those replays with MSG_ZEROCOPY; without a journal they are gap filled.
+
+namespace {
+
+using namespace TinyFix;
+
+struct SimOptions
+{
+    std::string mode = "loopback";
+    std::string ip = "127.0.0.1";
+    int         port = 13898;
+    size_t      sessions = 1;
+    // orders per second per client session, 0 sends none
+    uint64_t    rate = 1000;
+    bool        fill = false;
+    int         heartBtInt = 30;
+    int         durationSecs = 0;
+    int         statsSecs = 5;
+    // 0 disables the fault
+    uint64_t    gapEvery = 0;
+    uint64_t    resendEvery = 0;
+    uint64_t    disconnectEvery = 0;
+    int         reconnectMillis = 1000;
+    int         spinMicros = 0;
+    bool        ioUring = false;
+    // directory for the session journals, empty runs without one
+    std::string journalDir;
+    bool        zeroCopy = false;
+    std::string venueId = "VENUE";
+    std::string clientId = "CLIENT";
+};
+
+std::atomic<bool> running( true );
+// stats from the venue and the client thread are printed a block at a time
+std::mutex printMutex;
+
+void onSignal( int )
+{
+    running.store( false );
+}
+
+uint64_t nowMillis()
+{
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::milliseconds>(
+                                      std::chrono::steady_clock::now().time_since_epoch() )
+                                      .count() );
+}
+
+// the order pacer needs finer steps than heartbeats do
+class SimTimerWheelComponents : public DefaultTimerWheelComponents
+{
+public:
+    constexpr static int TICK_MICROS = 1000;
+};
+
+// per session counters and the faults due on it
+class SimApplication
+{
+public:
+    SimApplication( const SimOptions& options, bool venue )
+        : m_options( options )
+        , m_venue( venue )
+        , m_received( 0 )
+        , m_sent( 0 )
+        , m_orderId( 0 )
+        , m_logons( 0 )
+    {
+    }
+
+    template<typename SessionT>
+    void onLogon( SessionT& )
+    {
+        m_logons++;
+    }
+
+    template<typename SessionT>
+    void onLogout( SessionT& )
+    {
+    }
+
+    template<typename SessionT, typename MsgViewT>
+    void onMessage( SessionT& session, const MsgViewT& view )
+    {
+        m_received++;
+        std::string_view msgType = view.get_msg_type();
+        if( m_venue && msgType == "D" )
+        {
+            onNewOrder( session, view );
+        }
+        else if( m_venue && msgType == "F" )
+        {
+            sendExecutionReport( session, view, '4', '4', 0 );
+        }
+        else if( !m_venue && msgType == "8" )
+        {
+            onExecutionReport( view );
+        }
+        injectFaults( session );
+    }
+
+    // client: one NewOrderSingle, the ClOrdID carries the send time for the round trip
+    template<typename SessionT>
+    bool sendOrder( SessionT& session )
+    {
+        uint64_t sendTsc = readTsc();
+        bool     res = session.send( "D", [sendTsc]( typename SessionT::MsgType& msg ) {
+            char   clOrdId[24];
+            size_t size = formatUInt( clOrdId, sendTsc );
+            return msg.add_field( 11, std::string_view( clOrdId, size ) ) &&
+                   msg.add_field( 55, "SIM" ) && msg.add_char( 54, '1' ) &&
+                   msg.add_field( 60, "20240102-09:30:00.000" ) && msg.add_int( 38, 100 ) &&
+                   msg.add_char( 40, '2' ) && msg.add_decimal( 44, 10125, 2 );
+        } );
+        if( res )
+        {
+            m_sent++;
+            injectFaults( session );
+        }
+        return res;
+    }
+
+    // skips one outbound MsgSeqNum, the counterparty has to ask for it
+    template<typename SessionT>
+    static void injectGap( SessionT& session )
+    {
+        session.setNextSenderMsgSeqNum( session.getNextSenderMsgSeqNum() + 1 );
+    }
+
+    // asks again for the last 10 inbound messages
+    template<typename SessionT>
+    static void injectResend( SessionT& session )
+    {
+        uint64_t next = session.getNextTargetMsgSeqNum();
+        uint64_t begin = next > 10 ? next - 10 : 1;
+        session.send( "2", [begin]( typename SessionT::MsgType& msg ) {
+            return msg.add_int( 7, static_cast<int64_t>( begin ) ) && msg.add_int( 16, 0 );
+        } );
+    }
+
+    const LatencyHistogram<>& getRoundTrip() const
+    {
+        return m_roundTrip;
+    }
+
+    // starts the next stats interval
+    void resetRoundTrip()
+    {
+        m_roundTrip.reset();
+    }
+
+    uint64_t getReceived() const
+    {
+        return m_received;
+    }
+
+    uint64_t getSent() const
+    {
+        return m_sent;
+    }
+
+    uint64_t getLogons() const
+    {
+        return m_logons;
+    }
+
+private:
+    template<typename SessionT, typename MsgViewT>
+    void onNewOrder( SessionT& session, const MsgViewT& view )
+    {
+        int64_t qty = 0;
+        view.get_int( 38, qty );
+        if( sendExecutionReport( session, view, '0', '0', 0 ) && m_options.fill )
+        {
+            sendExecutionReport( session, view, 'F', '2', qty );
+        }
+    }
+
+    template<typename SessionT, typename MsgViewT>
+    bool sendExecutionReport(
+        SessionT& session, const MsgViewT& view, char execType, char ordStatus, int64_t filled )
+    {
+        std::string_view clOrdId = view.get_string( 11 );
+        std::string_view symbol = view.get_string( 55 );
+        std::string_view side = view.get_string( 54 );
+        int64_t          qty = 0;
+        view.get_int( 38, qty );
+        uint64_t orderId = ++m_orderId;
+        bool     res = session.send( "8", [&]( typename SessionT::MsgType& msg ) {
+            return msg.add_int( 37, static_cast<int64_t>( orderId ) ) &&
+                   msg.add_int( 17, static_cast<int64_t>( orderId ) ) &&
+                   msg.add_field( 11, clOrdId ) && msg.add_char( 150, execType ) &&
+                   msg.add_char( 39, ordStatus ) && msg.add_field( 55, symbol ) &&
+                   msg.add_field( 54, side ) && msg.add_int( 38, qty ) &&
+                   ( filled == 0 ||
+                     ( msg.add_int( 32, filled ) && msg.add_decimal( 31, 10125, 2 ) ) ) &&
+                   msg.add_int( 151, ordStatus == '0' ? qty : 0 ) && msg.add_int( 14, filled ) &&
+                   msg.add_decimal( 6, filled != 0 ? 10125 : 0, 2 );
+        } );
+        if( res )
+        {
+            m_sent++;
+        }
+        return res;
+    }
+
+    template<typename MsgViewT>
+    void onExecutionReport( const MsgViewT& view )
+    {
+        char    execType;
+        int64_t sendTsc;
+        // the first report of an order closes its round trip
+        if( view.get_char( 150, execType ) && execType == '0' && view.get_int( 11, sendTsc ) )
+        {
+            m_roundTrip.record( readTsc() - static_cast<uint64_t>( sendTsc ) );
+        }
+    }
+
+    template<typename SessionT>
+    void injectFaults( SessionT& session )
+    {
+        uint64_t count = m_received + m_sent;
+        if( m_options.gapEvery != 0 && count % m_options.gapEvery == 0 )
+        {
+            injectGap( session );
+        }
+        if( m_options.resendEvery != 0 && count % m_options.resendEvery == 0 )
+        {
+            injectResend( session );
+        }
+        if( m_options.disconnectEvery != 0 && count % m_options.disconnectEvery == 0 )
+        {
+            session.disconnect();
+        }
+    }
+
+private:
+    const SimOptions&  m_options;
+    const bool         m_venue;
+    uint64_t           m_received;
+    uint64_t           m_sent;
+    uint64_t           m_orderId;
+    uint64_t           m_logons;
+    LatencyHistogram<> m_roundTrip;
+};
+
+template<typename EpollerComponentsT>
+class SimSessionComponents : public DefaultSessionComponents
 {
-    std::cout << "hello world!" << std::endl;
+public:
+    using EpollerComponents = EpollerComponentsT;
+    using TimerWheelComponents = SimTimerWheelComponents;
+    // replays keep several batches in flight when --zerocopy is on, and copy otherwise
+    using ResendRequestProcessorComponents = ZeroCopyResendRequestProcessorComponents;
+    using Application = SimApplication;
+};
+
+template<typename EpollerComponentsT>
+class SimAcceptorComponents : public DefaultAcceptorComponents
+{
+public:
+    using EpollerComponents = EpollerComponentsT;
+    using TimerWheelComponents = SimTimerWheelComponents;
+    using Handler = SessionAcceptorHandler<Session<SimSessionComponents<EpollerComponentsT>>>;
+};
+
+// One event loop: the venue's acceptor and its sessions, or the client sessions.
+// Everything here runs on the thread that calls run().
+template<typename EpollerComponentsT>
+class SimSide
+{
+public:
+    using SessionType = Session<SimSessionComponents<EpollerComponentsT>>;
+    using EpollerType = typename SessionType::EpollerType;
+    using TimerWheelType = typename SessionType::TimerWheelType;
+    using AcceptorType = Acceptor<SimAcceptorComponents<EpollerComponentsT>>;
+    using AcceptHandlerType = typename AcceptorType::Handler;
+
+    SimSide( SimSide& ) = delete;
+    SimSide& operator=( SimSide& ) = delete;
+
+    SimSide( const SimOptions& options, bool venue )
+        : m_options( options )
+        , m_venue( venue )
+        , m_name( venue ? "venue" : "client" )
+        , m_epollerConfig( options.spinMicros, 1 )
+        , m_socketConfig( options.port,
+                          options.ip,
+                          true,
+                          true,
+                          true,
+                          128,
+                          0,
+                          false,
+                          0,
+                          0,
+                          false,
+                          -1,
+                          -1,
+                          options.zeroCopy )
+        , m_epoller( m_epollerConfig )
+        , m_acceptor( m_socketConfig, m_epoller, m_timerWheel, m_acceptHandler )
+    {
+        for( size_t i = 0; i < options.sessions; i++ )
+        {
+            m_slots.emplace_back( std::make_unique<Slot>( *this, i ) );
+        }
+        m_pacer.callback = [this]() { onPacer(); };
+        m_acceptHandler.factory = [this]( const struct sockaddr_in& ) { return freeSession(); };
+    }
+
+    // venue: listens, client: connects every session
+    bool start()
+    {
+        if( !m_timerWheel.attach( m_epoller ) )
+        {
+            return false;
+        }
+        if( m_venue && !m_acceptor.start() )
+        {
+            return false;
+        }
+        uint64_t now = nowMillis();
+        m_startMillis = now;
+        m_statsMillis = now;
+        m_paceMillis = now;
+        for( auto& slot : m_slots )
+        {
+            slot->reconnectAt = now;
+        }
+        m_timerWheel.schedule( m_pacer, 1 );
+        return true;
+    }
+
+    // until a signal, "quit" or --duration
+    void run()
+    {
+        while( running.load( std::memory_order_relaxed ) )
+        {
+            if( !m_epoller.poll() )
+            {
+                break;
+            }
+        }
+        printStats();
+        for( auto& slot : m_slots )
+        {
+            slot->session.disconnect();
+        }
+    }
+
+    // takes commands from stdin on this side's thread
+    void watchStdin()
+    {
+        m_epoller.addEvent( STDIN_FILENO, [this]() { onStdin(); } );
+    }
+
+private:
+    struct Slot
+    {
+        Slot( SimSide& side, size_t index )
+            : config( side.m_venue ? side.m_options.venueId : side.m_options.clientId,
+                      side.m_venue ? side.m_options.clientId : side.m_options.venueId,
+                      !side.m_venue,
+                      side.m_options.heartBtInt,
+                      HeatBeatStyle::Passive,
+                      10,
+                      true,
+                      journalPath( side, index ) )
+            , app( side.m_options, side.m_venue )
+            , session( config, side.m_socketConfig, side.m_epoller, side.m_timerWheel, app )
+            , reconnectAt( 0 )
+            , ordersDue( 0 )
+        {
+        }
+
+        // a journal file per session, two sessions can't share one
+        static std::string journalPath( SimSide& side, size_t index )
+        {
+            if( side.m_options.journalDir.empty() )
+            {
+                return std::string();
+            }
+            return side.m_options.journalDir + "/" + side.m_name + "-" + std::to_string( index ) +
+                   ".journal";
+        }
+
+        DefaultSessionConfig config;
+        SimApplication       app;
+        SessionType          session;
+        uint64_t             reconnectAt;
+        // orders owed by the pacer, fractional rates carry over in thousandths
+        uint64_t             ordersDue;
+    };
+
+    // the venue's acceptor hands a new connection to the first idle session
+    SessionType* freeSession()
+    {
+        for( auto& slot : m_slots )
+        {
+            if( slot->session.getState() == SessionState::Disconnected )
+            {
+                slot->app.resetRoundTrip();
+                return &slot->session;
+            }
+        }
+        std::cout << m_name << ": all " << m_slots.size() << " sessions taken" << std::endl;
+        return nullptr;
+    }
+
+    // every millisecond: paces the orders, reconnects, prints stats
+    void onPacer()
+    {
+        m_timerWheel.schedule( m_pacer, 1 );
+        uint64_t now = nowMillis();
+        uint64_t elapsed = now - m_paceMillis;
+        m_paceMillis = now;
+        for( auto& slot : m_slots )
+        {
+            SessionType& session = slot->session;
+            if( !m_venue && session.getState() == SessionState::Disconnected )
+            {
+                slot->ordersDue = 0;
+                if( now >= slot->reconnectAt )
+                {
+                    slot->reconnectAt = now + m_options.reconnectMillis;
+                    session.connect();
+                }
+                continue;
+            }
+            if( m_venue || session.getState() != SessionState::Active )
+            {
+                continue;
+            }
+            slot->ordersDue += m_options.rate * elapsed;
+            // a stalled loop doesn't turn into a burst of more than a second's worth
+            slot->ordersDue = std::min( slot->ordersDue, m_options.rate * 1000 );
+            while( slot->ordersDue >= 1000 && session.getState() == SessionState::Active )
+            {
+                slot->ordersDue -= 1000;
+                slot->app.sendOrder( session );
+            }
+        }
+        if( m_options.statsSecs > 0 && now - m_statsMillis >= m_options.statsSecs * 1000u )
+        {
+            m_statsMillis = now;
+            printStats();
+        }
+        if( m_options.durationSecs > 0 && now - m_startMillis >= m_options.durationSecs * 1000u )
+        {
+            running.store( false );
+        }
+    }
+
+    void printStats()
+    {
+        std::lock_guard<std::mutex> lock( printMutex );
+        for( size_t i = 0; i < m_slots.size(); i++ )
+        {
+            Slot&       slot = *m_slots[i];
+            const char* state =
+                slot.session.getState() == SessionState::Active ? "active" : "down";
+            std::cout << m_name << " session " << i << " " << state << " logons "
+                      << slot.app.getLogons() << " sent " << slot.app.getSent() << " received "
+                      << slot.app.getReceived();
+            LatencySnapshot rtt = slot.app.getRoundTrip().snapshot();
+            if( rtt.count != 0 )
+            {
+                std::cout << " rtt n " << rtt.count << " p50 " << rtt.p50 / 1000 << "us p99 "
+                          << rtt.p99 / 1000 << "us p99.9 " << rtt.p999 / 1000 << "us max "
+                          << rtt.max / 1000 << "us";
+            }
+            std::cout << std::endl;
+            slot.app.resetRoundTrip();
+        }
+    }
+
+    void onStdin()
+    {
+        char    buf[256];
+        ssize_t res = ::read( STDIN_FILENO, buf, sizeof( buf ) );
+        if( res <= 0 )
+        {
+            // closed, keep running on the flags alone
+            m_epoller.removeEvent( STDIN_FILENO );
+            return;
+        }
+        m_stdinLine.append( buf, static_cast<size_t>( res ) );
+        size_t end;
+        while( ( end = m_stdinLine.find( '\n' ) ) != std::string::npos )
+        {
+            std::string line = m_stdinLine.substr( 0, end );
+            m_stdinLine.erase( 0, end + 1 );
+            onCommand( line );
+        }
+    }
+
+    // "<command> [session]", without a session index it applies to all of them
+    void onCommand( const std::string& line )
+    {
+        size_t      space = line.find( ' ' );
+        std::string command = line.substr( 0, space );
+        long        index = space == std::string::npos ? -1 : ::atol( line.c_str() + space + 1 );
+        if( command == "quit" )
+        {
+            running.store( false );
+            return;
+        }
+        if( command == "stats" )
+        {
+            printStats();
+            return;
+        }
+        if( command != "gap" && command != "resend" && command != "disconnect" &&
+            command != "logout" )
+        {
+            std::cout << "commands: gap|resend|disconnect|logout [session], stats, quit"
+                      << std::endl;
+            return;
+        }
+        for( size_t i = 0; i < m_slots.size(); i++ )
+        {
+            SessionType& session = m_slots[i]->session;
+            if( ( index >= 0 && static_cast<size_t>( index ) != i ) ||
+                session.getState() != SessionState::Active )
+            {
+                continue;
+            }
+            if( command == "gap" )
+            {
+                SimApplication::injectGap( session );
+            }
+            else if( command == "resend" )
+            {
+                SimApplication::injectResend( session );
+            }
+            else if( command == "disconnect" )
+            {
+                session.disconnect();
+            }
+            else
+            {
+                session.logout( "simulator logout" );
+            }
+            std::cout << m_name << " session " << i << ": " << command << std::endl;
+        }
+    }
+
+    const SimOptions&                   m_options;
+    const bool                          m_venue;
+    const char*                         m_name;
+    SpinEpollerConfig                   m_epollerConfig;
+    DefaultSocketConfig                 m_socketConfig;
+    EpollerType                         m_epoller;
+    TimerWheelType                      m_timerWheel;
+    AcceptHandlerType                   m_acceptHandler;
+    AcceptorType                        m_acceptor;
+    std::vector<std::unique_ptr<Slot>>  m_slots;
+    typename SessionType::TimerNodeType m_pacer;
+    uint64_t                            m_startMillis;
+    uint64_t                            m_statsMillis;
+    uint64_t                            m_paceMillis;
+    std::string                         m_stdinLine;
+};
+
+void usage( const char* name )
+{
+    std::cout << "usage: " << name << " [options]\n"
+              << "  --mode loopback|venue|client  (loopback)\n"
+              << "  --ip ADDR --port N            venue address (127.0.0.1:13898)\n"
+              << "  --sessions N                  sessions per side (1)\n"
+              << "  --rate N                      orders/s per client session (1000)\n"
+              << "  --fill                        venue fills every order after the ack\n"
+              << "  --heartbeat SECS              HeartBtInt (30)\n"
+              << "  --duration SECS               stop after, 0 runs until quit (0)\n"
+              << "  --stats SECS                  stats interval, 0 only at exit (5)\n"
+              << "  --gap-every N                 skip a MsgSeqNum every N app messages\n"
+              << "  --resend-every N              send a ResendRequest every N app messages\n"
+              << "  --disconnect-every N          drop the session every N app messages\n"
+              << "  --reconnect-ms N              client reconnect delay (1000)\n"
+              << "  --spin-us N                   busy poll before sleeping in epoll (0)\n"
+              << "  --io-uring                    io_uring event loop instead of epoll\n"
+              << "  --journal DIR                 journal outbound messages, replay resends\n"
+              << "  --zerocopy                    MSG_ZEROCOPY replays, needs --journal\n"
+              << "  --venue-id ID --client-id ID  CompIDs (VENUE, CLIENT)" << std::endl;
+}
+
+bool parseOptions( int argc, char* argv[], SimOptions& options )
+{
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if( arg == "--fill" )
+        {
+            options.fill = true;
+            continue;
+        }
+        if( arg == "--io-uring" )
+        {
+            options.ioUring = true;
+            continue;
+        }
+        if( arg == "--zerocopy" )
+        {
+            options.zeroCopy = true;
+            continue;
+        }
+        if( i + 1 >= argc )
+        {
+            return false;
+        }
+        const char* value = argv[++i];
+        if( arg == "--mode" )
+        {
+            options.mode = value;
+        }
+        else if( arg == "--ip" )
+        {
+            options.ip = value;
+        }
+        else if( arg == "--port" )
+        {
+            options.port = ::atoi( value );
+        }
+        else if( arg == "--sessions" )
+        {
+            options.sessions = ::strtoul( value, nullptr, 10 );
+        }
+        else if( arg == "--rate" )
+        {
+            options.rate = ::strtoull( value, nullptr, 10 );
+        }
+        else if( arg == "--heartbeat" )
+        {
+            options.heartBtInt = ::atoi( value );
+        }
+        else if( arg == "--duration" )
+        {
+            options.durationSecs = ::atoi( value );
+        }
+        else if( arg == "--stats" )
+        {
+            options.statsSecs = ::atoi( value );
+        }
+        else if( arg == "--gap-every" )
+        {
+            options.gapEvery = ::strtoull( value, nullptr, 10 );
+        }
+        else if( arg == "--resend-every" )
+        {
+            options.resendEvery = ::strtoull( value, nullptr, 10 );
+        }
+        else if( arg == "--disconnect-every" )
+        {
+            options.disconnectEvery = ::strtoull( value, nullptr, 10 );
+        }
+        else if( arg == "--reconnect-ms" )
+        {
+            options.reconnectMillis = ::atoi( value );
+        }
+        else if( arg == "--spin-us" )
+        {
+            options.spinMicros = ::atoi( value );
+        }
+        else if( arg == "--journal" )
+        {
+            options.journalDir = value;
+        }
+        else if( arg == "--venue-id" )
+        {
+            options.venueId = value;
+        }
+        else if( arg == "--client-id" )
+        {
+            options.clientId = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    // only replays send with MSG_ZEROCOPY, and only a journal replays
+    if( options.zeroCopy && options.journalDir.empty() )
+    {
+        return false;
+    }
+    return options.mode == "loopback" || options.mode == "venue" || options.mode == "client";
+}
+
+template<typename EpollerComponentsT>
+int simulate( const SimOptions& options )
+{
+    // the side on this thread takes the stdin commands: the venue unless there is none
+    bool                        withVenue = options.mode != "client";
+    bool                        withClient = options.mode != "venue";
+    SimSide<EpollerComponentsT> side( options, withVenue );
+    if( !side.start() )
+    {
+        return 1;
+    }
+    side.watchStdin();
+
+    std::thread clientThread;
+    if( withVenue && withClient )
+    {
+        clientThread = std::thread( [&options]() {
+            SimSide<EpollerComponentsT> client( options, false );
+            if( client.start() )
+            {
+                client.run();
+            }
+        } );
+    }
+    side.run();
+    running.store( false );
+    if( clientThread.joinable() )
+    {
+        clientThread.join();
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    SimOptions options;
+    if( !parseOptions( argc, argv, options ) )
+    {
+        usage( argv[0] );
+        return 1;
+    }
+    ::signal( SIGINT, onSignal );
+    ::signal( SIGTERM, onSignal );
+    ::signal( SIGPIPE, SIG_IGN );
+    // calibrate the tick length before any round trip is timed
+    tscNanosPerTick();
+
+    if( options.ioUring )
+    {
+        return simulate<DefaultIoUringEpollerComponents>( options );
+    }
+    return simulate<DefaultEpollerComponents>( options );
+}
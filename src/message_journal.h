@@ -0,0 +1,311 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace TinyFix {
+
+class DefaultMessageJournalComponents
+{
+public:
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // mapped size of a new journal, it doubles whenever it fills up
+    constexpr static size_t INITIAL_MAP_SIZE = 64 * 1024 * 1024;
+    // the seq num index is reserved one slot per this many mapped bytes and grows
+    // with the mapping, so appends never reallocate it
+    constexpr static size_t BYTES_PER_INDEX_SLOT = 64;
+    // largest step from one stored seq num to the next; the index is dense, a bigger
+    // jump (a mistaken setNextSenderMsgSeqNum(), a corrupt record) is refused
+    constexpr static uint64_t MAX_SEQ_GAP = 1024 * 1024;
+};
+
+enum JournalRecordFlags : uint32_t
+{
+    // session level message that is gap filled instead of resent
+    JOURNAL_ADMIN = 1 << 0,
+};
+
+struct JournalRecord
+{
+    const char* data = nullptr;
+    uint32_t    size = 0;
+    uint32_t    flags = 0;
+
+    bool valid() const
+    {
+        return data != nullptr;
+    }
+};
+
+// Append-only, memory-mapped store of every message sent on a session.
+// Records are [size, flags, seq, bytes] padded to 8 bytes, written straight into a
+// MAP_SHARED mapping so they survive a process restart without an explicit write;
+// open() rebuilds the seq num -> offset index by walking the records.
+// The index is dense: entry seq - firstSeq holds offset + 1, 0 for no record.
+// Pointers handed out by get() stay valid until the next append that grows the map.
+template<typename MessageJournalComponents = DefaultMessageJournalComponents>
+class MessageJournal
+{
+public:
+    using OutType = typename MessageJournalComponents::OutStreamType;
+    constexpr static auto&    out = MessageJournalComponents::outStream;
+    constexpr static size_t   INITIAL_MAP_SIZE = MessageJournalComponents::INITIAL_MAP_SIZE;
+    constexpr static size_t   BYTES_PER_INDEX_SLOT = MessageJournalComponents::BYTES_PER_INDEX_SLOT;
+    constexpr static uint64_t MAX_SEQ_GAP = MessageJournalComponents::MAX_SEQ_GAP;
+
+    struct RecordHeader
+    {
+        uint32_t size; // 0 terminates the journal, the file is zero filled past the end
+        uint32_t flags;
+        uint64_t seq;
+    };
+
+    MessageJournal( MessageJournal& ) = delete;
+    MessageJournal& operator=( MessageJournal& ) = delete;
+
+    MessageJournal()
+        : m_fd( -1 )
+        , m_map( nullptr )
+        , m_mapSize( 0 )
+        , m_writePos( 0 )
+        , m_firstSeq( 0 )
+        , m_lastSeq( 0 )
+    {
+    }
+
+    virtual ~MessageJournal()
+    {
+        close();
+    }
+
+    bool open( const std::string& path )
+    {
+        close();
+        m_fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+        if( m_fd == -1 )
+        {
+            out << "journal open failed: " << path << " " << ::strerror( errno )
+                << ". (errno: " << errno << ")" << std::endl;
+            return false;
+        }
+        struct stat st;
+        if( ::fstat( m_fd, &st ) == -1 )
+        {
+            out << "journal fstat failed: " << ::strerror( errno ) << std::endl;
+            close();
+            return false;
+        }
+        size_t size = static_cast<size_t>( st.st_size );
+        if( !map( size < INITIAL_MAP_SIZE ? INITIAL_MAP_SIZE : size ) )
+        {
+            close();
+            return false;
+        }
+        recover();
+        return true;
+    }
+
+    void close()
+    {
+        if( m_map != nullptr )
+        {
+            ::munmap( m_map, m_mapSize );
+            m_map = nullptr;
+        }
+        if( m_fd != -1 )
+        {
+            ::close( m_fd );
+            m_fd = -1;
+        }
+        m_mapSize = 0;
+        m_writePos = 0;
+        m_firstSeq = 0;
+        m_lastSeq = 0;
+        m_index.clear();
+    }
+
+    bool isOpen() const
+    {
+        return m_map != nullptr;
+    }
+
+    // drops every record, used when sequence numbers are reset
+    void reset()
+    {
+        if( m_map == nullptr )
+        {
+            return;
+        }
+        ::memset( m_map, 0, m_writePos );
+        m_writePos = 0;
+        m_firstSeq = 0;
+        m_lastSeq = 0;
+        m_index.clear();
+    }
+
+    // seq must be above every seq already stored, and at most MAX_SEQ_GAP past the last
+    bool append( uint64_t seq, const char* data, size_t size, uint32_t flags = 0 )
+    {
+        if( m_map == nullptr || size == 0 || size > UINT32_MAX || seq <= m_lastSeq )
+        {
+            return false;
+        }
+        if( m_lastSeq != 0 && seq - m_lastSeq > MAX_SEQ_GAP )
+        {
+            out << "journal refused seq " << seq << ", " << seq - m_lastSeq
+                << " past the last record (limit " << MAX_SEQ_GAP << ")" << std::endl;
+            return false;
+        }
+        size_t   recordSize = align( sizeof( RecordHeader ) + size );
+        uint64_t slots = m_firstSeq == 0 ? 1 : seq - m_firstSeq + 1;
+        // keep room for a zeroed terminating header after the record
+        size_t mapSize = m_mapSize;
+        while( m_writePos + recordSize + sizeof( RecordHeader ) > mapSize ||
+               slots > mapSize / BYTES_PER_INDEX_SLOT )
+        {
+            mapSize *= 2;
+        }
+        if( mapSize != m_mapSize && !map( mapSize ) )
+        {
+            return false;
+        }
+        char*         record = m_map + m_writePos;
+        RecordHeader* header = reinterpret_cast<RecordHeader*>( record );
+        ::memcpy( record + sizeof( RecordHeader ), data, size );
+        header->flags = flags;
+        header->seq = seq;
+        // leftovers of a torn write must not look like a record on recovery
+        ::memset( record + recordSize, 0, sizeof( RecordHeader ) );
+        // size last, a record with size 0 is not there yet
+        __atomic_store_n( &header->size, static_cast<uint32_t>( size ), __ATOMIC_RELEASE );
+        addIndex( seq, m_writePos );
+        m_writePos += recordSize;
+        return true;
+    }
+
+    JournalRecord get( uint64_t seq ) const
+    {
+        JournalRecord res;
+        if( seq < m_firstSeq || seq > m_lastSeq || m_firstSeq == 0 )
+        {
+            return res;
+        }
+        uint64_t slot = m_index[seq - m_firstSeq];
+        if( slot == 0 )
+        {
+            return res;
+        }
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>( m_map + slot - 1 );
+        res.data = m_map + slot - 1 + sizeof( RecordHeader );
+        res.size = header->size;
+        res.flags = header->flags;
+        return res;
+    }
+
+    uint64_t getFirstSeq() const
+    {
+        return m_firstSeq;
+    }
+
+    // 0 if empty
+    uint64_t getLastSeq() const
+    {
+        return m_lastSeq;
+    }
+
+    // flushes the mapping to disk, the page cache already survives a process crash
+    bool sync()
+    {
+        return m_map == nullptr || ::msync( m_map, m_writePos, MS_SYNC ) == 0;
+    }
+
+private:
+    static size_t align( size_t size )
+    {
+        return ( size + 7 ) & ~static_cast<size_t>( 7 );
+    }
+
+    bool map( size_t size )
+    {
+        if( ::ftruncate( m_fd, static_cast<off_t>( size ) ) == -1 )
+        {
+            out << "journal ftruncate failed: " << ::strerror( errno ) << ". (errno: " << errno
+                << ")" << std::endl;
+            return false;
+        }
+        void* res;
+        if( m_map == nullptr )
+        {
+            res = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+        }
+        else
+        {
+            res = ::mremap( m_map, m_mapSize, size, MREMAP_MAYMOVE );
+        }
+        if( res == MAP_FAILED )
+        {
+            out << "journal mmap failed: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                << std::endl;
+            return false;
+        }
+        m_map = static_cast<char*>( res );
+        m_mapSize = size;
+        // the index grows here rather than on append, which only fills reserved slots
+        m_index.reserve( size / BYTES_PER_INDEX_SLOT );
+        return true;
+    }
+
+    void addIndex( uint64_t seq, size_t offset )
+    {
+        if( m_firstSeq == 0 )
+        {
+            m_firstSeq = seq;
+        }
+        m_index.resize( seq - m_firstSeq + 1, 0 );
+        m_index[seq - m_firstSeq] = offset + 1;
+        m_lastSeq = seq;
+    }
+
+    void recover()
+    {
+        m_writePos = 0;
+        while( m_writePos + sizeof( RecordHeader ) <= m_mapSize )
+        {
+            const RecordHeader* header = reinterpret_cast<const RecordHeader*>( m_map + m_writePos );
+            size_t              recordSize = align( sizeof( RecordHeader ) + header->size );
+            if( header->size == 0 || m_writePos + recordSize > m_mapSize ||
+                header->seq <= m_lastSeq ||
+                ( m_lastSeq != 0 && header->seq - m_lastSeq > MAX_SEQ_GAP ) )
+            {
+                break;
+            }
+            addIndex( header->seq, m_writePos );
+            m_writePos += recordSize;
+        }
+        // anything after the last good record is a torn write
+        size_t tail = m_mapSize - m_writePos < sizeof( RecordHeader ) ? m_mapSize - m_writePos
+                                                                       : sizeof( RecordHeader );
+        ::memset( m_map + m_writePos, 0, tail );
+    }
+
+    int                   m_fd;
+    char*                 m_map;
+    size_t                m_mapSize;
+    size_t                m_writePos;
+    uint64_t              m_firstSeq;
+    uint64_t              m_lastSeq;
+    std::vector<uint64_t> m_index;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+
+#include "tiny_fix_msg.h"
+
+namespace TinyFix {
+
+class DefaultMsgPoolComponents
+{
+public:
+    using MsgComponents = DefaultTinyFixMsgComponents;
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // block sizes are DEFAULT_ALLOC_SIZE << 0 .. NUM_SIZE_CLASSES - 1, 512B to 64KB by
+    // default; 64KB is as large as a message gets
+    constexpr static int NUM_SIZE_CLASSES = 8;
+    // memory is mapped a chunk at a time and carved into blocks of one size class
+    constexpr static size_t CHUNK_SIZE = 2 * 1024 * 1024;
+    // back chunks with explicit 2MB huge pages (MAP_HUGETLB, needs vm.nr_hugepages),
+    // falling back to transparent huge pages when none are left
+    constexpr static bool HUGE_PAGES = false;
+};
+
+// Pool of fixed size message blocks owned by one thread, e.g. a reactor.
+// Blocks come in power of two size classes; each class keeps a plain free list for
+// the owner, blocks released on any other thread go onto a lock-free list the owner
+// takes over in one exchange when a class runs dry. Memory comes from mmap()ed chunks
+// that are kept until the pool is destroyed, so once reserve() has warmed the pool
+// up the steady state never calls into malloc or the kernel.
+// Block and Msg are RAII handles that give the block back on destruction, from
+// whichever thread holds them last. The pool must outlive every handle.
+template<typename MsgPoolComponentsT = DefaultMsgPoolComponents>
+class MsgPool
+{
+public:
+    using MsgType = TinyFixMsgBase<typename MsgPoolComponentsT::MsgComponents>;
+    using OutType = typename MsgPoolComponentsT::OutStreamType;
+    constexpr static auto&  out = MsgPoolComponentsT::outStream;
+    constexpr static size_t MIN_BLOCK_SIZE = MsgType::DEFAULT_ALLOC_SIZE;
+    constexpr static int    NUM_SIZE_CLASSES = MsgPoolComponentsT::NUM_SIZE_CLASSES;
+    constexpr static size_t CHUNK_SIZE = MsgPoolComponentsT::CHUNK_SIZE;
+    constexpr static bool   HUGE_PAGES = MsgPoolComponentsT::HUGE_PAGES;
+    constexpr static size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << ( NUM_SIZE_CLASSES - 1 );
+    constexpr static size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    static_assert( ( MIN_BLOCK_SIZE & ( MIN_BLOCK_SIZE - 1 ) ) == 0,
+                   "DEFAULT_ALLOC_SIZE must be a power of two" );
+    static_assert( !HUGE_PAGES || CHUNK_SIZE % HUGE_PAGE_SIZE == 0,
+                   "huge page chunks must be a multiple of 2MB" );
+
+private:
+    // in front of every block, a cache line of its own so the data is line aligned;
+    // Msg handles build their encoder in it
+    struct alignas( 64 ) BlockHeader
+    {
+        BlockHeader* next;
+        MsgPool*     owner;
+        uint8_t      sizeClass;
+        typename std::aligned_storage<sizeof( MsgType ), alignof( MsgType )>::type msg;
+
+        char* data()
+        {
+            return reinterpret_cast<char*>( this + 1 );
+        }
+    };
+
+    // at the start of every mapping, chunks are only unmapped with the pool
+    struct alignas( 64 ) ChunkHeader
+    {
+        ChunkHeader* next;
+        size_t       size;
+    };
+
+public:
+    // a raw block, released back to its pool when the handle goes
+    class Block
+    {
+    public:
+        Block()
+            : m_header( nullptr )
+        {
+        }
+        Block( Block&& other )
+            : m_header( std::exchange( other.m_header, nullptr ) )
+        {
+        }
+        Block& operator=( Block&& other )
+        {
+            if( this != &other )
+            {
+                reset();
+                m_header = std::exchange( other.m_header, nullptr );
+            }
+            return *this;
+        }
+        ~Block()
+        {
+            reset();
+        }
+
+        explicit operator bool() const
+        {
+            return m_header != nullptr;
+        }
+
+        char* data() const
+        {
+            return m_header->data();
+        }
+
+        size_t size() const
+        {
+            return blockSize( m_header->sizeClass );
+        }
+
+        void reset()
+        {
+            if( m_header != nullptr )
+            {
+                m_header->owner->release( m_header );
+                m_header = nullptr;
+            }
+        }
+
+    private:
+        friend class MsgPool;
+        explicit Block( BlockHeader* header )
+            : m_header( header )
+        {
+        }
+
+        BlockHeader* m_header;
+    };
+
+    // a TinyFixMsgBase encoding straight into a pooled block
+    class Msg
+    {
+    public:
+        Msg()
+            : m_header( nullptr )
+        {
+        }
+        Msg( Msg&& other )
+            : m_header( std::exchange( other.m_header, nullptr ) )
+        {
+        }
+        Msg& operator=( Msg&& other )
+        {
+            if( this != &other )
+            {
+                reset();
+                m_header = std::exchange( other.m_header, nullptr );
+            }
+            return *this;
+        }
+        ~Msg()
+        {
+            reset();
+        }
+
+        explicit operator bool() const
+        {
+            return m_header != nullptr;
+        }
+
+        MsgType* get() const
+        {
+            return std::launder( reinterpret_cast<MsgType*>( &m_header->msg ) );
+        }
+        MsgType& operator*() const
+        {
+            return *get();
+        }
+        MsgType* operator->() const
+        {
+            return get();
+        }
+
+        void reset()
+        {
+            if( m_header != nullptr )
+            {
+                get()->~MsgType();
+                m_header->owner->release( m_header );
+                m_header = nullptr;
+            }
+        }
+
+    private:
+        friend class MsgPool;
+        explicit Msg( BlockHeader* header )
+            : m_header( header )
+        {
+            new( &header->msg ) MsgType( header->data(), blockSize( header->sizeClass ) );
+        }
+
+        BlockHeader* m_header;
+    };
+
+    MsgPool( const MsgPool& ) = delete;
+    MsgPool& operator=( const MsgPool& ) = delete;
+
+    MsgPool()
+        : m_owner( std::this_thread::get_id() )
+        , m_chunks( nullptr )
+        , m_mappedBytes( 0 )
+        , m_remoteFree( nullptr )
+    {
+        for( auto& head : m_free )
+        {
+            head = nullptr;
+        }
+    }
+
+    virtual ~MsgPool()
+    {
+        while( m_chunks != nullptr )
+        {
+            ChunkHeader* chunk = m_chunks;
+            m_chunks = chunk->next;
+            ::munmap( chunk, chunk->size );
+        }
+    }
+
+    // makes the calling thread the owner, for pools built before their thread runs
+    void adopt()
+    {
+        m_owner = std::this_thread::get_id();
+    }
+
+    // owner thread: a block of at least size bytes, empty if size is over
+    // MAX_BLOCK_SIZE or no memory could be mapped
+    Block allocate( size_t size )
+    {
+        return Block( take( size ) );
+    }
+
+    // owner thread: an empty message in a block of at least size bytes
+    Msg allocateMsg( size_t size = MIN_BLOCK_SIZE )
+    {
+        BlockHeader* header = take( size );
+        return header != nullptr ? Msg( header ) : Msg();
+    }
+
+    // owner thread: maps enough chunks up front that count blocks of size are free
+    bool reserve( size_t size, size_t count )
+    {
+        int sizeClass = sizeClassOf( size );
+        if( sizeClass < 0 )
+        {
+            return false;
+        }
+        collectRemote();
+        size_t free = 0;
+        for( BlockHeader* block = m_free[sizeClass]; block != nullptr; block = block->next )
+        {
+            free++;
+        }
+        while( free < count )
+        {
+            size_t added = refill( sizeClass );
+            if( added == 0 )
+            {
+                return false;
+            }
+            free += added;
+        }
+        return true;
+    }
+
+    static size_t blockSize( int sizeClass )
+    {
+        return MIN_BLOCK_SIZE << sizeClass;
+    }
+
+    // smallest class that holds size, -1 if none does
+    static int sizeClassOf( size_t size )
+    {
+        int sizeClass = 0;
+        while( sizeClass < NUM_SIZE_CLASSES && blockSize( sizeClass ) < size )
+        {
+            sizeClass++;
+        }
+        return sizeClass < NUM_SIZE_CLASSES ? sizeClass : -1;
+    }
+
+    size_t getMappedBytes() const
+    {
+        return m_mappedBytes;
+    }
+
+private:
+    BlockHeader* take( size_t size )
+    {
+        int sizeClass = sizeClassOf( size );
+        if( sizeClass < 0 )
+        {
+            out << "msg pool: no size class for " << size << " bytes" << std::endl;
+            return nullptr;
+        }
+        if( m_free[sizeClass] == nullptr )
+        {
+            collectRemote();
+            if( m_free[sizeClass] == nullptr && refill( sizeClass ) == 0 )
+            {
+                return nullptr;
+            }
+        }
+        BlockHeader* block = m_free[sizeClass];
+        m_free[sizeClass] = block->next;
+        return block;
+    }
+
+    void release( BlockHeader* block )
+    {
+        if( std::this_thread::get_id() == m_owner )
+        {
+            block->next = m_free[block->sizeClass];
+            m_free[block->sizeClass] = block;
+            return;
+        }
+        // push only, the owner takes the whole list at once, so no ABA
+        BlockHeader* head = m_remoteFree.load( std::memory_order_relaxed );
+        do
+        {
+            block->next = head;
+        } while( !m_remoteFree.compare_exchange_weak(
+            head, block, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    void collectRemote()
+    {
+        BlockHeader* block = m_remoteFree.exchange( nullptr, std::memory_order_acquire );
+        while( block != nullptr )
+        {
+            BlockHeader* next = block->next;
+            block->next = m_free[block->sizeClass];
+            m_free[block->sizeClass] = block;
+            block = next;
+        }
+    }
+
+    // maps one chunk and carves it into blocks of sizeClass, returns how many
+    size_t refill( int sizeClass )
+    {
+        size_t stride = sizeof( BlockHeader ) + blockSize( sizeClass );
+        size_t size = CHUNK_SIZE;
+        if( size < sizeof( ChunkHeader ) + stride )
+        {
+            // a block larger than a chunk gets a chunk of its own, in whole huge pages
+            size = sizeof( ChunkHeader ) + stride + HUGE_PAGE_SIZE - 1;
+            size &= ~( HUGE_PAGE_SIZE - 1 );
+        }
+        char* base = map( size );
+        if( base == nullptr )
+        {
+            return 0;
+        }
+        ChunkHeader* chunk = reinterpret_cast<ChunkHeader*>( base );
+        chunk->next = m_chunks;
+        chunk->size = size;
+        m_chunks = chunk;
+        m_mappedBytes += size;
+
+        size_t count = ( size - sizeof( ChunkHeader ) ) / stride;
+        // linked back to front so blocks are handed out in address order
+        for( size_t i = count; i-- > 0; )
+        {
+            BlockHeader* block =
+                reinterpret_cast<BlockHeader*>( base + sizeof( ChunkHeader ) + i * stride );
+            block->owner = this;
+            block->sizeClass = static_cast<uint8_t>( sizeClass );
+            block->next = m_free[sizeClass];
+            m_free[sizeClass] = block;
+        }
+        return count;
+    }
+
+    char* map( size_t size )
+    {
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+        void*     res = MAP_FAILED;
+        if( HUGE_PAGES )
+        {
+            res = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0 );
+            if( res == MAP_FAILED )
+            {
+                out << "msg pool: no huge pages left, falling back: " << ::strerror( errno )
+                    << ". (errno: " << errno << ")" << std::endl;
+            }
+        }
+        if( res == MAP_FAILED )
+        {
+            res = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0 );
+            if( res == MAP_FAILED )
+            {
+                out << "msg pool mmap failed: " << ::strerror( errno ) << ". (errno: " << errno
+                    << ")" << std::endl;
+                return nullptr;
+            }
+            if( HUGE_PAGES )
+            {
+                ::madvise( res, size, MADV_HUGEPAGE );
+            }
+        }
+        return static_cast<char*>( res );
+    }
+
+    std::thread::id m_owner;
+    BlockHeader*    m_free[NUM_SIZE_CLASSES];
+    ChunkHeader*    m_chunks;
+    size_t          m_mappedBytes;
+    // blocks released by other threads, they push, the owner takes all
+    alignas( 64 ) std::atomic<BlockHeader*> m_remoteFree;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <type_traits>
+
+#include "epoller.h"
+#include "io_uring_epoller.h"
+
+namespace TinyFix {
+
+// EpollerComponents::BACKEND, epoll for components written before there was a choice
+template<typename EpollerComponentsT, typename = void>
+struct PollerBackendOf
+{
+    constexpr static PollerBackend value = PollerBackend::Epoll;
+};
+
+template<typename EpollerComponentsT>
+struct PollerBackendOf<EpollerComponentsT, std::void_t<decltype( EpollerComponentsT::BACKEND )>>
+{
+    constexpr static PollerBackend value = EpollerComponentsT::BACKEND;
+};
+
+// The event loop EpollerComponents selects: Epoller, or IoUringEpoller with the same
+// addEvent / removeEvent / modifyEvent / poll surface. Modules that own or take an
+// event loop name it through this, so switching the backend is a Components change.
+template<typename EpollerComponentsT>
+using Poller = typename std::conditional<PollerBackendOf<EpollerComponentsT>::value ==
+                                             PollerBackend::IoUring,
+                                         IoUringEpoller<EpollerComponentsT>,
+                                         Epoller<EpollerComponentsT>>::type;
+
+} // namespace TinyFix
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "poller.h"
+#include "timer_wheel.h"
+#include "lockfree_queue.h"
+#include "reactor_group_misc.h"
+
+namespace TinyFix {
+
+// One event loop on its own thread: an Epoller, the TimerWheel ticking on it and an
+// eventfd woken task queue other threads hand work to. Everything registered on the
+// Epoller or the wheel, sessions included, must be touched from this thread only;
+// code running elsewhere goes through post().
+template<typename ReactorGroupComponentsT = DefaultReactorGroupComponents>
+class Reactor
+{
+public:
+    using EpollerType = Poller<typename ReactorGroupComponentsT::EpollerComponents>;
+    using TimerWheelType = TimerWheel<typename ReactorGroupComponentsT::TimerWheelComponents>;
+    using Task = typename ReactorGroupComponentsT::Task;
+    using TaskQueueType = MPSCQueue<Task, typename ReactorGroupComponentsT::TaskQueueComponents>;
+    using OutType = typename ReactorGroupComponentsT::OutStreamType;
+    constexpr static auto&  out = ReactorGroupComponentsT::outStream;
+    constexpr static size_t TASK_QUEUE_SIZE = ReactorGroupComponentsT::TASK_QUEUE_SIZE;
+
+    Reactor( Reactor& ) = delete;
+    Reactor& operator=( Reactor& ) = delete;
+
+    Reactor( EpollerConfigBase& epollerConfig, size_t index, int core )
+        : m_epoller( epollerConfig )
+        , m_tasks( TASK_QUEUE_SIZE )
+        , m_index( index )
+        , m_core( core )
+        , m_wakeFd( -1 )
+        , m_wakePending( false )
+        , m_running( false )
+        , m_load( 0 )
+    {
+    }
+
+    virtual ~Reactor()
+    {
+        stop();
+        if( m_wakeFd != -1 )
+        {
+            m_epoller.removeEvent( m_wakeFd );
+            ::close( m_wakeFd );
+        }
+    }
+
+    // registers the wake fd and the wheel, then starts the loop thread
+    bool start()
+    {
+        if( m_thread.joinable() )
+        {
+            return false;
+        }
+        if( m_wakeFd == -1 )
+        {
+            m_wakeFd = ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+            if( m_wakeFd == -1 )
+            {
+                out << "reactor " << m_index << " eventfd failed: " << ::strerror( errno )
+                    << ". (errno: " << errno << ")" << std::endl;
+                return false;
+            }
+            if( !m_epoller.addEvent( m_wakeFd, [this]() { onWake(); } ) ||
+                !m_timerWheel.attach( m_epoller ) )
+            {
+                return false;
+            }
+        }
+        m_running.store( true, std::memory_order_release );
+        m_thread = std::thread( [this]() { run(); } );
+        return true;
+    }
+
+    // asks the loop to return and joins it; tasks still queued stay queued
+    void stop()
+    {
+        if( !m_thread.joinable() )
+        {
+            return;
+        }
+        m_running.store( false, std::memory_order_release );
+        wake();
+        m_thread.join();
+    }
+
+    // Queues task to run on this reactor's thread, from any thread. Tasks from one
+    // thread run in the order they were posted. False when the queue is full.
+    template<typename TaskT>
+    bool post( TaskT&& task )
+    {
+        if( !m_tasks.tryPush( std::forward<TaskT>( task ) ) )
+        {
+            out << "reactor " << m_index << " task queue full" << std::endl;
+            return false;
+        }
+        wake();
+        return true;
+    }
+
+    bool inReactorThread() const
+    {
+        return std::this_thread::get_id() == m_thread.get_id();
+    }
+
+    EpollerType& getEpoller()
+    {
+        return m_epoller;
+    }
+
+    TimerWheelType& getTimerWheel()
+    {
+        return m_timerWheel;
+    }
+
+    size_t getIndex() const
+    {
+        return m_index;
+    }
+
+    int getCore() const
+    {
+        return m_core;
+    }
+
+    // sessions the group has assigned here, see ReactorGroup::assign()
+    uint32_t getLoad() const
+    {
+        return m_load.load( std::memory_order_relaxed );
+    }
+
+    void addLoad( int32_t delta )
+    {
+        m_load.fetch_add( static_cast<uint32_t>( delta ), std::memory_order_relaxed );
+    }
+
+private:
+    void run()
+    {
+        pin();
+        while( m_running.load( std::memory_order_acquire ) )
+        {
+            if( !m_epoller.poll() )
+            {
+                break;
+            }
+        }
+    }
+
+    void pin()
+    {
+        std::string name = "tinyfix-r" + std::to_string( m_index );
+        ::pthread_setname_np( ::pthread_self(), name.c_str() );
+        if( m_core < 0 )
+        {
+            return;
+        }
+        cpu_set_t cpus;
+        CPU_ZERO( &cpus );
+        CPU_SET( m_core, &cpus );
+        // pthread calls return the error instead of setting errno
+        int res = ::pthread_setaffinity_np( ::pthread_self(), sizeof( cpus ), &cpus );
+        if( res != 0 )
+        {
+            out << "reactor " << m_index << " pin to core " << m_core
+                << " failed: " << ::strerror( res ) << ". (errno: " << res << ")" << std::endl;
+        }
+    }
+
+    // One eventfd write per batch of posts: only the post that finds no wake-up
+    // pending writes, the loop clears the flag before it drains the queue.
+    void wake()
+    {
+        if( !m_wakePending.exchange( true, std::memory_order_acq_rel ) )
+        {
+            uint64_t one = 1;
+            ssize_t  res = ::write( m_wakeFd, &one, sizeof( one ) );
+            (void)res;
+        }
+    }
+
+    void onWake()
+    {
+        uint64_t count;
+        ssize_t  res = ::read( m_wakeFd, &count, sizeof( count ) );
+        (void)res;
+        // an exchange, not a store, so a post that saw the flag still set is visible
+        // to the drain below
+        m_wakePending.exchange( false, std::memory_order_acq_rel );
+        // bounded so tasks that post back to this reactor can't starve the sockets
+        m_tasks.consume(
+            []( Task& task ) {
+                task();
+                task = Task();
+            },
+            TASK_QUEUE_SIZE );
+        if( !m_tasks.empty() )
+        {
+            wake();
+        }
+    }
+
+    EpollerType    m_epoller;
+    TimerWheelType m_timerWheel;
+    TaskQueueType  m_tasks;
+    const size_t   m_index;
+    const int      m_core;
+    int            m_wakeFd;
+    std::thread    m_thread;
+
+    std::atomic<bool>     m_wakePending;
+    std::atomic<bool>     m_running;
+    std::atomic<uint32_t> m_load;
+};
+
+// Thread per core: one Reactor per configured core, new sessions are spread over
+// them by the ShardPolicy. A gateway accepts on its own thread, picks a reactor with
+// assign( targetCompID ) and posts a task there that builds the Session on the
+// reactor's Epoller and TimerWheel and calls accept( fd ); from then on the session
+// lives on that thread. Reactors never share sessions, nothing past post() locks.
+template<typename ReactorGroupComponentsT = DefaultReactorGroupComponents>
+class ReactorGroup
+{
+public:
+    using ReactorType = Reactor<ReactorGroupComponentsT>;
+    using ShardPolicy = typename ReactorGroupComponentsT::ShardPolicy;
+    using Task = typename ReactorType::Task;
+
+    ReactorGroup( ReactorGroup& ) = delete;
+    ReactorGroup& operator=( ReactorGroup& ) = delete;
+
+    ReactorGroup( ReactorGroupConfigBase& config, EpollerConfigBase& epollerConfig )
+    {
+        const std::vector<int>& cores = config.getCores();
+        for( size_t i = 0; i < cores.size(); i++ )
+        {
+            m_reactors.emplace_back( std::make_unique<ReactorType>( epollerConfig, i, cores[i] ) );
+        }
+    }
+
+    virtual ~ReactorGroup()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        for( auto& reactor : m_reactors )
+        {
+            if( !reactor->start() )
+            {
+                stop();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        for( auto& reactor : m_reactors )
+        {
+            reactor->stop();
+        }
+    }
+
+    size_t size() const
+    {
+        return m_reactors.size();
+    }
+
+    ReactorType& at( size_t index )
+    {
+        return *m_reactors[index];
+    }
+
+    const ReactorType& at( size_t index ) const
+    {
+        return *m_reactors[index];
+    }
+
+    // picks the reactor for a new session keyed by key and counts it there until
+    // unassign()
+    ReactorType& assign( std::string_view key )
+    {
+        ReactorType& reactor = *m_reactors[m_policy.pick( *this, key )];
+        reactor.addLoad( 1 );
+        return reactor;
+    }
+
+    // the session assign() placed on reactor is gone
+    void unassign( ReactorType& reactor )
+    {
+        reactor.addLoad( -1 );
+    }
+
+    template<typename TaskT>
+    bool post( size_t index, TaskT&& task )
+    {
+        return m_reactors[index]->post( std::forward<TaskT>( task ) );
+    }
+
+    ShardPolicy& getShardPolicy()
+    {
+        return m_policy;
+    }
+
+private:
+    std::vector<std::unique_ptr<ReactorType>> m_reactors;
+    ShardPolicy                               m_policy;
+};
+
+} // namespace TinyFix
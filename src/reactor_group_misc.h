@@ -0,0 +1,121 @@
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <string_view>
+#include <functional>
+#include <stdint.h>
+
+#include "epoller_misc.h"
+#include "timer_wheel_misc.h"
+#include "lockfree_queue_misc.h"
+
+namespace TinyFix {
+
+// Shard policies: pick( group, key ) returns the index of the reactor a new session
+// goes to. key is whatever the caller shards on, normally the counterparty CompID.
+// pick() may be called from any thread.
+
+// spreads sessions in turn, ignores the key
+class RoundRobinShardPolicy
+{
+public:
+    template<typename ReactorGroupT>
+    size_t pick( const ReactorGroupT& group, std::string_view )
+    {
+        return m_next.fetch_add( 1, std::memory_order_relaxed ) % group.size();
+    }
+
+private:
+    std::atomic<size_t> m_next{ 0 };
+};
+
+// the reactor currently running the fewest sessions, the lowest index on a tie
+class LeastLoadedShardPolicy
+{
+public:
+    template<typename ReactorGroupT>
+    size_t pick( const ReactorGroupT& group, std::string_view )
+    {
+        size_t   best = 0;
+        uint32_t bestLoad = UINT32_MAX;
+        for( size_t i = 0; i < group.size(); i++ )
+        {
+            uint32_t load = group.at( i ).getLoad();
+            if( load < bestLoad )
+            {
+                best = i;
+                bestLoad = load;
+            }
+        }
+        return best;
+    }
+};
+
+// FNV-1a of the key, so a counterparty lands on the same reactor (and core) across
+// reconnects and restarts as long as the group size stays the same
+class CompIDHashShardPolicy
+{
+public:
+    template<typename ReactorGroupT>
+    size_t pick( const ReactorGroupT& group, std::string_view key )
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for( char c : key )
+        {
+            hash ^= static_cast<uint8_t>( c );
+            hash *= 1099511628211ull;
+        }
+        return hash % group.size();
+    }
+};
+
+class DefaultReactorGroupComponents
+{
+public:
+    using EpollerComponents = DefaultEpollerComponents;
+    using TimerWheelComponents = DefaultTimerWheelComponents;
+    // the task queue is only ever drained from the reactor's own loop, it never waits
+    using TaskQueueComponents = DefaultLockFreeQueueComponents;
+    using ShardPolicy = RoundRobinShardPolicy;
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // cross-reactor tasks; they run on the target reactor's thread
+    using Task = std::function<void( void )>;
+    // tasks that can be queued on one reactor before post() fails
+    constexpr static size_t TASK_QUEUE_SIZE = 4096;
+};
+
+class ReactorGroupConfigBase
+{
+public:
+    // one reactor per entry: the core its thread is pinned to, -1 leaves it unpinned
+    virtual const std::vector<int>& getCores() const = 0;
+    virtual ~ReactorGroupConfigBase()
+    {
+    }
+};
+
+class DefaultReactorGroupConfig : public ReactorGroupConfigBase
+{
+public:
+    DefaultReactorGroupConfig( std::vector<int> cores )
+        : m_cores( cores )
+    {
+    }
+
+    ~DefaultReactorGroupConfig()
+    {
+    }
+
+    virtual const std::vector<int>& getCores() const
+    {
+        return m_cores;
+    }
+
+private:
+    const std::vector<int> m_cores;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <iostream>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace TinyFix {
+
+class DefaultRecvBufferComponents
+{
+public:
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // size of the ring once something arrives, an idle socket maps nothing
+    constexpr static size_t INITIAL_SIZE = 64 * 1024;
+    // the ring doubles under backlog up to this, a peer that far ahead is not keeping up
+    constexpr static size_t MAX_SIZE = 16 * 1024 * 1024;
+};
+
+// Receive ring backed by one memfd mapped twice back to back, so the readable bytes
+// are contiguous even when they wrap and a message never has to be reassembled or
+// moved to the front. Reads append at writeHead() and commit(), the parser works on
+// readHead() / readable() and consume()s what it is done with.
+// Nothing is mapped until the first reserve(); the ring grows only when the free
+// space runs short, into a fresh mapping the unconsumed bytes are copied to.
+template<typename RecvBufferComponentsT = DefaultRecvBufferComponents>
+class RecvBuffer
+{
+public:
+    using OutType = typename RecvBufferComponentsT::OutStreamType;
+    constexpr static auto&  out = RecvBufferComponentsT::outStream;
+    constexpr static size_t INITIAL_SIZE = RecvBufferComponentsT::INITIAL_SIZE;
+    constexpr static size_t MAX_SIZE = RecvBufferComponentsT::MAX_SIZE;
+
+    static_assert( ( INITIAL_SIZE & ( INITIAL_SIZE - 1 ) ) == 0 && INITIAL_SIZE >= 4096,
+                   "ring size must be a power of two multiple of the page size" );
+    static_assert( MAX_SIZE >= INITIAL_SIZE, "MAX_SIZE below INITIAL_SIZE" );
+
+    RecvBuffer( const RecvBuffer& ) = delete;
+    RecvBuffer& operator=( const RecvBuffer& ) = delete;
+
+    RecvBuffer()
+        : m_base( nullptr )
+        , m_capacity( 0 )
+        , m_head( 0 )
+        , m_tail( 0 )
+    {
+    }
+
+    ~RecvBuffer()
+    {
+        release();
+    }
+
+    // Makes sure at least minFree bytes can be written, growing the ring if needed.
+    // False if that would take it past MAX_SIZE or the mapping fails.
+    bool reserve( size_t minFree )
+    {
+        if( m_base != nullptr && writable() >= minFree )
+        {
+            return true;
+        }
+        size_t capacity = m_capacity == 0 ? INITIAL_SIZE : m_capacity;
+        while( capacity - readable() < minFree && capacity <= MAX_SIZE / 2 )
+        {
+            capacity *= 2;
+        }
+        if( capacity - readable() < minFree )
+        {
+            out << "recv buffer full. (size: " << m_capacity << ")" << std::endl;
+            return false;
+        }
+        return remap( capacity );
+    }
+
+    // frees the mapping, e.g. when the connection is closed
+    void release()
+    {
+        if( m_base != nullptr )
+        {
+            ::munmap( m_base, m_capacity * 2 );
+            m_base = nullptr;
+        }
+        m_capacity = 0;
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    void clear()
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    char* writeHead()
+    {
+        return m_base + ( m_tail & ( m_capacity - 1 ) );
+    }
+
+    size_t writable() const
+    {
+        return m_capacity - readable();
+    }
+
+    void commit( size_t size )
+    {
+        m_tail += size;
+    }
+
+    char* readHead()
+    {
+        return m_base + ( m_head & ( m_capacity - 1 ) );
+    }
+
+    size_t readable() const
+    {
+        return static_cast<size_t>( m_tail - m_head );
+    }
+
+    void consume( size_t size )
+    {
+        m_head += size;
+        if( m_head == m_tail )
+        {
+            // back to the start so the next read lands on warm lines
+            m_head = 0;
+            m_tail = 0;
+        }
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    bool remap( size_t capacity )
+    {
+        int fd = ::memfd_create( "tinyfix_recv", MFD_CLOEXEC );
+        if( fd == -1 )
+        {
+            out << "recv buffer memfd_create failed: " << ::strerror( errno )
+                << ". (errno: " << errno << ")" << std::endl;
+            return false;
+        }
+        char* base = nullptr;
+        if( ::ftruncate( fd, static_cast<off_t>( capacity ) ) == 0 )
+        {
+            // reserve both halves first so nothing else can land in the second one
+            void* res =
+                ::mmap( nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            if( res != MAP_FAILED )
+            {
+                base = static_cast<char*>( res );
+                if( !mapHalf( base, capacity, fd ) || !mapHalf( base + capacity, capacity, fd ) )
+                {
+                    ::munmap( base, capacity * 2 );
+                    base = nullptr;
+                }
+            }
+        }
+        if( base == nullptr )
+        {
+            out << "recv buffer mmap failed: " << ::strerror( errno ) << ". (errno: " << errno
+                << ")" << std::endl;
+            ::close( fd );
+            return false;
+        }
+        ::close( fd );
+
+        size_t size = readable();
+        if( m_base != nullptr )
+        {
+            ::memcpy( base, readHead(), size );
+            ::munmap( m_base, m_capacity * 2 );
+        }
+        m_base = base;
+        m_capacity = capacity;
+        m_head = 0;
+        m_tail = size;
+        return true;
+    }
+
+    static bool mapHalf( char* addr, size_t size, int fd )
+    {
+        return ::mmap( addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0 ) !=
+               MAP_FAILED;
+    }
+
+    char*    m_base;
+    size_t   m_capacity; // bytes in one half of the mapping
+    uint64_t m_head;     // read and write positions, masked into the ring on use
+    uint64_t m_tail;
+};
+
+} // namespace TinyFix
@@ -4,20 +4,609 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <new>
 #include <atomic>
+#include <algorithm>
+#include <string_view>
+#include <stdint.h>
+
+#include <sys/uio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "message_journal.h"
+#include "tiny_fix_msg.h"
+#include "tiny_fix_utils.h"
 
 namespace TinyFix
 {
 
+class DefaultResendRequestProcessorComponents
+{
+public:
+    using Journal = MessageJournal<DefaultMessageJournalComponents>;
+    using MsgComponents = DefaultTinyFixMsgComponents;
+    // largest message that can be replayed, TinyFixMsgBase caps messages at 64KB
+    constexpr static size_t REWRITE_BUF_SIZE = 64 * 1024;
+    // rewritten headers, trailers and GapFills of one writev batch
+    constexpr static size_t BATCH_BUF_SIZE = 256 * 1024;
+    // iovecs per writev, well under IOV_MAX
+    constexpr static int MAX_IOV = 256;
+    // writev calls per operator() before handing the thread back to the Epoller
+    constexpr static int MAX_BATCHES_PER_CALL = 16;
+    // batch buffers taken in turn; with zero copy sends a buffer is only refilled once
+    // the kernel is done with it, one buffer then allows one batch in flight
+    constexpr static int BATCH_BUFS = 1;
+};
+
+// replays over SO_ZEROCOPY sockets: four batches can be in flight before the replay
+// waits for completions
+class ZeroCopyResendRequestProcessorComponents : public DefaultResendRequestProcessorComponents
+{
+public:
+    constexpr static int BATCH_BUFS = 4;
+};
+
+enum class ResendStatus : uint8_t
+{
+    Done = 0,
+    // socket full or batch budget spent, call again once the socket is writable
+    Pending,
+    // hard socket error, the replay is dropped
+    Failed,
+    // every batch buffer is pinned by a zero copy send, call again once completions
+    // have been read, the socket reports them as EPOLLERR
+    Waiting,
+};
+
+// Serves a ResendRequest out of the MessageJournal.
+// Application messages are replayed as PossDups without copying their bodies: the
+// header up to SendingTime is rewritten into a batch buffer with PossDupFlag(43)=Y,
+// OrigSendingTime(122) and a fresh SendingTime(52), the rest is sent straight from
+// the journal mapping, and CheckSum is recomputed over both. Runs of admin messages
+// and seq nums missing from the journal collapse into one SequenceReset-GapFill.
+// Messages go out in writev batches; a replay that fills the socket is resumed by
+// the next call, a message torn by a short write is finished first.
+// Messages sent on the session while a replay is pending are left in the journal
+// and go out unchanged behind it, so the counterparty still sees seq num order.
+// Given a zero copy sender, batches go out with MSG_ZEROCOPY: the stored bodies
+// straight from the journal's pages, and a batch buffer is refilled only once its
+// send has completed. The journal must not be reset() while such sends are in flight,
+// which only a new connection does.
+// The batch buffers and the carry are allocated by the first replay, a session that
+// is never asked to resend doesn't carry them. They are kept from then on: zero copy
+// sends may still read a buffer after the replay that filled it is done.
+template<typename ResendRequestProcessorComponentsT = DefaultResendRequestProcessorComponents>
 class ResendRequestProcessor
 {
 public:
-    ResendRequestProcessor();
+    using Journal = typename ResendRequestProcessorComponentsT::Journal;
+    using MsgType = TinyFixMsgBase<typename ResendRequestProcessorComponentsT::MsgComponents>;
+    constexpr static size_t REWRITE_BUF_SIZE = ResendRequestProcessorComponentsT::REWRITE_BUF_SIZE;
+    constexpr static size_t BATCH_BUF_SIZE = ResendRequestProcessorComponentsT::BATCH_BUF_SIZE;
+    constexpr static int    MAX_IOV = ResendRequestProcessorComponentsT::MAX_IOV;
+    constexpr static int    MAX_BATCHES_PER_CALL =
+        ResendRequestProcessorComponentsT::MAX_BATCHES_PER_CALL;
+    constexpr static int    BATCH_BUFS = ResendRequestProcessorComponentsT::BATCH_BUFS;
+    // room kept for one encoded GapFill
+    constexpr static size_t GAP_FILL_ROOM = 512;
+    // bytes a rewritten header can grow by: 43=Y, 122=, 52= and a wider BodyLength
+    constexpr static size_t REWRITE_SLACK = 128;
 
-    void operator()(){}
+    static_assert( BATCH_BUF_SIZE >= REWRITE_BUF_SIZE + REWRITE_SLACK + GAP_FILL_ROOM,
+                   "batch buffer must hold the largest rewritten message" );
+    static_assert( BATCH_BUFS >= 1, "at least one batch buffer" );
 
+    ResendRequestProcessor( const ResendRequestProcessor& ) = delete;
+    ResendRequestProcessor& operator=( const ResendRequestProcessor& ) = delete;
 
-};
+    ResendRequestProcessor( Journal& journal )
+        : m_journal( journal )
+        , m_seq( 0 )
+        , m_end( 0 )
+        , m_sentSeq( 0 )
+        , m_active( false )
+        , m_batch( nullptr )
+        , m_batchBuf( 0 )
+        , m_batchPos( 0 )
+        , m_batchBytes( 0 )
+        , m_iovCount( 0 )
+        , m_msgCount( 0 )
+        , m_carryPos( 0 )
+    {
+        m_batchTickets.fill( 0 );
+    }
+
+    // Queues [begin, end] for replay, end being the last seq num sent when the
+    // request came in. A request during a replay rewinds to the lower begin; what
+    // is sent twice is dropped by the counterparty as a PossDup. Messages the replay
+    // hasn't sent yet can't be pulled into the PossDup range by end, admin ones
+    // would be gap filled away.
+    void start( uint64_t begin, uint64_t end )
+    {
+        if( !m_batchBufs )
+        {
+            // a failed allocation fails the replay, see operator()
+            m_batchBufs.reset( new( std::nothrow ) char[BATCH_BUFS * BATCH_BUF_SIZE] );
+            m_carry.reserve( REWRITE_BUF_SIZE + REWRITE_SLACK );
+        }
+        if( m_active )
+        {
+            m_end = std::max( m_end, std::min( end, m_sentSeq ) );
+            m_seq = std::min( m_seq, begin );
+            return;
+        }
+        m_seq = begin;
+        m_end = end;
+        m_sentSeq = end;
+        m_active = true;
+    }
+
+    // drops the replay, e.g. on disconnect
+    void cancel()
+    {
+        m_active = false;
+        m_carry.clear();
+        m_carryPos = 0;
+        // tickets belong to the socket's zero copy numbering, a new one starts over
+        m_batchTickets.fill( 0 );
+    }
+
+    bool pending() const
+    {
+        return m_active;
+    }
+
+    // Sends what it can of the replay.
+    // writev( const struct iovec*, int ) returns the bytes sent or -1 with errno set,
+    // encodeGapFill( MsgType& msg, uint64_t seq, uint64_t newSeq ) encodes a
+    // SequenceReset-GapFill under seq into msg and calls gen_tail().
+    template<typename WritevFn, typename GapFillFn>
+    ResendStatus operator()( WritevFn&& writev, GapFillFn&& encodeGapFill )
+    {
+        CopyingSender<WritevFn> sender{ writev };
+        return ( *this )( writev, encodeGapFill, sender );
+    }
+
+    // As above with batches sent through zeroCopy, e.g. the session's TCPSocket:
+    //   ssize_t  sendvZeroCopy( const struct iovec*, int )  writev() without the copy
+    //   uint32_t zeroCopyTicket()                           taken after each batch
+    //   bool     zeroCopyReleased( uint32_t ticket )        that batch's pages are free
+    // A torn message is finished with a plain writev(), it goes out of m_carry.
+    template<typename WritevFn, typename GapFillFn, typename ZeroCopyT>
+    ResendStatus operator()( WritevFn&& writev, GapFillFn&& encodeGapFill, ZeroCopyT& zeroCopy )
+    {
+        if( !m_active )
+        {
+            return ResendStatus::Done;
+        }
+        if( !m_batchBufs )
+        {
+            cancel();
+            return ResendStatus::Failed;
+        }
+        for( int batch = 0; batch < MAX_BATCHES_PER_CALL; batch++ )
+        {
+            if( m_carryPos < m_carry.size() )
+            {
+                struct iovec iov;
+                iov.iov_base = m_carry.data() + m_carryPos;
+                iov.iov_len = m_carry.size() - m_carryPos;
+                ssize_t res = writev( &iov, 1 );
+                if( res < 0 )
+                {
+                    return onWriteError();
+                }
+                m_carryPos += static_cast<size_t>( res );
+                if( m_carryPos < m_carry.size() )
+                {
+                    return ResendStatus::Pending;
+                }
+                m_carry.clear();
+                m_carryPos = 0;
+                continue;
+            }
+            if( m_seq > std::max( m_end, m_journal.getLastSeq() ) )
+            {
+                m_active = false;
+                return ResendStatus::Done;
+            }
+            if( !zeroCopy.zeroCopyReleased( m_batchTickets[m_batchBuf] ) )
+            {
+                return ResendStatus::Waiting;
+            }
+            m_batch = m_batchBufs.get() + m_batchBuf * BATCH_BUF_SIZE;
+            if( !fillBatch( encodeGapFill ) )
+            {
+                cancel();
+                return ResendStatus::Failed;
+            }
+            ssize_t res = zeroCopy.sendvZeroCopy( m_iov.data(), m_iovCount );
+            if( res < 0 )
+            {
+                return onWriteError();
+            }
+            m_batchTickets[m_batchBuf] = zeroCopy.zeroCopyTicket();
+            m_batchBuf = ( m_batchBuf + 1 ) % BATCH_BUFS;
+            if( !commit( static_cast<size_t>( res ) ) )
+            {
+                return ResendStatus::Pending;
+            }
+        }
+        return ResendStatus::Pending;
+    }
+
+private:
+    // no zero copy: batches are written with the caller's writev and never pinned
+    template<typename WritevFn>
+    struct CopyingSender
+    {
+        WritevFn& writev;
+
+        ssize_t sendvZeroCopy( const struct iovec* iov, int count )
+        {
+            return writev( iov, count );
+        }
 
-}
+        uint32_t zeroCopyTicket() const
+        {
+            return 0;
+        }
+
+        bool zeroCopyReleased( uint32_t ) const
+        {
+            return true;
+        }
+    };
+
+    ResendStatus onWriteError()
+    {
+        if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+        {
+            return ResendStatus::Pending;
+        }
+        cancel();
+        return ResendStatus::Failed;
+    }
+
+    // builds the iovecs for as many messages from m_seq on as fit in one writev
+    template<typename GapFillFn>
+    bool fillBatch( GapFillFn& encodeGapFill )
+    {
+        m_batchPos = 0;
+        m_batchBytes = 0;
+        m_iovCount = 0;
+        m_msgCount = 0;
+        uint64_t last = std::max( m_end, m_journal.getLastSeq() );
+        uint64_t seq = m_seq;
+        while( seq <= last && m_msgCount < MAX_IOV && m_iovCount + 3 <= MAX_IOV )
+        {
+            JournalRecord record = m_journal.get( seq );
+            if( gapFilled( seq, record ) )
+            {
+                if( BATCH_BUF_SIZE - m_batchPos < GAP_FILL_ROOM )
+                {
+                    break;
+                }
+                uint64_t newSeq = seq + 1;
+                while( newSeq <= last && gapFilled( newSeq, m_journal.get( newSeq ) ) )
+                {
+                    newSeq++;
+                }
+                if( !addGapFill( encodeGapFill, seq, newSeq ) )
+                {
+                    return false;
+                }
+                endMessage( newSeq - 1 );
+                seq = newSeq;
+                continue;
+            }
+            if( seq > m_end )
+            {
+                // sent on the session during the replay, goes out as stored
+                push( record.data, record.size );
+                endMessage( seq );
+                seq++;
+                continue;
+            }
+            if( BATCH_BUF_SIZE - m_batchPos < record.size + REWRITE_SLACK )
+            {
+                if( m_msgCount > 0 )
+                {
+                    break;
+                }
+            }
+            else if( addPossDup( record ) )
+            {
+                endMessage( seq );
+                seq++;
+                continue;
+            }
+            // too big or not parseable, the counterparty gets a GapFill instead
+            if( BATCH_BUF_SIZE - m_batchPos < GAP_FILL_ROOM )
+            {
+                break;
+            }
+            if( !addGapFill( encodeGapFill, seq, seq + 1 ) )
+            {
+                return false;
+            }
+            endMessage( seq );
+            seq++;
+        }
+        return true;
+    }
+
+    bool gapFilled( uint64_t seq, const JournalRecord& record ) const
+    {
+        return !record.valid() || ( seq <= m_end && ( record.flags & JOURNAL_ADMIN ) );
+    }
+
+    template<typename GapFillFn>
+    bool addGapFill( GapFillFn& encodeGapFill, uint64_t seq, uint64_t newSeq )
+    {
+        MsgType msg( m_batch + m_batchPos, BATCH_BUF_SIZE - m_batchPos );
+        if( !encodeGapFill( msg, seq, newSeq ) )
+        {
+            return false;
+        }
+        const char* data = msg.get_msg_data();
+        push( data, msg.get_msg_size() );
+        m_batchPos = static_cast<size_t>( data + msg.get_msg_size() - m_batch );
+        return true;
+    }
+
+    // Rewrites the header in front of SendingTime into the batch buffer and points
+    // the next iovec at the rest of the stored message.
+    bool addPossDup( const JournalRecord& record )
+    {
+        const char* data = record.data;
+        const char* end = data + record.size;
+        // stored messages end in "10=NNN<SOH>"
+        if( record.size < 16 || ::memcmp( end - 7, "10=", 3 ) != 0 )
+        {
+            return false;
+        }
+        const char* bodyEnd = end - 7;
+        const char* beginStringEnd = findByte( data, bodyEnd, SOH ) + 1;
+        if( beginStringEnd >= bodyEnd )
+        {
+            return false;
+        }
+        const char* p = findByte( beginStringEnd, bodyEnd, SOH ) + 1;
+
+        // the body prefix goes after room for "8=...<SOH>9=NNNNNN<SOH>" and is
+        // moved down once BodyLength is known
+        size_t headerRoom = static_cast<size_t>( beginStringEnd - data ) + 10;
+        char*  prefixBegin = m_batch + m_batchPos + headerRoom;
+        char*  w = prefixBegin;
+        bool   sendingTime = false;
+        while( p < bodyEnd && !sendingTime )
+        {
+            const char* fieldEnd = findByte( p, bodyEnd, SOH );
+            uint32_t    tag;
+            const char* value;
+            if( fieldEnd == bodyEnd || !parseTag( p, fieldEnd, tag, value ) )
+            {
+                return false;
+            }
+            if( tag == 52 )
+            {
+                w = put( w, "43=Y\x01" "122=" );
+                w = put( w, std::string_view( value, fieldEnd + 1 - value ) );
+                w = put( w, "52=" );
+                m_timestamp.format( w );
+                w += UtcTimestampFormatter::SIZE;
+                *w++ = SOH;
+                sendingTime = true;
+            }
+            else if( tag != 43 && tag != 122 )
+            {
+                w = put( w, std::string_view( p, static_cast<size_t>( fieldEnd - p ) + 1 ) );
+            }
+            p = fieldEnd + 1;
+        }
+        std::string_view rest( p, static_cast<size_t>( bodyEnd - p ) );
+        // no SendingTime in the header, or PossDup fields further down: copy it all
+        if( !sendingTime || rest.find( "\x01" "43=" ) != std::string_view::npos ||
+            rest.find( "\x01" "122=" ) != std::string_view::npos )
+        {
+            return addRewritten( record );
+        }
+
+        size_t prefixLen = static_cast<size_t>( w - prefixBegin );
+        char*  header = m_batch + m_batchPos;
+        char*  h = put( header, std::string_view( data, beginStringEnd - data ) );
+        h = put( h, "9=" );
+        h += formatUInt( h, prefixLen + rest.size() );
+        *h++ = SOH;
+        ::memmove( h, prefixBegin, prefixLen );
+        h += prefixLen;
+        uint32_t sum = byteSum( header, static_cast<size_t>( h - header ) ) +
+                       byteSum( rest.data(), rest.size() );
+
+        push( header, static_cast<size_t>( h - header ) );
+        push( rest.data(), rest.size() );
+        char* tail = h;
+        h = put( h, "10=" );
+        formatUIntFixed( h, sum & 0xFF, 3 );
+        h += 3;
+        *h++ = SOH;
+        push( tail, static_cast<size_t>( h - tail ) );
+        m_batchPos = static_cast<size_t>( h - m_batch );
+        return true;
+    }
+
+    // copying fallback: every field is rewritten into the batch buffer
+    bool addRewritten( const JournalRecord& record )
+    {
+        MsgType     msg( m_batch + m_batchPos, BATCH_BUF_SIZE - m_batchPos );
+        const char* end = record.data + record.size;
+        // skip BeginString and BodyLength, gen_tail() writes both
+        const char* p = findByte( record.data, end, SOH ) + 1;
+        p = p < end ? findByte( p, end, SOH ) + 1 : end;
+        while( p < end )
+        {
+            const char* fieldEnd = findByte( p, end, SOH );
+            uint32_t    tag;
+            const char* value;
+            if( fieldEnd == end || !parseTag( p, fieldEnd, tag, value ) )
+            {
+                return false;
+            }
+            std::string_view field( value, static_cast<size_t>( fieldEnd - value ) );
+            bool             ok = true;
+            if( tag == 10 )
+            {
+                break;
+            }
+            else if( tag == 52 )
+            {
+                char sendingTime[UtcTimestampFormatter::SIZE];
+                m_timestamp.format( sendingTime );
+                ok = msg.add_char( 43, 'Y' ) && msg.add_field( 122, field ) &&
+                     msg.add_field( 52, std::string_view( sendingTime, sizeof( sendingTime ) ) );
+            }
+            else if( tag != 43 && tag != 122 )
+            {
+                size_t len = static_cast<size_t>( fieldEnd - p ) + 1;
+                char*  dst = msg.reserve_block( len );
+                ok = dst != nullptr;
+                if( ok )
+                {
+                    ::memcpy( dst, p, len );
+                    msg.advance( len );
+                }
+            }
+            if( !ok )
+            {
+                return false;
+            }
+            p = fieldEnd + 1;
+        }
+        msg.gen_tail();
+        const char* data = msg.get_msg_data();
+        push( data, msg.get_msg_size() );
+        m_batchPos = static_cast<size_t>( data + msg.get_msg_size() - m_batch );
+        return true;
+    }
+
+    static bool parseTag( const char* p, const char* fieldEnd, uint32_t& tag, const char*& value )
+    {
+        tag = 0;
+        for( ; p < fieldEnd && *p >= '0' && *p <= '9'; p++ )
+        {
+            tag = tag * 10 + static_cast<uint32_t>( *p - '0' );
+        }
+        if( p == fieldEnd || *p != '=' )
+        {
+            return false;
+        }
+        value = p + 1;
+        return true;
+    }
+
+    static char* put( char* dst, std::string_view s )
+    {
+        ::memcpy( dst, s.data(), s.size() );
+        return dst + s.size();
+    }
+
+    // adjacent buffers share an iovec, a trailer and the next header usually are
+    void push( const char* data, size_t size )
+    {
+        struct iovec& prev = m_iov[m_iovCount > 0 ? m_iovCount - 1 : 0];
+        if( m_iovCount > 0 && static_cast<const char*>( prev.iov_base ) + prev.iov_len == data )
+        {
+            prev.iov_len += size;
+        }
+        else
+        {
+            m_iov[m_iovCount].iov_base = const_cast<char*>( data );
+            m_iov[m_iovCount].iov_len = size;
+            m_iovCount++;
+        }
+        m_batchBytes += size;
+    }
+
+    // lastSeq is the last seq num the message covers, GapFills cover several
+    void endMessage( uint64_t lastSeq )
+    {
+        m_msgEnd[m_msgCount] = m_batchBytes;
+        m_msgLastSeq[m_msgCount] = lastSeq;
+        m_msgCount++;
+    }
+
+    // Moves m_seq past what a writev of sent bytes put on the wire, false if it
+    // fell short. The unsent part of a torn message is copied aside; the messages
+    // behind it are rebuilt by the next batch.
+    bool commit( size_t sent )
+    {
+        int msg = 0;
+        while( msg < m_msgCount && m_msgEnd[msg] <= sent )
+        {
+            msg++;
+        }
+        if( msg > 0 )
+        {
+            m_seq = m_msgLastSeq[msg - 1] + 1;
+        }
+        bool   done = msg == m_msgCount;
+        size_t msgBegin = msg > 0 ? m_msgEnd[msg - 1] : 0;
+        if( !done && sent > msgBegin )
+        {
+            carry( sent, m_msgEnd[msg] );
+            m_seq = m_msgLastSeq[msg] + 1;
+        }
+        m_sentSeq = std::max( m_sentSeq, m_seq - 1 );
+        return done;
+    }
+
+    // copies batch bytes [from, to) out of the iovecs, they may point into the
+    // journal mapping which moves when it grows
+    void carry( size_t from, size_t to )
+    {
+        m_carry.clear();
+        m_carryPos = 0;
+        size_t pos = 0;
+        for( int i = 0; i < m_iovCount && pos < to; i++ )
+        {
+            const char* base = static_cast<const char*>( m_iov[i].iov_base );
+            size_t      len = m_iov[i].iov_len;
+            size_t      begin = std::max( from, pos );
+            size_t      end = std::min( to, pos + len );
+            if( begin < end )
+            {
+                m_carry.insert( m_carry.end(), base + ( begin - pos ), base + ( end - pos ) );
+            }
+            pos += len;
+        }
+    }
+
+    Journal&              m_journal;
+    uint64_t              m_seq; // next seq num to put in a batch
+    uint64_t              m_end; // last seq num replayed as a PossDup
+    uint64_t              m_sentSeq; // highest seq num on the wire, rewinds included
+    bool                  m_active;
+    UtcTimestampFormatter m_timestamp;
+
+    // BATCH_BUFS buffers of BATCH_BUF_SIZE, allocated by the first start()
+    std::unique_ptr<char[]>           m_batchBufs;
+    // zeroCopyTicket() after each buffer's last send
+    std::array<uint32_t, BATCH_BUFS>  m_batchTickets;
+    char*                             m_batch; // the buffer fillBatch() writes
+    int                               m_batchBuf;
+    size_t                            m_batchPos;
+    size_t                            m_batchBytes;
+    std::array<struct iovec, MAX_IOV> m_iov;
+    int                               m_iovCount;
+    // per message in the batch: batch bytes up to its end, last seq num it covers
+    std::array<size_t, MAX_IOV>   m_msgEnd;
+    std::array<uint64_t, MAX_IOV> m_msgLastSeq;
+    int                           m_msgCount;
+
+    std::vector<char> m_carry;
+    size_t            m_carryPos;
+};
 
+} // namespace TinyFix
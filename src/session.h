@@ -0,0 +1,1065 @@
+#pragma once
+
+#include <string_view>
+#include <utility>
+#include <stdint.h>
+
+#include "poller.h"
+#include "socket.h"
+#include "timer_wheel.h"
+#include "tiny_fix_msg.h"
+#include "tiny_fix_msg_template.h"
+#include "tiny_fix_framer.h"
+#include "session_misc.h"
+
+namespace TinyFix {
+
+// FIX 4.2/4.4 session layer over one TCPSocket.
+// Inbound bytes are framed and parsed in place in the socket's buffer, admin
+// messages (Logon, Heartbeat, TestRequest, ResendRequest, SequenceReset, Logout,
+// Reject) are handled here and application messages are handed to the Application.
+// Outbound messages are encoded into one session owned block, heartbeats and
+// TestRequests run off the shared TimerWheel. Nothing on the steady state path
+// allocates. The socket config must be non blocking, reads and resends rely on EAGAIN.
+// Sends are corked: messages are queued on the socket and every message of a loop
+// iteration goes out with one write once the Epoller has dispatched its ready set. A
+// backlog the socket doesn't take stays queued and drains on EPOLLOUT.
+// With getZeroCopy() in the socket config replays are sent with MSG_ZEROCOPY out of
+// the journal, completions are read off the socket's error queue on EPOLLERR.
+// With a journal path configured every sent message is stored in a MessageJournal
+// and ResendRequests are replayed from it in writev batches, resumed on EPOLLOUT when
+// the socket fills up; without one they are answered with a SequenceReset-GapFill
+// over the whole range.
+// With Components::Probes set to LatencyProbes every stage from recv() to the socket
+// write is timed with the TSC, see latency_probe.h; the default compiles them out.
+template<typename SessionComponentsT = DefaultSessionComponents>
+class Session
+{
+public:
+    using SocketType = TCPSocket<typename SessionComponentsT::SocketComponents>;
+    using EpollerType = Poller<typename SessionComponentsT::EpollerComponents>;
+    using TimerWheelType = TimerWheel<typename SessionComponentsT::TimerWheelComponents>;
+    using TimerNodeType = typename TimerWheelType::Node;
+    using MsgType = TinyFixMsgBase<typename SessionComponentsT::MsgComponents>;
+    using MsgViewType = TinyFixMsgView<typename SessionComponentsT::MsgViewComponents>;
+    using FramerType = TinyFixFramer<typename SessionComponentsT::FramerComponents>;
+    using ResendRequestProcessorType =
+        ResendRequestProcessor<typename SessionComponentsT::ResendRequestProcessorComponents>;
+    using JournalType = typename ResendRequestProcessorType::Journal;
+    using Application = typename SessionComponentsT::Application;
+    using Probes = typename SessionComponentsT::Probes;
+    using OutType = typename SessionComponentsT::OutStreamType;
+    constexpr static auto&  out = SessionComponentsT::outStream;
+    constexpr static size_t SEND_BUF_SIZE = SessionComponentsT::SEND_BUF_SIZE;
+
+    Session( Session& ) = delete;
+    Session& operator=( Session& ) = delete;
+
+    Session( SessionConfigBase& config,
+             SocketConfigBase&  socketConfig,
+             EpollerType&       epoller,
+             TimerWheelType&    timerWheel,
+             Application&       app )
+        : m_config( config )
+        , m_socket( socketConfig )
+        , m_epoller( epoller )
+        , m_timerWheel( timerWheel )
+        , m_app( app )
+        , m_txMsg( m_txBuf, SEND_BUF_SIZE )
+        , m_resendProcessor( m_journal )
+        , m_state( SessionState::Disconnected )
+        , m_heartBtInt( config.getHeartBtInt() )
+        , m_nextOutSeq( 1 )
+        , m_nextInSeq( 1 )
+        , m_resendEnd( 0 )
+        , m_testRequestId( 0 )
+        , m_testRequestPending( false )
+        , m_resendWaiting( false )
+        , m_watchedEvents( 0 )
+    {
+        m_heartbeatTimer.callback = [this]() { onHeartbeatTimer(); };
+        m_inboundTimer.callback = [this]() { onInboundTimer(); };
+        m_logonTimer.callback = [this]() { onLogonTimer(); };
+        m_flushTask.callback = [this]() { flushSendQueue(); };
+    }
+
+    virtual ~Session()
+    {
+        disconnect();
+    }
+
+    // initiator: connects, sends Logon and waits for the reply
+    bool connect()
+    {
+        if( m_state != SessionState::Disconnected )
+        {
+            return false;
+        }
+        if( !openJournal() )
+        {
+            return false;
+        }
+        if( !m_socket.create() || !m_socket.setSockaddrIn() || !m_socket.connect() ||
+            !m_socket.setNonBlock() )
+        {
+            m_socket.release();
+            return false;
+        }
+        if( !start() )
+        {
+            return false;
+        }
+        m_state = SessionState::LogonSent;
+        bool reset = m_config.getResetSeqNumOnLogon();
+        if( reset )
+        {
+            m_nextOutSeq = 1;
+            m_nextInSeq = 1;
+            m_journal.reset();
+        }
+        return sendLogon( reset );
+    }
+
+    // acceptor: takes over a connected fd, e.g. from TCPSocket::accept(), applies the
+    // socket config to it and waits for the counterparty's Logon. nonBlocking says
+    // the fd is O_NONBLOCK already, as accept4() fds are.
+    bool accept( int fd, bool nonBlocking = false )
+    {
+        if( m_state != SessionState::Disconnected )
+        {
+            return false;
+        }
+        m_socket.setFd( fd );
+        if( ( !nonBlocking && !m_socket.setNonBlock() ) || !m_socket.tune() )
+        {
+            m_socket.release();
+            return false;
+        }
+        return awaitLogon();
+    }
+
+    // an fd from Acceptor, non blocking and tuned with the same socket config already
+    bool accept( int fd, const SocketTuningReport& tuning )
+    {
+        if( m_state != SessionState::Disconnected )
+        {
+            return false;
+        }
+        m_socket.adopt( fd, tuning );
+        return awaitLogon();
+    }
+
+    // sends Logout and waits for the counterparty's Logout before disconnecting
+    void logout( std::string_view text = std::string_view() )
+    {
+        if( m_state != SessionState::Active )
+        {
+            disconnect();
+            return;
+        }
+        sendLogout( text );
+        m_state = SessionState::LogoutSent;
+        m_timerWheel.schedule( m_logonTimer, m_config.getLogonTimeout() * 1000 );
+    }
+
+    void disconnect()
+    {
+        if( m_state == SessionState::Disconnected )
+        {
+            return;
+        }
+        bool wasActive = m_state == SessionState::Active || m_state == SessionState::LogoutSent;
+        // last chance for what is still corked, e.g. the Logout terminate() just sent
+        if( !loopSendsPending() )
+        {
+            m_socket.flushQueue();
+        }
+        m_epoller.cancel( m_flushTask );
+        m_epoller.removeEvent( m_socket.getFd() );
+        m_socket.release();
+        m_timerWheel.cancel( m_heartbeatTimer );
+        m_timerWheel.cancel( m_inboundTimer );
+        m_timerWheel.cancel( m_logonTimer );
+        m_state = SessionState::Disconnected;
+        m_resendProcessor.cancel();
+        m_resendWaiting = false;
+        m_watchedEvents = 0;
+        if( wasActive )
+        {
+            m_app.onLogout( *this );
+        }
+    }
+
+    // Encodes and sends one message: the standard header is written here, then
+    // writeBody( MsgType& ) appends the body fields. Application messages wait for
+    // the Logon exchange, session level ones go out in any connected state.
+    template<typename BodyWriter>
+    bool send( std::string_view msgType, BodyWriter&& writeBody )
+    {
+        if( m_state == SessionState::Disconnected ||
+            ( m_state != SessionState::Active && !isAdmin( msgType ) ) )
+        {
+            return false;
+        }
+        m_probes.start( PROBE_ENCODE );
+        if( !encode( msgType, m_nextOutSeq, writeBody ) )
+        {
+            return false;
+        }
+        m_probes.mark( PROBE_ENCODE );
+        if( !journal( msgType, m_txMsg.get_msg_data(), m_txMsg.get_msg_size() ) )
+        {
+            return false;
+        }
+        m_nextOutSeq++;
+        if( m_resendProcessor.pending() )
+        {
+            // queued in the journal, the replay sends it once it gets there
+            return true;
+        }
+        return sendBytes( m_txMsg.get_msg_data(), m_txMsg.get_msg_size() );
+    }
+
+    // Sends a pre-rendered message: MsgSeqNum and, when it is the second slot,
+    // SendingTime are filled in here, writeSlots( Writer& ) sets the rest.
+    template<typename SchemaT, typename SlotWriter>
+    bool send( const TinyFixMsgTemplate<SchemaT>& tmpl, SlotWriter&& writeSlots )
+    {
+        static_assert( TinyFixMsgTemplate<SchemaT>::SIZE <= SEND_BUF_SIZE,
+                       "template does not fit in the send buffer" );
+        if( m_state != SessionState::Active )
+        {
+            return false;
+        }
+        m_probes.start( PROBE_ENCODE );
+        auto writer = tmpl.render( m_txBuf );
+        writer.set_uint( 0, m_nextOutSeq );
+        if( SchemaT::SLOTS.size() > 1 && SchemaT::SLOTS[1].tag == 52 )
+        {
+            char sendingTime[UtcTimestampFormatter::SIZE];
+            m_timestamp.format( sendingTime );
+            writer.set_string( 1, std::string_view( sendingTime, sizeof( sendingTime ) ) );
+        }
+        writeSlots( writer );
+        uint16_t size = writer.finish();
+        if( size == 0 )
+        {
+            out << "encode failed, MsgType: " << SchemaT::MSG_TYPE << std::endl;
+            return false;
+        }
+        m_probes.mark( PROBE_ENCODE );
+        if( !journal( SchemaT::MSG_TYPE, m_txBuf, size ) )
+        {
+            return false;
+        }
+        m_nextOutSeq++;
+        if( m_resendProcessor.pending() )
+        {
+            return true;
+        }
+        return sendBytes( m_txBuf, size );
+    }
+
+    SessionState getState() const
+    {
+        return m_state;
+    }
+
+    uint64_t getNextSenderMsgSeqNum() const
+    {
+        return m_nextOutSeq;
+    }
+
+    uint64_t getNextTargetMsgSeqNum() const
+    {
+        return m_nextInSeq;
+    }
+
+    void setNextSenderMsgSeqNum( uint64_t seq )
+    {
+        m_nextOutSeq = seq;
+    }
+
+    void setNextTargetMsgSeqNum( uint64_t seq )
+    {
+        m_nextInSeq = seq;
+    }
+
+    const SessionConfigBase& getConfig() const
+    {
+        return m_config;
+    }
+
+    SocketType& getSocket()
+    {
+        return m_socket;
+    }
+
+    JournalType& getJournal()
+    {
+        return m_journal;
+    }
+
+    // latency histograms per probe point, snapshot()s are safe from any thread
+    const Probes& getProbes() const
+    {
+        return m_probes;
+    }
+
+private:
+    // opens the configured journal once and carries on from its last seq num
+    bool openJournal()
+    {
+        const std::string& path = m_config.getJournalPath();
+        if( path.empty() || m_journal.isOpen() )
+        {
+            return true;
+        }
+        if( !m_journal.open( path ) )
+        {
+            return false;
+        }
+        if( m_journal.getLastSeq() != 0 )
+        {
+            m_nextOutSeq = m_journal.getLastSeq() + 1;
+        }
+        return true;
+    }
+
+    // Heartbeat, TestRequest, ResendRequest, Reject, SequenceReset, Logout and Logon
+    static bool isAdmin( std::string_view msgType )
+    {
+        return msgType.size() == 1 &&
+               ( msgType[0] == 'A' || ( msgType[0] >= '0' && msgType[0] <= '5' ) );
+    }
+
+    // False if a message that would be resent couldn't be stored. It must not go out
+    // then: a replay would gap fill it. Session level messages are gap filled anyway,
+    // they still go, so heartbeats and Logout keep working.
+    bool journal( std::string_view msgType, const char* data, size_t size )
+    {
+        if( !m_journal.isOpen() )
+        {
+            return true;
+        }
+        // everything session level but Reject is gap filled on a resend
+        bool admin = isAdmin( msgType ) && msgType[0] != '3';
+        uint32_t flags = admin ? static_cast<uint32_t>( JOURNAL_ADMIN ) : 0u;
+        if( !m_journal.append( m_nextOutSeq, data, size, flags ) )
+        {
+            out << "session " << m_config.getTargetCompID() << " journal append failed, seq: "
+                << m_nextOutSeq << ( admin ? "" : ", not sent" ) << std::endl;
+            return admin;
+        }
+        return true;
+    }
+
+    template<typename BodyWriter>
+    bool encode( std::string_view msgType, uint64_t seq, BodyWriter& writeBody )
+    {
+        m_txMsg.reset();
+        if( !writeHeader( m_txMsg, msgType, seq ) || !writeBody( m_txMsg ) )
+        {
+            out << "encode failed, MsgType: " << msgType << std::endl;
+            return false;
+        }
+        m_txMsg.gen_tail();
+        return true;
+    }
+
+    bool awaitLogon()
+    {
+        if( !openJournal() || !start() )
+        {
+            m_socket.release();
+            return false;
+        }
+        m_state = SessionState::AwaitingLogon;
+        return true;
+    }
+
+    bool start()
+    {
+        bool added;
+        if constexpr( EpollerType::NATIVE_IO )
+        {
+            // the loop reads for us, the fd callback only sees EPOLLOUT and EPOLLERR
+            // for direct writes and the loop's sends going out, see loopSendsPending()
+            added = m_epoller.addRecv(
+                m_socket.getFd(),
+                [this]( const char* data, int res ) { onRecv( data, res ); },
+                [this]() { onSocketEvent(); } );
+        }
+        else
+        {
+            added = m_epoller.addEvent( m_socket.getFd(), [this]() { onSocketEvent(); } );
+        }
+        if( !added )
+        {
+            m_socket.release();
+            return false;
+        }
+        m_resendEnd = 0;
+        m_testRequestPending = false;
+        m_timerWheel.schedule( m_logonTimer, m_config.getLogonTimeout() * 1000 );
+        return true;
+    }
+
+    void onSocketEvent()
+    {
+        if( m_socket.zeroCopyPending() && !m_resendProcessor.pending() )
+        {
+            // EPOLLERR, the kernel is done with the pages of earlier zero copy sends
+            reapZeroCopy();
+            if( m_state == SessionState::Disconnected )
+            {
+                return;
+            }
+        }
+        if( m_resendProcessor.pending() || m_socket.queued() != 0 )
+        {
+            if( m_resendProcessor.pending() )
+            {
+                pumpResend();
+            }
+            else
+            {
+                flushSendQueue();
+            }
+            if( m_state == SessionState::Disconnected )
+            {
+                return;
+            }
+        }
+        if constexpr( !EpollerType::NATIVE_IO )
+        {
+            onReadable();
+            m_probes.end();
+        }
+    }
+
+    void onReadable()
+    {
+        m_probes.start( PROBE_RECV );
+        ssize_t res = m_socket.recv();
+        if( res <= 0 )
+        {
+            if( res == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+            {
+                out << "session " << m_config.getTargetCompID() << " connection closed"
+                    << std::endl;
+                disconnect();
+            }
+            return;
+        }
+        m_probes.mark( PROBE_RECV );
+        onData();
+    }
+
+    // io_uring: bytes the loop has read already, appended to the ring like a recv()
+    void onRecv( const char* data, int res )
+    {
+        m_probes.start( PROBE_RECV );
+        if( res <= 0 )
+        {
+            out << "session " << m_config.getTargetCompID() << " connection closed";
+            if( res < 0 )
+            {
+                out << ": " << ::strerror( -res ) << ". (errno: " << -res << ")";
+            }
+            out << std::endl;
+            disconnect();
+            return;
+        }
+        auto& rx = m_socket.buf();
+        if( !rx.reserve( static_cast<size_t>( res ) ) )
+        {
+            out << "session " << m_config.getTargetCompID() << " receive buffer full" << std::endl;
+            disconnect();
+            return;
+        }
+        ::memcpy( rx.writeHead(), data, static_cast<size_t>( res ) );
+        rx.commit( static_cast<size_t>( res ) );
+        m_probes.mark( PROBE_RECV );
+        onData();
+        m_probes.end();
+    }
+
+    // frames and handles everything complete in the receive ring
+    void onData()
+    {
+        // the ring keeps a partial message at the end for the next read
+        auto& rx = m_socket.buf();
+        for( ;; )
+        {
+            size_t consumed = m_framer.frame( rx.readHead(), rx.readable() );
+            m_probes.mark( PROBE_FRAME );
+            for( const TinyFixFrame& frame : m_framer )
+            {
+                onMessage( frame.data, frame.size );
+                m_probes.mark( PROBE_DISPATCH );
+                if( m_state == SessionState::Disconnected )
+                {
+                    return;
+                }
+            }
+            rx.consume( consumed );
+            if( m_framer.frame_count() < FramerType::MAX_BATCH )
+            {
+                break;
+            }
+        }
+    }
+
+    void onMessage( const char* data, size_t size )
+    {
+        if( !m_view.parse( data, size ) )
+        {
+            out << "session " << m_config.getTargetCompID() << " dropped garbled message"
+                << std::endl;
+            return;
+        }
+        m_probes.mark( PROBE_PARSE );
+        resetInboundTimer();
+
+        std::string_view msgType = m_view.get_msg_type();
+        char             type = msgType.size() == 1 ? msgType[0] : '\0';
+        int64_t          seq;
+        if( m_view.get_string( 49 ) != m_config.getTargetCompID() ||
+            m_view.get_string( 56 ) != m_config.getSenderCompID() )
+        {
+            out << "session " << m_config.getTargetCompID() << " CompID mismatch" << std::endl;
+            terminate( "CompID problem" );
+            return;
+        }
+        if( !m_view.get_int( 34, seq ) || seq <= 0 )
+        {
+            terminate( "MsgSeqNum missing" );
+            return;
+        }
+        if( type != 'A' &&
+            ( m_state == SessionState::AwaitingLogon || m_state == SessionState::LogonSent ) )
+        {
+            terminate( "first message is not a Logon" );
+            return;
+        }
+
+        char flag;
+        bool reset = type == 'A' && m_view.get_char( 141, flag ) && flag == 'Y';
+        if( reset )
+        {
+            m_nextInSeq = 1;
+            m_resendEnd = 0;
+            if( m_state == SessionState::AwaitingLogon )
+            {
+                m_nextOutSeq = 1;
+                m_journal.reset();
+            }
+        }
+        // SequenceReset-Reset ignores MsgSeqNum, and makes any gap we asked for moot
+        if( type == '4' && !( m_view.get_char( 123, flag ) && flag == 'Y' ) )
+        {
+            onSequenceReset();
+            m_resendEnd = 0;
+            return;
+        }
+
+        uint64_t msgSeq = static_cast<uint64_t>( seq );
+        if( msgSeq > m_nextInSeq )
+        {
+            if( type == 'A' )
+            {
+                onLogon( reset );
+            }
+            else if( type == '5' )
+            {
+                onLogout();
+                return;
+            }
+            else if( type == '2' )
+            {
+                // answered before asking for our own gap, or two sides that both
+                // see a gap would each drop the other's request
+                onResendRequest();
+            }
+            requestResend( msgSeq );
+            return;
+        }
+        if( msgSeq < m_nextInSeq )
+        {
+            if( m_view.get_char( 43, flag ) && flag == 'Y' )
+            {
+                // a replayed GapFill that starts below us can still reach past us,
+                // dropping it would leave the rest of its range missing for good
+                if( type == '4' )
+                {
+                    onSequenceReset();
+                }
+                return;
+            }
+            terminate( "MsgSeqNum too low" );
+            return;
+        }
+        m_nextInSeq++;
+        checkResendDone();
+
+        switch( type )
+        {
+            case 'A':
+                onLogon( reset );
+                break;
+            case '0':
+                onHeartbeat();
+                break;
+            case '1':
+                onTestRequest();
+                break;
+            case '2':
+                onResendRequest();
+                break;
+            case '4':
+                onSequenceReset();
+                break;
+            case '5':
+                onLogout();
+                break;
+            default:
+                if( m_state == SessionState::Active )
+                {
+                    m_app.onMessage( *this, m_view );
+                }
+                break;
+        }
+    }
+
+    void onLogon( bool reset )
+    {
+        if( m_state == SessionState::Active )
+        {
+            return;
+        }
+        int64_t heartBtInt;
+        if( m_view.get_int( 108, heartBtInt ) && heartBtInt > 0 &&
+            m_state == SessionState::AwaitingLogon )
+        {
+            // acceptors follow the initiator's interval
+            m_heartBtInt = static_cast<int>( heartBtInt );
+        }
+        if( m_state == SessionState::AwaitingLogon )
+        {
+            m_state = SessionState::Active;
+            // echo the counterparty's ResetSeqNumFlag
+            sendLogon( reset );
+        }
+        m_state = SessionState::Active;
+        m_timerWheel.cancel( m_logonTimer );
+        m_timerWheel.schedule( m_heartbeatTimer, m_heartBtInt * 1000 );
+        resetInboundTimer();
+        m_app.onLogon( *this );
+    }
+
+    void onHeartbeat()
+    {
+        int64_t testRequestId;
+        if( m_testRequestPending && m_view.get_int( 112, testRequestId ) &&
+            static_cast<uint64_t>( testRequestId ) == m_testRequestId )
+        {
+            m_testRequestPending = false;
+        }
+    }
+
+    void onTestRequest()
+    {
+        std::string_view testReqId = m_view.get_string( 112 );
+        send( "0", [testReqId]( MsgType& msg ) { return msg.add_field( 112, testReqId ); } );
+    }
+
+    void onResendRequest()
+    {
+        int64_t begin;
+        int64_t end;
+        if( !m_view.get_int( 7, begin ) || begin <= 0 ||
+            static_cast<uint64_t>( begin ) >= m_nextOutSeq )
+        {
+            return;
+        }
+        // EndSeqNo 0 means everything sent so far
+        uint64_t last = m_nextOutSeq - 1;
+        if( m_view.get_int( 16, end ) && end != 0 )
+        {
+            if( end < begin )
+            {
+                sendReject( "2", 16, 5, "EndSeqNo below BeginSeqNo" );
+                return;
+            }
+            if( static_cast<uint64_t>( end ) < last )
+            {
+                last = static_cast<uint64_t>( end );
+            }
+        }
+        if( !m_journal.isOpen() )
+        {
+            // no store: fill the whole range with one gap fill sent under BeginSeqNo
+            sendGapFill( static_cast<uint64_t>( begin ), last + 1 );
+            return;
+        }
+        m_resendProcessor.start( static_cast<uint64_t>( begin ), last );
+        pumpResend();
+    }
+
+    // Runs the replay until it is done or the socket is full
+    void pumpResend()
+    {
+        // the replay writes directly, whatever is still queued is older and goes first
+        if( loopSendsPending() )
+        {
+            updateWriteInterest();
+            return;
+        }
+        ssize_t backlog = m_socket.flushQueue();
+        if( backlog != 0 )
+        {
+            if( backlog < 0 )
+            {
+                out << "session " << m_config.getTargetCompID() << " send failed" << std::endl;
+                disconnect();
+                return;
+            }
+            updateWriteInterest();
+            return;
+        }
+        if( m_socket.zeroCopyPending() && !m_socket.reapZeroCopy() )
+        {
+            disconnect();
+            return;
+        }
+        ResendStatus status = m_resendProcessor(
+            [this]( const struct iovec* iov, int count ) { return m_socket.sendv( iov, count ); },
+            [this]( auto& msg, uint64_t seq, uint64_t newSeq ) {
+                return writeGapFill( msg, seq, newSeq );
+            },
+            m_socket );
+        if( status == ResendStatus::Failed )
+        {
+            out << "session " << m_config.getTargetCompID() << " resend failed" << std::endl;
+            disconnect();
+            return;
+        }
+        m_resendWaiting = status == ResendStatus::Waiting;
+        updateWriteInterest();
+        if( m_config.getHeatBeatStyle() == HeatBeatStyle::Passive &&
+            m_state == SessionState::Active )
+        {
+            m_timerWheel.touch( m_heartbeatTimer, m_heartBtInt * 1000 );
+        }
+    }
+
+    // Loop iteration done: everything queued since the last flush in one write, what
+    // the socket doesn't take waits for EPOLLOUT
+    void flushSendQueue()
+    {
+        if( loopSendsPending() )
+        {
+            updateWriteInterest();
+            return;
+        }
+        if( m_socket.flushQueue() < 0 )
+        {
+            out << "session " << m_config.getTargetCompID() << " send failed" << std::endl;
+            disconnect();
+            return;
+        }
+        updateWriteInterest();
+    }
+
+    // EPOLLOUT is only watched while a backlog or a replay is left, a writable socket
+    // would wake the loop forever; a replay waiting on zero copy completions watches
+    // EPOLLERR instead, which epoll reports anyway but a poll backend has to ask for.
+    // Behind io_uring sends nothing is watched, the loop calls back once they are out.
+    void updateWriteInterest()
+    {
+        uint32_t watched = 0;
+        if( ( ( m_resendProcessor.pending() && !m_resendWaiting ) || m_socket.queued() != 0 ) &&
+            !loopSendsPending() )
+        {
+            watched |= EPOLLOUT;
+        }
+        if( m_socket.zeroCopyPending() )
+        {
+            watched |= EPOLLERR;
+        }
+        if( watched != m_watchedEvents &&
+            m_epoller.modifyEvent( m_socket.getFd(), EpollerType::EPOLL_MODE | watched ) )
+        {
+            m_watchedEvents = watched;
+        }
+    }
+
+    // io_uring: sends the loop still has queued for the socket, anything written to it
+    // directly waits until onSocketEvent() runs for them being out
+    bool loopSendsPending()
+    {
+        if constexpr( EpollerType::NATIVE_IO )
+        {
+            return m_epoller.sendPending( m_socket.getFd() );
+        }
+        return false;
+    }
+
+    void reapZeroCopy()
+    {
+        if( !m_socket.reapZeroCopy() )
+        {
+            disconnect();
+            return;
+        }
+        updateWriteInterest();
+    }
+
+    // SequenceReset-GapFill under seq as a PossDup, not journaled
+    template<typename MsgT>
+    bool writeGapFill( MsgT& msg, uint64_t seq, uint64_t newSeq )
+    {
+        if( !writeHeader( msg, "4", seq ) || !msg.add_char( 43, 'Y' ) ||
+            !msg.add_char( 123, 'Y' ) || !msg.add_int( 36, static_cast<int64_t>( newSeq ) ) )
+        {
+            return false;
+        }
+        msg.gen_tail();
+        return true;
+    }
+
+    bool sendGapFill( uint64_t seq, uint64_t newSeq )
+    {
+        m_probes.start( PROBE_ENCODE );
+        m_txMsg.reset();
+        if( !writeGapFill( m_txMsg, seq, newSeq ) )
+        {
+            return false;
+        }
+        m_probes.mark( PROBE_ENCODE );
+        return sendBytes( m_txMsg.get_msg_data(), m_txMsg.get_msg_size() );
+    }
+
+    void onSequenceReset()
+    {
+        int64_t newSeq;
+        if( !m_view.get_int( 36, newSeq ) || newSeq <= 0 )
+        {
+            return;
+        }
+        if( static_cast<uint64_t>( newSeq ) > m_nextInSeq )
+        {
+            m_nextInSeq = static_cast<uint64_t>( newSeq );
+            // a GapFill can jump past the end of the gap we asked for
+            checkResendDone();
+        }
+    }
+
+    // the outstanding ResendRequest is answered once m_nextInSeq passes its end
+    void checkResendDone()
+    {
+        if( m_resendEnd != 0 && m_nextInSeq > m_resendEnd )
+        {
+            m_resendEnd = 0;
+        }
+    }
+
+    void onLogout()
+    {
+        if( m_state != SessionState::LogoutSent )
+        {
+            sendLogout( std::string_view() );
+        }
+        disconnect();
+    }
+
+    void requestResend( uint64_t seq )
+    {
+        // one outstanding request at a time, it already covers everything after it
+        if( m_resendEnd != 0 )
+        {
+            return;
+        }
+        m_resendEnd = seq;
+        uint64_t begin = m_nextInSeq;
+        send( "2", [begin]( MsgType& msg ) {
+            return msg.add_int( 7, static_cast<int64_t>( begin ) ) && msg.add_int( 16, 0 );
+        } );
+    }
+
+    // session level error: Logout with the reason, then drop the connection
+    void terminate( std::string_view text )
+    {
+        sendLogout( text );
+        disconnect();
+    }
+
+    bool sendLogon( bool reset )
+    {
+        int heartBtInt = m_heartBtInt;
+        return send( "A", [heartBtInt, reset]( MsgType& msg ) {
+            return msg.add_int( 98, 0 ) && msg.add_int( 108, heartBtInt ) &&
+                   ( !reset || msg.add_char( 141, 'Y' ) );
+        } );
+    }
+
+    bool sendLogout( std::string_view text )
+    {
+        return send( "5", [text]( MsgType& msg ) {
+            return text.empty() || msg.add_field( 58, text );
+        } );
+    }
+
+    // session level Reject of the message in m_view; reason is a SessionRejectReason
+    bool sendReject( std::string_view refMsgType, int refTag, int reason, std::string_view text )
+    {
+        int64_t refSeq = 0;
+        m_view.get_int( 34, refSeq );
+        return send( "3", [&]( MsgType& msg ) {
+            return msg.add_int( 45, refSeq ) && msg.add_int( 371, refTag ) &&
+                   msg.add_field( 372, refMsgType ) && msg.add_int( 373, reason ) &&
+                   msg.add_field( 58, text );
+        } );
+    }
+
+    template<typename MsgT>
+    bool writeHeader( MsgT& msg, std::string_view msgType, uint64_t seq )
+    {
+        if( !msg.add_field( 35, msgType ) || !msg.add_field( 49, m_config.getSenderCompID() ) ||
+            !msg.add_field( 56, m_config.getTargetCompID() ) ||
+            !msg.add_int( 34, static_cast<int64_t>( seq ) ) )
+        {
+            return false;
+        }
+        char* p = msg.reserve_block( 3 + UtcTimestampFormatter::SIZE + 1 );
+        if( p == nullptr )
+        {
+            return false;
+        }
+        ::memcpy( p, "52=", 3 );
+        m_timestamp.format( p + 3 );
+        p[3 + UtcTimestampFormatter::SIZE] = SOH;
+        msg.advance( 3 + UtcTimestampFormatter::SIZE + 1 );
+        return true;
+    }
+
+    bool sendBytes( const char* data, size_t size )
+    {
+        bool queued = false;
+        if constexpr( EpollerType::NATIVE_IO )
+        {
+            // queued with the loop's next submit, a failure comes back through onRecv().
+            // Once the loop refuses, the socket's queue takes over until it is empty.
+            queued = m_socket.queued() == 0 && m_epoller.send( m_socket.getFd(), data, size );
+        }
+        if( !queued )
+        {
+            queued = m_socket.queue( data, size );
+            if( queued )
+            {
+                m_epoller.schedule( m_flushTask );
+            }
+        }
+        if( !queued )
+        {
+            // a dropped message can't be recovered on this connection
+            out << "session " << m_config.getTargetCompID() << " send of " << size
+                << " bytes failed" << std::endl;
+            disconnect();
+            return false;
+        }
+        m_probes.mark( PROBE_SEND );
+        if( m_config.getHeatBeatStyle() == HeatBeatStyle::Passive &&
+            m_state == SessionState::Active )
+        {
+            m_timerWheel.touch( m_heartbeatTimer, m_heartBtInt * 1000 );
+        }
+        return true;
+    }
+
+    // any traffic pushes the inbound timer out; only the Heartbeat answering our
+    // TestRequest clears it, see onHeartbeat()
+    void resetInboundTimer()
+    {
+        if( m_state == SessionState::Active )
+        {
+            // a little slack over the interval for transmission delay
+            m_timerWheel.touch( m_inboundTimer, m_heartBtInt * 1200 );
+        }
+    }
+
+    void onHeartbeatTimer()
+    {
+        if( m_state != SessionState::Active )
+        {
+            return;
+        }
+        if( m_config.getHeatBeatStyle() == HeatBeatStyle::Aggressive )
+        {
+            m_timerWheel.schedule( m_heartbeatTimer, m_heartBtInt * 1000 );
+        }
+        send( "0", []( MsgType& ) { return true; } );
+    }
+
+    // nothing received for a heartbeat interval: TestRequest. If its Heartbeat hasn't
+    // come back by the time the timer fires again the connection is dead
+    void onInboundTimer()
+    {
+        if( m_state != SessionState::Active )
+        {
+            return;
+        }
+        if( m_testRequestPending )
+        {
+            out << "session " << m_config.getTargetCompID() << " TestRequest timed out"
+                << std::endl;
+            disconnect();
+            return;
+        }
+        m_testRequestPending = true;
+        m_testRequestId++;
+        uint64_t id = m_testRequestId;
+        m_timerWheel.schedule( m_inboundTimer, m_heartBtInt * 1000 );
+        send( "1", [id]( MsgType& msg ) { return msg.add_int( 112, static_cast<int64_t>( id ) ); } );
+    }
+
+    void onLogonTimer()
+    {
+        out << "session " << m_config.getTargetCompID() << " logon/logout timed out" << std::endl;
+        disconnect();
+    }
+
+    SessionConfigBase&         m_config;
+    SocketType                 m_socket;
+    EpollerType&               m_epoller;
+    TimerWheelType&            m_timerWheel;
+    Application&               m_app;
+    char                       m_txBuf[SEND_BUF_SIZE];
+    MsgType                    m_txMsg;
+    JournalType                m_journal;
+    ResendRequestProcessorType m_resendProcessor;
+    MsgViewType                m_view;
+    FramerType                 m_framer;
+    Probes                     m_probes;
+    UtcTimestampFormatter      m_timestamp;
+    TimerNodeType              m_heartbeatTimer;
+    TimerNodeType              m_inboundTimer;
+    TimerNodeType              m_logonTimer;
+    // flushes the send queue at the end of the loop iteration
+    typename EpollerType::Task m_flushTask;
+    SessionState               m_state;
+    int                        m_heartBtInt;
+    uint64_t                   m_nextOutSeq;
+    uint64_t                   m_nextInSeq;
+    // highest seq seen when the pending ResendRequest went out
+    uint64_t                   m_resendEnd;
+    uint64_t                   m_testRequestId;
+    bool                       m_testRequestPending;
+    // the replay is held up by zero copy sends that haven't completed
+    bool                       m_resendWaiting;
+    // EPOLLOUT and EPOLLERR watched on top of EPOLL_MODE, see updateWriteInterest()
+    uint32_t                   m_watchedEvents;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+#include "epoller_misc.h"
+#include "socket_misc.h"
+#include "timer_wheel_misc.h"
+#include "tiny_fix_msg.h"
+#include "tiny_fix_framer.h"
+#include "message_journal.h"
+#include "resend_request_processor.h"
+#include "latency_probe.h"
+
+namespace TinyFix {
+
+enum class SessionState : uint8_t
+{
+    Disconnected = 0,
+    AwaitingLogon, // acceptor, connected and waiting for the counterparty's Logon
+    LogonSent,     // initiator, Logon sent and waiting for the reply
+    Active,
+    LogoutSent,
+
+    SessionState_Count
+};
+
+// Application callbacks, called on the thread that runs the session's Epoller.
+// The view and everything it points to is only valid during the call.
+struct DefaultSessionApplication
+{
+    template<typename SessionT>
+    void onLogon( SessionT& )
+    {
+    }
+
+    template<typename SessionT>
+    void onLogout( SessionT& )
+    {
+    }
+
+    // every application message, and session level Rejects
+    template<typename SessionT, typename MsgViewT>
+    void onMessage( SessionT&, const MsgViewT& )
+    {
+    }
+};
+
+class DefaultSessionComponents
+{
+public:
+    using SocketComponents = DefaultSocketComponents;
+    using EpollerComponents = DefaultEpollerComponents;
+    using TimerWheelComponents = DefaultTimerWheelComponents;
+    using MsgComponents = DefaultTinyFixMsgComponents;
+    using MsgViewComponents = DefaultTinyFixMsgViewComponents;
+    using FramerComponents = DefaultTinyFixFramerComponents;
+    // ZeroCopyResendRequestProcessorComponents keeps several replay batches in flight
+    // when the socket config turns on getZeroCopy()
+    using ResendRequestProcessorComponents = DefaultResendRequestProcessorComponents;
+    using Application = DefaultSessionApplication;
+    // NullLatencyProbes compiles the probe points out, LatencyProbes<> records them
+    using Probes = NullLatencyProbes;
+    using OutStreamType = std::ostream;
+    constexpr static auto& outStream = std::cout;
+    // one outbound message is encoded here at a time
+    constexpr static size_t SEND_BUF_SIZE = 4096;
+};
+
+class SessionConfigBase
+{
+public:
+    virtual const std::string& getSenderCompID() const = 0;
+    virtual const std::string& getTargetCompID() const = 0;
+    // HeartBtInt(108) in seconds
+    virtual const int           getHeartBtInt() const = 0;
+    virtual const HeatBeatStyle getHeatBeatStyle() const = 0;
+    // initiators send the Logon, acceptors wait for it
+    virtual const bool getInitiator() const = 0;
+    // seconds to wait for the Logon (acceptor) or its reply (initiator)
+    virtual const int  getLogonTimeout() const = 0;
+    // ResetSeqNumFlag(141) on Logon
+    virtual const bool getResetSeqNumOnLogon() const = 0;
+    // outbound message journal, empty disables it and ResendRequests are gap filled
+    virtual const std::string& getJournalPath() const
+    {
+        static const std::string none;
+        return none;
+    }
+    virtual ~SessionConfigBase()
+    {
+    }
+};
+
+class DefaultSessionConfig : public SessionConfigBase
+{
+public:
+    DefaultSessionConfig( std::string   senderCompID,
+                          std::string   targetCompID,
+                          bool          initiator = true,
+                          int           heartBtInt = 30,
+                          HeatBeatStyle heatBeatStyle = HeatBeatStyle::Passive,
+                          int           logonTimeout = 10,
+                          bool          resetSeqNumOnLogon = true,
+                          std::string   journalPath = "" )
+        : m_senderCompID( senderCompID )
+        , m_targetCompID( targetCompID )
+        , m_initiator( initiator )
+        , m_heartBtInt( heartBtInt )
+        , m_heatBeatStyle( heatBeatStyle )
+        , m_logonTimeout( logonTimeout )
+        , m_resetSeqNumOnLogon( resetSeqNumOnLogon )
+        , m_journalPath( journalPath )
+    {
+    }
+
+    ~DefaultSessionConfig()
+    {
+    }
+
+    virtual const std::string& getSenderCompID() const
+    {
+        return m_senderCompID;
+    }
+    virtual const std::string& getTargetCompID() const
+    {
+        return m_targetCompID;
+    }
+    virtual const int getHeartBtInt() const
+    {
+        return m_heartBtInt;
+    }
+    virtual const HeatBeatStyle getHeatBeatStyle() const
+    {
+        return m_heatBeatStyle;
+    }
+    virtual const bool getInitiator() const
+    {
+        return m_initiator;
+    }
+    virtual const int getLogonTimeout() const
+    {
+        return m_logonTimeout;
+    }
+    virtual const bool getResetSeqNumOnLogon() const
+    {
+        return m_resetSeqNumOnLogon;
+    }
+    virtual const std::string& getJournalPath() const
+    {
+        return m_journalPath;
+    }
+
+private:
+    const std::string   m_senderCompID;
+    const std::string   m_targetCompID;
+    const bool          m_initiator;
+    const int           m_heartBtInt;
+    const HeatBeatStyle m_heatBeatStyle;
+    const int           m_logonTimeout;
+    const bool          m_resetSeqNumOnLogon;
+    const std::string   m_journalPath;
+};
+
+} // namespace TinyFix
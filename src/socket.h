@@ -1,10 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <vector>
 #include <errno.h>
 #include <iostream>
 #include <string>
 #include <thread>
+#include <utility>
 // memset
 #include <string.h>
 // socket headers
@@ -12,15 +15,37 @@
 #include <sys/types.h>
 // sockaddr_in
 #include <netinet/in.h>
+// TCP_NODELAY
+#include <netinet/tcp.h>
 // inet_pton
 #include <arpa/inet.h>
 // fcntl
 #include <fcntl.h>
+// writev
+#include <sys/uio.h>
+// timespec
+#include <time.h>
+// sock_extended_err, zero copy completions
+#include <linux/errqueue.h>
 // shutdown and close
 #include <unistd.h>
 // misc
 #include "socket_misc.h"
 
+// older libc headers predate these
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
 namespace TinyFix {
 
 enum SocketType
@@ -32,14 +57,228 @@ enum SocketType
     DUMMYSocketType,
 };
 
+// Pre-allocated slots for recvmmsg(): one call fills up to BATCH_SIZE datagrams,
+// each with its source address and, after setTimestampNs(), the kernel receive
+// timestamp. The received datagrams are valid until the next recvBatch().
+template<typename SocketComponentsT>
+class DatagramBatch
+{
+public:
+    constexpr static int    BATCH_SIZE = SocketComponentsT::DATAGRAM_BATCH_SIZE;
+    constexpr static size_t SLOT_SIZE = SocketComponentsT::DATAGRAM_SLOT_SIZE;
+    // room for one SCM_TIMESTAMPNS message
+    constexpr static size_t CONTROL_SIZE = CMSG_SPACE( sizeof( struct timespec ) );
+
+    struct Datagram
+    {
+        const char*        data;
+        size_t             size;
+        struct sockaddr_in source;
+        // zero unless kernel timestamps are on
+        struct timespec    timestamp;
+        // the datagram was longer than a slot, only SLOT_SIZE bytes were kept
+        bool               truncated;
+    };
+
+    DatagramBatch( const DatagramBatch& ) = delete;
+    DatagramBatch& operator=( const DatagramBatch& ) = delete;
+
+    DatagramBatch()
+        : m_count( 0 )
+    {
+        ::memset( m_msgs, 0, sizeof( m_msgs ) );
+        for( int i = 0; i < BATCH_SIZE; i++ )
+        {
+            m_iov[i].iov_base = m_slots + i * SLOT_SIZE;
+            m_iov[i].iov_len = SLOT_SIZE;
+            m_msgs[i].msg_hdr.msg_name = &m_datagrams[i].source;
+            m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+            m_msgs[i].msg_hdr.msg_iovlen = 1;
+            m_msgs[i].msg_hdr.msg_control = m_control[i].buf;
+        }
+    }
+
+    int count() const
+    {
+        return m_count;
+    }
+
+    const Datagram& at( int i ) const
+    {
+        return m_datagrams[i];
+    }
+
+    const Datagram* begin() const
+    {
+        return m_datagrams;
+    }
+
+    const Datagram* end() const
+    {
+        return m_datagrams + m_count;
+    }
+
+    // the kernel shrinks the name and control lengths to what it wrote, so they are
+    // reset before every call
+    struct mmsghdr* prepare()
+    {
+        for( int i = 0; i < BATCH_SIZE; i++ )
+        {
+            m_msgs[i].msg_hdr.msg_namelen = sizeof( struct sockaddr_in );
+            m_msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+            m_msgs[i].msg_hdr.msg_flags = 0;
+        }
+        m_count = 0;
+        return m_msgs;
+    }
+
+    // picks up the count datagrams recvmmsg() returned
+    void fill( int count )
+    {
+        m_count = count;
+        for( int i = 0; i < count; i++ )
+        {
+            Datagram&      datagram = m_datagrams[i];
+            struct msghdr& hdr = m_msgs[i].msg_hdr;
+            datagram.data = m_slots + i * SLOT_SIZE;
+            datagram.size = m_msgs[i].msg_len;
+            datagram.truncated = ( hdr.msg_flags & MSG_TRUNC ) != 0;
+            datagram.timestamp.tv_sec = 0;
+            datagram.timestamp.tv_nsec = 0;
+            for( struct cmsghdr* cmsg = CMSG_FIRSTHDR( &hdr ); cmsg != nullptr;
+                 cmsg = CMSG_NXTHDR( &hdr, cmsg ) )
+            {
+                if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+                {
+                    ::memcpy( &datagram.timestamp, CMSG_DATA( cmsg ), sizeof( struct timespec ) );
+                }
+            }
+        }
+    }
+
+private:
+    // control buffers have to be aligned for the cmsghdr inside
+    union ControlBuf
+    {
+        char           buf[CONTROL_SIZE];
+        struct cmsghdr align;
+    };
+
+    int            m_count;
+    struct mmsghdr m_msgs[BATCH_SIZE];
+    struct iovec   m_iov[BATCH_SIZE];
+    Datagram       m_datagrams[BATCH_SIZE];
+    ControlBuf     m_control[BATCH_SIZE];
+    char           m_slots[BATCH_SIZE * SLOT_SIZE];
+};
+
+// Outbound bytes a TCP socket hasn't written yet. Messages are appended back to back
+// and go out together with the next flush, what the socket doesn't take stays queued
+// from the offset it stopped at, so a message is never torn or dropped. Nothing is
+// allocated until the first append(); after that the storage is only grown.
+template<typename SocketComponentsT>
+class SendQueue
+{
+public:
+    constexpr static size_t INITIAL_SIZE = SocketComponentsT::SEND_QUEUE_INITIAL_SIZE;
+    constexpr static size_t MAX_SIZE = SocketComponentsT::SEND_QUEUE_MAX_SIZE;
+
+    static_assert( MAX_SIZE >= INITIAL_SIZE, "SEND_QUEUE_MAX_SIZE below SEND_QUEUE_INITIAL_SIZE" );
+
+    SendQueue( const SendQueue& ) = delete;
+    SendQueue& operator=( const SendQueue& ) = delete;
+
+    SendQueue()
+        : m_head( 0 )
+        , m_tail( 0 )
+    {
+    }
+
+    // false if the backlog would pass MAX_SIZE, nothing is queued then
+    bool append( const char* data, size_t size )
+    {
+        if( m_tail + size > m_data.size() && !makeRoom( size ) )
+        {
+            return false;
+        }
+        ::memcpy( m_data.data() + m_tail, data, size );
+        m_tail += size;
+        return true;
+    }
+
+    const char* data() const
+    {
+        return m_data.data() + m_head;
+    }
+
+    size_t size() const
+    {
+        return m_tail - m_head;
+    }
+
+    bool empty() const
+    {
+        return m_tail == m_head;
+    }
+
+    void consume( size_t size )
+    {
+        m_head += size;
+        if( m_head == m_tail )
+        {
+            m_head = 0;
+            m_tail = 0;
+        }
+    }
+
+    void clear()
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+private:
+    // moves the backlog to the front, then grows if that still isn't enough
+    bool makeRoom( size_t size )
+    {
+        size_t queued = m_tail - m_head;
+        if( queued + size > MAX_SIZE )
+        {
+            return false;
+        }
+        if( m_head != 0 )
+        {
+            ::memmove( m_data.data(), m_data.data() + m_head, queued );
+            m_head = 0;
+            m_tail = queued;
+        }
+        if( queued + size > m_data.size() )
+        {
+            size_t capacity = m_data.empty() ? INITIAL_SIZE : m_data.size();
+            while( capacity < queued + size )
+            {
+                capacity *= 2;
+            }
+            m_data.resize( std::min( capacity, MAX_SIZE ) );
+        }
+        return true;
+    }
+
+    std::vector<char> m_data;
+    size_t            m_head;
+    size_t            m_tail;
+};
+
 template<typename SocketComponentsT>
 class SocketBase
 {
 public:
-    constexpr static size_t BUF_SIZE = SocketComponentsT::SOCKET_RECV_BUF_SIZE;
+    constexpr static size_t RECV_MIN_FREE = SocketComponentsT::SOCKET_RECV_MIN_FREE;
+    constexpr static size_t ZEROCOPY_MIN_SIZE = SocketComponentsT::ZEROCOPY_MIN_SIZE;
     using OutType = typename SocketComponentsT::OutStreamType;
     constexpr static auto& out = SocketComponentsT::outStream;
-    using BufType = std::array<uint8_t, BUF_SIZE>;
+    using BufType = RecvBuffer<typename SocketComponentsT::RecvBufferComponents>;
+    using SendQueueType = SendQueue<SocketComponentsT>;
 
     SocketBase( const SocketBase& ) = delete;
     SocketBase& operator=( const SocketBase& ) = delete;
@@ -47,6 +286,11 @@ public:
     SocketBase( SocketConfigBase& config )
         : m_config( config )
         , m_fd( -1 )
+        , m_quickAck( false )
+        , m_zeroCopy( false )
+        , m_zeroCopySent( 0 )
+        , m_zeroCopyDone( 0 )
+        , m_zeroCopyCopied( 0 )
     {
     }
     ~SocketBase()
@@ -115,6 +359,85 @@ public:
         return true;
     }
 
+    // lets several sockets bind the same address and port, the kernel spreads incoming
+    // connections (TCP) or datagrams (UDP) over them by a hash of the 4-tuple
+    bool setReUsePort()
+    {
+        int reuse = 1;
+        if( ::setsockopt( m_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof( reuse ) ) < 0 )
+        {
+            out << "set SO_REUSEPORT failed: " << ::strerror( errno ) << ". (errno: " << errno
+                << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Applies the config's tuning profile and reads every option back into
+    // getTuning(). An option the kernel refuses fails the call; one it adjusts, e.g. a
+    // buffer clamped to net.core.rmem_max, is logged and left in the report.
+    // create() runs it; an accepted fd needs its own call, buffer sizes it inherits
+    // from the listener.
+    bool tune()
+    {
+        m_tuning = SocketTuningReport();
+        m_quickAck = false;
+        m_zeroCopy = false;
+        int       type = 0;
+        socklen_t len = sizeof( type );
+        ::getsockopt( m_fd, SOL_SOCKET, SO_TYPE, &type, &len );
+        bool tcp = type == SOCK_STREAM;
+        bool res = true;
+
+        res &= applyOption( m_tuning.noDelay, IPPROTO_TCP, TCP_NODELAY, 1,
+                            tcp && m_config.getNoDelay() );
+        res &= applyOption( m_tuning.quickAck, IPPROTO_TCP, TCP_QUICKACK, 1,
+                            tcp && m_config.getQuickAck() );
+        m_quickAck = m_tuning.quickAck.applied;
+        res &= applyBufSize( m_tuning.recvBuf, SO_RCVBUF, SO_RCVBUFFORCE,
+                             m_config.getRecvBufSize() );
+        res &= applyBufSize( m_tuning.sendBuf, SO_SNDBUF, SO_SNDBUFFORCE,
+                             m_config.getSendBufSize() );
+        // let recv() on this socket poll the device queue instead of waiting for the
+        // interrupt
+        int busyPoll = m_config.getBusyPollMicros();
+        res &= applyOption( m_tuning.busyPoll, SOL_SOCKET, SO_BUSY_POLL, busyPoll, busyPoll > 0 );
+        res &= applyOption( m_tuning.preferBusyPoll, SOL_SOCKET, SO_PREFER_BUSY_POLL, 1,
+                            busyPoll > 0 && m_config.getPreferBusyPoll() );
+        int tos = m_config.getTos();
+        res &= applyOption( m_tuning.tos, IPPROTO_IP, IP_TOS, tos, tos >= 0 );
+        int cpu = m_config.getIncomingCpu();
+        res &= applyOption( m_tuning.incomingCpu, SOL_SOCKET, SO_INCOMING_CPU, cpu, cpu >= 0 );
+        res &= applyOption( m_tuning.zeroCopy, SOL_SOCKET, SO_ZEROCOPY, 1,
+                            tcp && m_config.getZeroCopy() );
+        m_zeroCopy = m_tuning.zeroCopy.applied;
+
+        if( !m_tuning.ok() )
+        {
+            out << "socket " << m_fd << " tuning differs from the config:" << std::endl;
+            m_tuning.print( out );
+        }
+        return res;
+    }
+
+    const SocketTuningReport& getTuning() const
+    {
+        return m_tuning;
+    }
+
+    // kernel receive timestamps (SCM_TIMESTAMPNS), recvBatch() reports them per datagram
+    bool setTimestampNs()
+    {
+        int on = 1;
+        if( ::setsockopt( m_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof( on ) ) < 0 )
+        {
+            out << "set SO_TIMESTAMPNS failed: " << ::strerror( errno ) << ". (errno: " << errno
+                << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
     /*
      * 主要分四种情况：
      *   1.l_onoff为0。则马上关闭socket（graceful），closesocket马上返回。并尽量在后台将内核发送缓冲区的数据发出去。这种情况正常四次挥手。
@@ -162,6 +485,14 @@ public:
             ::close( m_fd );
             m_fd = -1;
         }
+        m_buf.release();
+        m_sendQueue.clear();
+        m_quickAck = false;
+        m_zeroCopy = false;
+        // a new socket numbers its zero copy sends from 0 again
+        m_zeroCopySent = 0;
+        m_zeroCopyDone = 0;
+        m_zeroCopyEarly.clear();
         return true;
     }
 
@@ -176,15 +507,202 @@ public:
         return res;
     }
 
+    // gathers count buffers into one syscall; EAGAIN isn't logged, a non blocking
+    // caller is expected to hit it and resume on EPOLLOUT
+    ssize_t sendv( const struct iovec* iov, int count )
+    {
+        ssize_t res = ::writev( m_fd, iov, count );
+        if( res < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+        {
+            out << "send error: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                << std::endl;
+        }
+        return res;
+    }
+
+    // sendv() with MSG_ZEROCOPY once SO_ZEROCOPY is on and the write is at least
+    // ZEROCOPY_MIN_SIZE: the kernel sends straight out of the caller's pages, so they
+    // must stay untouched until zeroCopyReleased( zeroCopyTicket() ), taken after the
+    // call, is true.
+    ssize_t sendvZeroCopy( const struct iovec* iov, int count )
+    {
+        size_t size = 0;
+        for( int i = 0; i < count; i++ )
+        {
+            size += iov[i].iov_len;
+        }
+        if( !m_zeroCopy || size < ZEROCOPY_MIN_SIZE )
+        {
+            return sendv( iov, count );
+        }
+        struct msghdr msg;
+        ::memset( &msg, 0, sizeof( msg ) );
+        msg.msg_iov = const_cast<struct iovec*>( iov );
+        msg.msg_iovlen = static_cast<size_t>( count );
+        ssize_t res = ::sendmsg( m_fd, &msg, MSG_ZEROCOPY );
+        if( res < 0 && errno == ENOBUFS )
+        {
+            // optmem_max can't account for more pinned pages, this one is copied
+            return sendv( iov, count );
+        }
+        if( res < 0 )
+        {
+            if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+            {
+                out << "send error: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                    << std::endl;
+            }
+            return res;
+        }
+        // the kernel numbers every successful call, failed ones give their number back
+        m_zeroCopySent++;
+        return res;
+    }
+
+    // the zero copy sends made so far, see zeroCopyReleased()
+    uint32_t zeroCopyTicket() const
+    {
+        return m_zeroCopySent;
+    }
+
+    // every zero copy send before ticket is done with its pages
+    bool zeroCopyReleased( uint32_t ticket ) const
+    {
+        return static_cast<int32_t>( m_zeroCopyDone - ticket ) >= 0;
+    }
+
+    bool zeroCopyPending() const
+    {
+        return m_zeroCopyDone != m_zeroCopySent;
+    }
+
+    // Reads the completions of zero copy sends off the socket's error queue, which
+    // epoll reports as EPOLLERR. False on an error other than the queue running dry.
+    bool reapZeroCopy()
+    {
+        for( ;; )
+        {
+            union
+            {
+                char           buf[CMSG_SPACE( sizeof( struct sock_extended_err ) ) +
+                                   CMSG_SPACE( sizeof( struct sockaddr_in ) )];
+                struct cmsghdr align;
+            } control;
+            struct msghdr msg;
+            ::memset( &msg, 0, sizeof( msg ) );
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof( control.buf );
+            if( ::recvmsg( m_fd, &msg, MSG_ERRQUEUE ) == -1 )
+            {
+                if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+                {
+                    return true;
+                }
+                out << "recv error queue error: " << ::strerror( errno ) << ". (errno: " << errno
+                    << ")" << std::endl;
+                return false;
+            }
+            for( struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg ); cmsg != nullptr;
+                 cmsg = CMSG_NXTHDR( &msg, cmsg ) )
+            {
+                struct sock_extended_err err;
+                if( cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR )
+                {
+                    continue;
+                }
+                ::memcpy( &err, CMSG_DATA( cmsg ), sizeof( err ) );
+                if( err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY )
+                {
+                    continue;
+                }
+                // [ee_info, ee_data] of the send numbers
+                if( err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED )
+                {
+                    m_zeroCopyCopied += err.ee_data - err.ee_info + 1;
+                }
+                completeZeroCopy( err.ee_info, err.ee_data );
+            }
+        }
+    }
+
+    // zero copy sends the kernel copied after all, e.g. over loopback or to a NIC
+    // without scatter gather; a socket where most are is better off without SO_ZEROCOPY
+    uint64_t getZeroCopyCopied() const
+    {
+        return m_zeroCopyCopied;
+    }
+
+    // Corked send: the bytes are only copied to the send queue, flushQueue() writes
+    // everything queued since the last flush with one syscall. False if the queue is
+    // full, the peer isn't reading.
+    bool queue( const char* data, size_t size )
+    {
+        if( !m_sendQueue.append( data, size ) )
+        {
+            out << "send queue full. (queued: " << m_sendQueue.size() << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Writes as much of the send queue as the socket takes, a short write leaves the
+    // rest queued for the next call, e.g. on EPOLLOUT. Returns the bytes still queued,
+    // -1 on an error other than EAGAIN, which drops the queue.
+    ssize_t flushQueue()
+    {
+        if( m_sendQueue.empty() )
+        {
+            return 0;
+        }
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>( m_sendQueue.data() );
+        iov.iov_len = m_sendQueue.size();
+        ssize_t res = sendv( &iov, 1 );
+        if( res < 0 )
+        {
+            if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+            {
+                return static_cast<ssize_t>( m_sendQueue.size() );
+            }
+            // the connection is gone, so are the bytes
+            m_sendQueue.clear();
+            return -1;
+        }
+        m_sendQueue.consume( static_cast<size_t>( res ) );
+        return static_cast<ssize_t>( m_sendQueue.size() );
+    }
+
+    size_t queued() const
+    {
+        return m_sendQueue.size();
+    }
+
+    // appends to the receive ring behind whatever the caller hasn't consumed yet,
+    // so a message split across reads is contiguous once the rest arrives
     ssize_t recv()
     {
-        ssize_t res = ::recv( m_fd, &m_buf[0], BUF_SIZE, 0 );
-        if( res < 0 ||
+        if( !m_buf.reserve( RECV_MIN_FREE ) )
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        ssize_t res = ::recv( m_fd, m_buf.writeHead(), m_buf.writable(), 0 );
+        // a wakeup for EPOLLOUT or EPOLLERR reads nothing, that isn't worth a line
+        if( ( res < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) ||
             ( res == 0 && ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) ) )
         {
             out << "recv error: " << ::strerror( errno ) << ". (errno: " << errno << ")"
                 << std::endl;
         }
+        else if( res > 0 )
+        {
+            m_buf.commit( static_cast<size_t>( res ) );
+            if( m_quickAck )
+            {
+                int on = 1;
+                ::setsockopt( m_fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof( on ) );
+            }
+        }
         return res;
     }
 
@@ -198,6 +716,16 @@ public:
         m_fd = fd;
     }
 
+    // takes over fd with the tuning another socket on the same config gave it, e.g.
+    // Acceptor, instead of running tune() again
+    void adopt( int fd, const SocketTuningReport& tuning )
+    {
+        m_fd = fd;
+        m_tuning = tuning;
+        m_quickAck = tuning.quickAck.applied;
+        m_zeroCopy = tuning.zeroCopy.applied;
+    }
+
     BufType& buf()
     {
         return m_buf;
@@ -214,10 +742,148 @@ public:
     }
 
 protected:
+    // TCP completes sends in order as a rule, a range that arrives early waits for
+    // the ones before it
+    void completeZeroCopy( uint32_t first, uint32_t last )
+    {
+        if( first != m_zeroCopyDone )
+        {
+            m_zeroCopyEarly.emplace_back( first, last );
+            return;
+        }
+        m_zeroCopyDone = last + 1;
+        for( size_t i = 0; i < m_zeroCopyEarly.size(); )
+        {
+            if( m_zeroCopyEarly[i].first == m_zeroCopyDone )
+            {
+                m_zeroCopyDone = m_zeroCopyEarly[i].second + 1;
+                m_zeroCopyEarly.erase( m_zeroCopyEarly.begin() + i );
+                i = 0;
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    // sets one option when requested and reads it back into report
+    bool applyOption( SocketOptionReport& report, int level, int name, int value, bool requested )
+    {
+        if( !requested )
+        {
+            return true;
+        }
+        report.requested = true;
+        report.wanted = value;
+        if( ::setsockopt( m_fd, level, name, &value, sizeof( value ) ) < 0 )
+        {
+            out << "setsockopt( " << level << ", " << name << " ) failed: " << ::strerror( errno )
+                << ". (errno: " << errno << ")" << std::endl;
+            return false;
+        }
+        report.applied = true;
+        report.actual = readOption( level, name );
+        report.verified = report.actual == value;
+        return true;
+    }
+
+    // Buffer sizes read back doubled, the kernel counts its bookkeeping in them, so
+    // anything at least as large as asked for is fine. A clamped size is retried with
+    // the FORCE variant, which only works with CAP_NET_ADMIN.
+    bool applyBufSize( SocketOptionReport& report, int name, int forceName, int size )
+    {
+        if( !applyOption( report, SOL_SOCKET, name, size, size > 0 ) )
+        {
+            return false;
+        }
+        if( report.applied && report.actual < size )
+        {
+            ::setsockopt( m_fd, SOL_SOCKET, forceName, &size, sizeof( size ) );
+            report.actual = readOption( SOL_SOCKET, name );
+        }
+        report.verified = report.actual >= size;
+        return true;
+    }
+
+    int readOption( int level, int name )
+    {
+        int       value = 0;
+        socklen_t len = sizeof( value );
+        ::getsockopt( m_fd, level, name, &value, &len );
+        return value;
+    }
+
+    // Receives up to DatagramBatch::BATCH_SIZE datagrams in one syscall. Blocks for the
+    // first one on a blocking socket, then takes whatever else is already queued.
+    int recvDatagrams( DatagramBatch<SocketComponentsT>& batch )
+    {
+        constexpr int BATCH_SIZE = DatagramBatch<SocketComponentsT>::BATCH_SIZE;
+        int res = ::recvmmsg( m_fd, batch.prepare(), BATCH_SIZE, MSG_WAITFORONE, nullptr );
+        if( res < 0 )
+        {
+            if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+            {
+                out << "recvmmsg error: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                    << std::endl;
+            }
+            return res;
+        }
+        batch.fill( res );
+        return res;
+    }
+
+    // Sends count datagrams to sendAddr, DatagramBatch::BATCH_SIZE per syscall.
+    // Returns how many went out, short when the socket buffer fills up.
+    int sendDatagrams( struct sockaddr_in& sendAddr, const struct iovec* datagrams, int count )
+    {
+        constexpr int  BATCH_SIZE = DatagramBatch<SocketComponentsT>::BATCH_SIZE;
+        struct mmsghdr msgs[BATCH_SIZE];
+        int            sent = 0;
+        while( sent < count )
+        {
+            int batch = count - sent < BATCH_SIZE ? count - sent : BATCH_SIZE;
+            ::memset( msgs, 0, sizeof( struct mmsghdr ) * batch );
+            for( int i = 0; i < batch; i++ )
+            {
+                msgs[i].msg_hdr.msg_name = &sendAddr;
+                msgs[i].msg_hdr.msg_namelen = sizeof( sendAddr );
+                msgs[i].msg_hdr.msg_iov = const_cast<struct iovec*>( &datagrams[sent + i] );
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int res = ::sendmmsg( m_fd, msgs, batch, 0 );
+            if( res < 0 )
+            {
+                if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                {
+                    out << "sendmmsg error: " << ::strerror( errno ) << ". (errno: " << errno
+                        << ")" << std::endl;
+                }
+                return sent > 0 ? sent : res;
+            }
+            sent += res;
+            if( res < batch )
+            {
+                break;
+            }
+        }
+        return sent;
+    }
+
     const SocketConfigBase& m_config;
     int                     m_fd;
     struct sockaddr_in      m_servAddr;
     BufType                 m_buf;
+    SendQueueType           m_sendQueue;
+    SocketTuningReport      m_tuning;
+    // TCP_QUICKACK is re-armed after every read
+    bool                    m_quickAck;
+    bool                    m_zeroCopy;
+    // zero copy sends made and completed, numbered by the kernel from 0 per socket
+    uint32_t                m_zeroCopySent;
+    uint32_t                m_zeroCopyDone;
+    uint64_t                m_zeroCopyCopied;
+    std::vector<std::pair<uint32_t, uint32_t>> m_zeroCopyEarly;
 
 private:
 };
@@ -240,16 +906,17 @@ public:
     {
     }
 
-    bool create()
+    // flags are OR'ed into the socket type, e.g. SOCK_NONBLOCK | SOCK_CLOEXEC
+    bool create( int flags = 0 )
     {
-        SocketBase<SocketComponentsT>::setFd( ::socket( AF_INET, SOCK_STREAM, 0 ) );
+        SocketBase<SocketComponentsT>::setFd( ::socket( AF_INET, SOCK_STREAM | flags, 0 ) );
         if( SocketBase<SocketComponentsT>::getFd() == -1 )
         {
             out << "create socket fd failed, error: " << ::strerror( errno )
                 << ". error no: " << errno << std::endl;
             return false;
         }
-        return true;
+        return SocketBase<SocketComponentsT>::tune();
     }
 
     int accept()
@@ -263,6 +930,27 @@ public:
         return res;
     }
 
+    // accept4(): the new fd comes back with flags already set, no fcntl() after it.
+    // EAGAIN isn't logged, a non blocking listener hits it once the backlog is empty.
+    // Neither is running out of fds or memory, the caller backs off and reports that
+    // once instead of on every retry.
+    int accept4( struct sockaddr_in& clnt_addr, int flags = SOCK_NONBLOCK | SOCK_CLOEXEC )
+    {
+        socklen_t addrSize = sizeof( clnt_addr );
+
+        int res = ::accept4( SocketBase<SocketComponentsT>::getFd(),
+                             reinterpret_cast<struct sockaddr*>( &clnt_addr ),
+                             &addrSize,
+                             flags );
+        if( res == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+            errno != EMFILE && errno != ENFILE && errno != ENOBUFS && errno != ENOMEM )
+        {
+            out << "accept failed, error: " << ::strerror( errno ) << ". error no: " << errno
+                << std::endl;
+        }
+        return res;
+    }
+
     int accept( struct sockaddr_in& clnt_addr )
     {
         static socklen_t addrSize = sizeof( sockaddr_in );
@@ -283,7 +971,8 @@ template<typename SocketComponentsT>
 class UDPSocket : public SocketBase<SocketComponentsT>
 {
 public:
-    constexpr static size_t BUF_SIZE = SocketComponentsT::SOCKET_RECV_BUF_SIZE;
+    // largest UDP payload over IPv4
+    constexpr static size_t MAX_DATAGRAM_SIZE = 65507;
     using OutType = typename SocketComponentsT::OutStreamType;
     constexpr static auto& out = SocketComponentsT::outStream;
 
@@ -316,15 +1005,23 @@ public:
                 return false;
             }
         }
-        return true;
+        return SocketBase<SocketComponentsT>::tune();
     }
 
     ssize_t recvFrom( struct sockaddr_in& recvAddr = SocketBase<SocketComponentsT>::socketAddr() )
     {
         static socklen_t len = sizeof( recvAddr );
-        ssize_t          res = ::recvfrom( SocketBase<SocketComponentsT>::getFd(),
-                                  SocketBase<SocketComponentsT>::buf().data(),
-                                  BUF_SIZE,
+        // one datagram at a time, it replaces whatever the ring held
+        auto& buf = SocketBase<SocketComponentsT>::buf();
+        buf.clear();
+        if( !buf.reserve( MAX_DATAGRAM_SIZE + 1 ) )
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        ssize_t res = ::recvfrom( SocketBase<SocketComponentsT>::getFd(),
+                                  buf.writeHead(),
+                                  MAX_DATAGRAM_SIZE,
                                   0,
                                   (struct sockaddr*)&recvAddr,
                                   &len );
@@ -336,7 +1033,9 @@ public:
         }
         else if( res > 0 )
         {
-            SocketBase<SocketComponentsT>::buf()[res] = 0;
+            // NUL terminated for callers that treat the payload as a string
+            buf.writeHead()[res] = 0;
+            buf.commit( static_cast<size_t>( res ) );
         }
         return res;
     }
@@ -353,13 +1052,26 @@ public:
                                 len );
         return res;
     }
+
+    // recvFrom() for a burst: one recvmmsg() into batch, returns the datagram count
+    int recvBatch( DatagramBatch<SocketComponentsT>& batch )
+    {
+        return SocketBase<SocketComponentsT>::recvDatagrams( batch );
+    }
+
+    // sendTo() for a burst: count datagrams over sendmmsg(), returns how many went out
+    int sendBatch( struct sockaddr_in& sendAddr, const struct iovec* datagrams, int count )
+    {
+        return SocketBase<SocketComponentsT>::sendDatagrams( sendAddr, datagrams, count );
+    }
 };
 
 template<typename SocketComponentsT>
 class MulticastSocket : public SocketBase<SocketComponentsT>
 {
 public:
-    constexpr static size_t BUF_SIZE = SocketComponentsT::SOCKET_RECV_BUF_SIZE;
+    // largest UDP payload over IPv4
+    constexpr static size_t MAX_DATAGRAM_SIZE = 65507;
     using OutType = typename SocketComponentsT::OutStreamType;
     constexpr static auto& out = SocketComponentsT::outStream;
 
@@ -390,7 +1102,7 @@ public:
                 << ". error no: " << std::endl;
             return false;
         }
-        return true;
+        return SocketBase<SocketComponentsT>::tune();
     }
 
     bool joinMulticastGroup()
@@ -444,10 +1156,17 @@ public:
     ssize_t recvFrom( struct sockaddr_in& recvAddr = SocketBase<SocketComponentsT>::socketAddr() )
     {
         static socklen_t len = sizeof( recvAddr );
-
+        // one datagram at a time, it replaces whatever the ring held
+        auto& buf = SocketBase<SocketComponentsT>::buf();
+        buf.clear();
+        if( !buf.reserve( MAX_DATAGRAM_SIZE + 1 ) )
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
         ssize_t res = ::recvfrom( SocketBase<SocketComponentsT>::getFd(),
-                                  SocketBase<SocketComponentsT>::buf().data(),
-                                  BUF_SIZE,
+                                  buf.writeHead(),
+                                  MAX_DATAGRAM_SIZE,
                                   0,
                                   (struct sockaddr*)&recvAddr,
                                   &len );
@@ -459,11 +1178,19 @@ public:
         }
         else if( res > 0 )
         {
-            SocketBase<SocketComponentsT>::buf()[res] = 0;
+            // NUL terminated for callers that treat the payload as a string
+            buf.writeHead()[res] = 0;
+            buf.commit( static_cast<size_t>( res ) );
         }
         return res;
     }
 
+    // recvFrom() for a burst: one recvmmsg() into batch, returns the datagram count
+    int recvBatch( DatagramBatch<SocketComponentsT>& batch )
+    {
+        return SocketBase<SocketComponentsT>::recvDatagrams( batch );
+    }
+
 private:
     const MulticastSocketConfigBase& m_config;
 };
@@ -4,6 +4,8 @@
 #include <string>
 #include <sys/types.h>
 
+#include "recv_buffer.h"
+
 namespace TinyFix {
 
 class DefaultSocketComponents
@@ -11,8 +13,21 @@ class DefaultSocketComponents
 public:
     using OutStreamType = std::ostream;
     constexpr static auto& outStream = std::cout;
-    // 4MB of receive buffer is quite enough
-    constexpr static size_t SOCKET_RECV_BUF_SIZE = 1024 * 1024 * 4;
+    // receive ring sizes, see RecvBuffer
+    using RecvBufferComponents = DefaultRecvBufferComponents;
+    // free space kept ahead of each TCP read, the ring only grows when less is left
+    constexpr static size_t SOCKET_RECV_MIN_FREE = 16 * 1024;
+    // datagrams per recvmmsg / sendmmsg call and the slot each one is received into,
+    // anything longer than a slot is truncated and flagged
+    constexpr static int    DATAGRAM_BATCH_SIZE = 64;
+    constexpr static size_t DATAGRAM_SLOT_SIZE = 2048;
+    // outbound bytes queued between flushes, see SendQueue. The queue grows from the
+    // initial size as a slow peer backs up and gives up past the max.
+    constexpr static size_t SEND_QUEUE_INITIAL_SIZE = 64 * 1024;
+    constexpr static size_t SEND_QUEUE_MAX_SIZE = 16 * 1024 * 1024;
+    // smallest write sendvZeroCopy() sends with MSG_ZEROCOPY, below it pinning the
+    // pages and reading the completion costs more than the copy
+    constexpr static size_t ZEROCOPY_MIN_SIZE = 16 * 1024;
 };
 
 class SocketConfigBase
@@ -26,6 +41,114 @@ public:
     virtual const bool    getNonBlock() const = 0;
     virtual const bool    getReUseAddr() const = 0;
     virtual const int     getBacklog() const = 0;
+    // SO_BUSY_POLL in microseconds, 0 leaves the system default (net.core.busy_read).
+    // raising it above the sysctl needs CAP_NET_ADMIN.
+    virtual const int getBusyPollMicros() const
+    {
+        return 0;
+    }
+    // SO_PREFER_BUSY_POLL, only meaningful with getBusyPollMicros() > 0
+    virtual const bool getPreferBusyPoll() const
+    {
+        return false;
+    }
+    // SO_RCVBUF / SO_SNDBUF in bytes, 0 leaves the system default. The kernel clamps
+    // them to net.core.rmem_max / wmem_max unless the process has CAP_NET_ADMIN.
+    virtual const int getRecvBufSize() const
+    {
+        return 0;
+    }
+    virtual const int getSendBufSize() const
+    {
+        return 0;
+    }
+    // TCP_QUICKACK, acks inbound data at once instead of delaying them; the kernel
+    // drops it again on its own so TCP sockets re-arm it after every recv()
+    virtual const bool getQuickAck() const
+    {
+        return false;
+    }
+    // IP_TOS byte (DSCP << 2), -1 leaves it alone
+    virtual const int getTos() const
+    {
+        return -1;
+    }
+    // SO_INCOMING_CPU, -1 leaves it alone. On an SO_REUSEPORT listener it steers
+    // connections that arrive on that CPU's queue to this listener.
+    virtual const int getIncomingCpu() const
+    {
+        return -1;
+    }
+    // SO_ZEROCOPY on TCP sockets, large writes through sendvZeroCopy() then go out
+    // of the sender's pages instead of a copy, see SocketBase::reapZeroCopy()
+    virtual const bool getZeroCopy() const
+    {
+        return false;
+    }
+};
+
+// One option of the tuning profile: what the config asked for and what getsockopt()
+// read back after setting it.
+struct SocketOptionReport
+{
+    bool requested = false;
+    bool applied = false;  // setsockopt() succeeded
+    bool verified = false; // the value read back is the one asked for
+    int  wanted = 0;
+    int  actual = 0;
+};
+
+// What SocketBase::tune() did with each option, options the socket type has no use
+// for (TCP ones on UDP) stay unrequested
+struct SocketTuningReport
+{
+    SocketOptionReport noDelay;
+    SocketOptionReport quickAck;
+    SocketOptionReport recvBuf;
+    SocketOptionReport sendBuf;
+    SocketOptionReport busyPoll;
+    SocketOptionReport preferBusyPoll;
+    SocketOptionReport tos;
+    SocketOptionReport incomingCpu;
+    SocketOptionReport zeroCopy;
+
+    // every requested option was set and reads back as asked
+    bool ok() const
+    {
+        bool res = true;
+        forEach( [&res]( const char*, const SocketOptionReport& option ) {
+            res = res && ( !option.requested || option.verified );
+        } );
+        return res;
+    }
+
+    template<typename OutT>
+    void print( OutT& out ) const
+    {
+        forEach( [&out]( const char* name, const SocketOptionReport& option ) {
+            if( option.requested )
+            {
+                out << name << ": wanted " << option.wanted << ", got " << option.actual
+                    << ( option.verified ? "" : option.applied ? " (adjusted)" : " (failed)" )
+                    << std::endl;
+            }
+        } );
+    }
+
+private:
+    template<typename Fn>
+    void forEach( Fn&& fn ) const
+    {
+        fn( "TCP_NODELAY", noDelay );
+        fn( "TCP_QUICKACK", quickAck );
+        fn( "SO_RCVBUF", recvBuf );
+        fn( "SO_SNDBUF", sendBuf );
+        fn( "SO_BUSY_POLL", busyPoll );
+        fn( "SO_PREFER_BUSY_POLL", preferBusyPoll );
+        fn( "IP_TOS", tos );
+        fn( "SO_INCOMING_CPU", incomingCpu );
+        fn( "SO_ZEROCOPY", zeroCopy );
+    }
 };
 
 class MulticastSocketConfigBase : public SocketConfigBase
@@ -47,13 +170,29 @@ public:
                          bool   noDelay = false,
                          bool   nonBlock = false,
                          bool   reUseAddr = false,
-                         int    backlog = 4 )
+                         int    backlog = 4,
+                         int    busyPollMicros = 0,
+                         bool   preferBusyPoll = false,
+                         int    recvBufSize = 0,
+                         int    sendBufSize = 0,
+                         bool   quickAck = false,
+                         int    tos = -1,
+                         int    incomingCpu = -1,
+                         bool   zeroCopy = false )
         : m_port( port )
         , m_ip( ip )
         , m_noDelay( noDelay )
         , m_nonBlock( nonBlock )
         , m_reUseAddr( reUseAddr )
         , m_backlog( backlog )
+        , m_busyPollMicros( busyPollMicros )
+        , m_preferBusyPoll( preferBusyPoll )
+        , m_recvBufSize( recvBufSize )
+        , m_sendBufSize( sendBufSize )
+        , m_quickAck( quickAck )
+        , m_tos( tos )
+        , m_incomingCpu( incomingCpu )
+        , m_zeroCopy( zeroCopy )
     {
     }
 
@@ -85,6 +224,38 @@ public:
     {
         return m_backlog;
     }
+    virtual const int getBusyPollMicros() const
+    {
+        return m_busyPollMicros;
+    }
+    virtual const bool getPreferBusyPoll() const
+    {
+        return m_preferBusyPoll;
+    }
+    virtual const int getRecvBufSize() const
+    {
+        return m_recvBufSize;
+    }
+    virtual const int getSendBufSize() const
+    {
+        return m_sendBufSize;
+    }
+    virtual const bool getQuickAck() const
+    {
+        return m_quickAck;
+    }
+    virtual const int getTos() const
+    {
+        return m_tos;
+    }
+    virtual const int getIncomingCpu() const
+    {
+        return m_incomingCpu;
+    }
+    virtual const bool getZeroCopy() const
+    {
+        return m_zeroCopy;
+    }
 
 private:
     const int    m_port;
@@ -93,6 +264,14 @@ private:
     const bool   m_nonBlock;
     const bool   m_reUseAddr;
     const int    m_backlog;
+    const int    m_busyPollMicros;
+    const bool   m_preferBusyPoll;
+    const int    m_recvBufSize;
+    const int    m_sendBufSize;
+    const bool   m_quickAck;
+    const int    m_tos;
+    const int    m_incomingCpu;
+    const bool   m_zeroCopy;
 };
 
 class DefaultMulticastSocketConfig : public MulticastSocketConfigBase
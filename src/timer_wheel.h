@@ -0,0 +1,247 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "timer_wheel_misc.h"
+
+namespace TinyFix {
+
+// Hierarchical timing wheel, O(1) schedule, cancel and touch.
+// Thousands of session timers (heartbeat, TestRequest, logon timeout) share one
+// timerfd ticking at TICK_MICROS; attach() registers it with an Epoller so the wheel
+// advances from the same loop that does the I/O. Nodes are embedded in their owners,
+// the wheel never allocates after construction.
+template<typename TimerWheelComponents = DefaultTimerWheelComponents>
+class TimerWheel
+{
+public:
+    constexpr static int TICK_MICROS = TimerWheelComponents::TICK_MICROS;
+    constexpr static int SLOT_BITS = TimerWheelComponents::SLOT_BITS;
+    constexpr static int NUM_LEVELS = TimerWheelComponents::NUM_LEVELS;
+    constexpr static int NUM_SLOTS = 1 << SLOT_BITS;
+    constexpr static uint64_t SLOT_MASK = NUM_SLOTS - 1;
+    constexpr static uint64_t MAX_TICKS = ( uint64_t( 1 ) << ( SLOT_BITS * NUM_LEVELS ) ) - 1;
+    using TimerCallback = typename TimerWheelComponents::TimerCallback;
+    using OutType = typename TimerWheelComponents::OutStreamType;
+    constexpr static auto& out = TimerWheelComponents::outStream;
+    using Node = TimerNode<TimerCallback>;
+    using Clock = std::chrono::steady_clock;
+
+    TimerWheel( TimerWheel& ) = delete;
+    TimerWheel& operator=( TimerWheel& ) = delete;
+
+    TimerWheel()
+        : m_timerFd( -1 )
+        , m_currentTick( 0 )
+        , m_start( Clock::now() )
+        , m_count( 0 )
+    {
+        for( auto& level : m_slots )
+        {
+            for( auto& slot : level )
+            {
+                slot.prev = &slot;
+                slot.next = &slot;
+            }
+        }
+    }
+
+    virtual ~TimerWheel()
+    {
+        if( m_timerFd != -1 )
+        {
+            ::close( m_timerFd );
+        }
+    }
+
+    // creates the tick timerfd and registers it, the wheel then advances on its own
+    template<typename EpollerT>
+    bool attach( EpollerT& epoller )
+    {
+        m_timerFd = ::timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+        if( m_timerFd == -1 )
+        {
+            out << "timerfd_create failed: " << ::strerror( errno ) << ". (errno: " << errno << ")"
+                << std::endl;
+            return false;
+        }
+        struct itimerspec spec;
+        spec.it_interval.tv_sec = TICK_MICROS / 1000000;
+        spec.it_interval.tv_nsec = ( TICK_MICROS % 1000000 ) * 1000;
+        spec.it_value = spec.it_interval;
+        if( ::timerfd_settime( m_timerFd, 0, &spec, nullptr ) == -1 )
+        {
+            out << "timerfd_settime failed: " << ::strerror( errno ) << ". (errno: " << errno
+                << ")" << std::endl;
+            return false;
+        }
+        return epoller.addEvent( m_timerFd, [this]() { onTimerFd(); } );
+    }
+
+    int getTimerFd() const
+    {
+        return m_timerFd;
+    }
+
+    // timerfd readable: catch the wheel up with the clock
+    void onTimerFd()
+    {
+        uint64_t expirations;
+        while( ::read( m_timerFd, &expirations, sizeof( expirations ) ) > 0 )
+        {
+        }
+        advanceTo( clockTick() );
+    }
+
+    // ticks elapsed since construction according to the monotonic clock
+    uint64_t clockTick() const
+    {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>( Clock::now() - m_start )
+                .count() /
+            TICK_MICROS );
+    }
+
+    uint64_t currentTick() const
+    {
+        return m_currentTick;
+    }
+
+    static uint64_t millisToTicks( uint64_t millis )
+    {
+        // round up; timers still fire up to one tick early against wall time since the
+        // wheel counts whole ticks
+        return ( millis * 1000 + TICK_MICROS - 1 ) / TICK_MICROS;
+    }
+
+    size_t size() const
+    {
+        return m_count;
+    }
+
+    // (re)arms node to fire delayMillis from now
+    void schedule( Node& node, uint64_t delayMillis )
+    {
+        if( node.linked() )
+        {
+            node.unlink();
+            m_count--;
+        }
+        node.deadline = m_currentTick + std::max<uint64_t>( millisToTicks( delayMillis ), 1 );
+        insert( node, node.deadline );
+    }
+
+    // Pushes the deadline of a running timer out to delayMillis from now without
+    // touching the wheel, for resetting e.g. a Passive heartbeat on every send.
+    // The node is moved when its current slot comes up. An unarmed node is scheduled.
+    void touch( Node& node, uint64_t delayMillis )
+    {
+        uint64_t deadline = m_currentTick + std::max<uint64_t>( millisToTicks( delayMillis ), 1 );
+        if( !node.linked() || deadline < node.expiry )
+        {
+            schedule( node, delayMillis );
+            return;
+        }
+        node.deadline = deadline;
+    }
+
+    void cancel( Node& node )
+    {
+        if( node.linked() )
+        {
+            node.unlink();
+            m_count--;
+        }
+    }
+
+    // fires everything due up to and including tick
+    void advanceTo( uint64_t tick )
+    {
+        while( m_currentTick < tick )
+        {
+            m_currentTick++;
+            cascade();
+            expire( m_slots[0][m_currentTick & SLOT_MASK] );
+        }
+    }
+
+private:
+    void insert( Node& node, uint64_t expiry )
+    {
+        uint64_t delta = expiry - m_currentTick;
+        if( delta > MAX_TICKS )
+        {
+            delta = MAX_TICKS;
+            expiry = m_currentTick + MAX_TICKS;
+        }
+        int level = 0;
+        while( level < NUM_LEVELS - 1 && delta >= ( uint64_t( 1 ) << ( SLOT_BITS * ( level + 1 ) ) ) )
+        {
+            level++;
+        }
+        node.expiry = expiry;
+        TimerLink& head = m_slots[level][( expiry >> ( SLOT_BITS * level ) ) & SLOT_MASK];
+        node.prev = head.prev;
+        node.next = &head;
+        head.prev->next = &node;
+        head.prev = &node;
+        m_count++;
+    }
+
+    // a level's slot is redistributed into the levels below each time the level
+    // below wraps around
+    void cascade()
+    {
+        for( int level = 1; level < NUM_LEVELS; level++ )
+        {
+            if( ( m_currentTick & ( ( uint64_t( 1 ) << ( SLOT_BITS * level ) ) - 1 ) ) != 0 )
+            {
+                break;
+            }
+            TimerLink& head = m_slots[level][( m_currentTick >> ( SLOT_BITS * level ) ) & SLOT_MASK];
+            while( head.next != &head )
+            {
+                Node& node = static_cast<Node&>( *head.next );
+                node.unlink();
+                m_count--;
+                insert( node, node.expiry );
+            }
+        }
+    }
+
+    void expire( TimerLink& head )
+    {
+        // callbacks may schedule or cancel any timer, including the ones still in this
+        // slot, so always take the current first node
+        while( head.next != &head )
+        {
+            Node& node = static_cast<Node&>( *head.next );
+            node.unlink();
+            m_count--;
+            if( node.deadline > m_currentTick )
+            {
+                insert( node, node.deadline );
+                continue;
+            }
+            node.callback();
+        }
+    }
+
+    using Level = std::array<TimerLink, NUM_SLOTS>;
+
+    int                           m_timerFd;
+    uint64_t                      m_currentTick;
+    Clock::time_point             m_start;
+    size_t                        m_count;
+    std::array<Level, NUM_LEVELS> m_slots;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <iostream>
+#include <functional>
+#include <stdint.h>
+
+namespace TinyFix {
+
+class DefaultTimerWheelComponents
+{
+public:
+    // resolution of the wheel, heartbeats and logon timeouts are in seconds so 10ms is plenty
+    constexpr static int   TICK_MICROS = 10 * 1000;
+    // 4 levels of 64 slots cover 2^24 ticks, ~46 hours at 10ms; longer timers are
+    // parked at the far end and re-inserted when they get there
+    constexpr static int   SLOT_BITS = 6;
+    constexpr static int   NUM_LEVELS = 4;
+    constexpr static auto& outStream = std::cout;
+    using OutStreamType = std::ostream;
+    using TimerCallback = std::function<void( void )>;
+};
+
+// intrusive list hook, the owner of a timer embeds the node so scheduling never allocates
+struct TimerLink
+{
+    TimerLink* prev = nullptr;
+    TimerLink* next = nullptr;
+
+    bool linked() const
+    {
+        return prev != nullptr;
+    }
+
+    void unlink()
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = nullptr;
+        next = nullptr;
+    }
+};
+
+template<typename TimerCallback>
+struct TimerNode : public TimerLink
+{
+    // tick of the slot the node sits in
+    uint64_t expiry = 0;
+    // tick the timer really fires at; touch() only moves this, the node is
+    // re-inserted lazily when its slot comes up
+    uint64_t deadline = 0;
+
+    TimerCallback callback;
+};
+
+} // namespace TinyFix
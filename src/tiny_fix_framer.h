@@ -0,0 +1,243 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "tiny_fix_utils.h"
+
+namespace TinyFix {
+
+struct DefaultTinyFixFramerComponents
+{
+    // frames handed back by one frame() call
+    static constexpr uint16_t MAX_BATCH = 64;
+    // a BodyLength above this is treated as garbage rather than waited for
+    static constexpr uint32_t MAX_BODY_LENGTH = 1024 * 1024;
+    static constexpr bool     VALIDATE_CHECKSUM = true;
+};
+
+struct TinyFixFrame
+{
+    const char* data; // points at "8="
+    uint32_t    size; // up to and including the trailer's SOH
+};
+
+// Splits a byte stream into complete FIX messages.
+// Only the header is scanned: BodyLength(9) is used to jump straight to the
+// "10=xxx<SOH>" trailer. Bytes that do not start a message are skipped until the
+// next "8=FIX", and messages whose CheckSum does not match are dropped, as the
+// spec asks for garbled messages.
+template<typename TinyFixFramerComponentsT = DefaultTinyFixFramerComponents>
+class TinyFixFramer
+{
+public:
+    static constexpr uint16_t MAX_BATCH = TinyFixFramerComponentsT::MAX_BATCH;
+    static constexpr uint32_t MAX_BODY_LENGTH = TinyFixFramerComponentsT::MAX_BODY_LENGTH;
+    static constexpr bool     VALIDATE_CHECKSUM = TinyFixFramerComponentsT::VALIDATE_CHECKSUM;
+    // "10=xxx<SOH>"
+    static constexpr size_t TRAILER_SIZE = 7;
+
+    TinyFixFramer()
+        : frame_count_( 0 )
+        , garbage_bytes_( 0 )
+        , checksum_errors_( 0 )
+    {
+    }
+
+    TinyFixFramer( const TinyFixFramer& ) = delete;
+    TinyFixFramer& operator=( const TinyFixFramer& ) = delete;
+
+    // Frames as many complete messages from [data, data + len) as fit in one batch
+    // and returns the number of bytes consumed. Bytes past that are either a partial
+    // message, to be carried into the next read, or the rest of a stream that filled
+    // the batch, in which case frame() should be called again on them.
+    size_t frame( const char* data, size_t len )
+    {
+        frame_count_ = 0;
+        size_t pos = 0;
+        while( frame_count_ < MAX_BATCH && pos < len )
+        {
+            size_t msg_size = 0;
+            Status status = check_message( data + pos, len - pos, msg_size );
+            if( status == Status::Incomplete )
+            {
+                break;
+            }
+            if( status == Status::Garbage )
+            {
+                pos += resync( data + pos, len - pos );
+                continue;
+            }
+            if( status == Status::Complete )
+            {
+                frames_[frame_count_].data = data + pos;
+                frames_[frame_count_].size = static_cast<uint32_t>( msg_size );
+                frame_count_++;
+            }
+            pos += msg_size;
+        }
+        return pos;
+    }
+
+    uint16_t frame_count() const
+    {
+        return frame_count_;
+    }
+
+    const TinyFixFrame& frame_at( uint16_t i ) const
+    {
+        return frames_[i];
+    }
+
+    const TinyFixFrame* begin() const
+    {
+        return frames_;
+    }
+
+    const TinyFixFrame* end() const
+    {
+        return frames_ + frame_count_;
+    }
+
+    uint64_t garbage_bytes() const
+    {
+        return garbage_bytes_;
+    }
+
+    uint64_t checksum_errors() const
+    {
+        return checksum_errors_;
+    }
+
+    // moves the unconsumed tail to the front of buf and returns its length, so the
+    // next read can be appended right after it
+    static size_t carry_tail( char* buf, size_t len, size_t consumed )
+    {
+        size_t tail = len - consumed;
+        if( tail != 0 && consumed != 0 )
+        {
+            ::memmove( buf, buf + consumed, tail );
+        }
+        return tail;
+    }
+
+private:
+    enum class Status : uint8_t
+    {
+        Complete,
+        Incomplete,
+        Garbage,
+        BadChecksum,
+    };
+
+    Status check_message( const char* p, size_t len, size_t& msg_size )
+    {
+        // "8=" BeginString SOH
+        if( len < 2 )
+        {
+            return ::memcmp( p, "8=", len ) == 0 ? Status::Incomplete : Status::Garbage;
+        }
+        if( p[0] != '8' || p[1] != '=' )
+        {
+            return Status::Garbage;
+        }
+        // BeginString is "FIX.4.x" or "FIXT.1.1", never anywhere near 32 bytes
+        size_t      scan_len = len < 32 ? len : 32;
+        const char* soh = findByte( p + 2, p + scan_len, SOH );
+        if( soh == p + scan_len )
+        {
+            return scan_len == len ? Status::Incomplete : Status::Garbage;
+        }
+
+        // "9=" BodyLength SOH
+        const char* end = p + len;
+        const char* q = soh + 1;
+        if( end - q < 2 )
+        {
+            return ::memcmp( q, "9=", end - q ) == 0 ? Status::Incomplete : Status::Garbage;
+        }
+        if( q[0] != '9' || q[1] != '=' )
+        {
+            return Status::Garbage;
+        }
+        q += 2;
+        uint32_t body_len = 0;
+        size_t   digits = 0;
+        for( ; q < end && *q != SOH; q++, digits++ )
+        {
+            uint8_t digit = static_cast<uint8_t>( *q - '0' );
+            if( digit > 9 || digits == 7 )
+            {
+                return Status::Garbage;
+            }
+            body_len = body_len * 10 + digit;
+        }
+        if( q == end )
+        {
+            return Status::Incomplete;
+        }
+        if( digits == 0 || body_len > MAX_BODY_LENGTH )
+        {
+            return Status::Garbage;
+        }
+
+        const char* trailer = q + 1 + body_len;
+        if( end - trailer < static_cast<ptrdiff_t>( TRAILER_SIZE ) )
+        {
+            return Status::Incomplete;
+        }
+        if( trailer[-1] != SOH || trailer[0] != '1' || trailer[1] != '0' || trailer[2] != '=' ||
+            trailer[6] != SOH )
+        {
+            return Status::Garbage;
+        }
+        msg_size = static_cast<size_t>( trailer - p ) + TRAILER_SIZE;
+
+        if( VALIDATE_CHECKSUM )
+        {
+            uint8_t d0 = static_cast<uint8_t>( trailer[3] - '0' );
+            uint8_t d1 = static_cast<uint8_t>( trailer[4] - '0' );
+            uint8_t d2 = static_cast<uint8_t>( trailer[5] - '0' );
+            if( d0 > 9 || d1 > 9 || d2 > 9 ||
+                static_cast<uint32_t>( d0 * 100 + d1 * 10 + d2 ) !=
+                    ( byteSum( p, static_cast<size_t>( trailer - p ) ) & 0xFF ) )
+            {
+                checksum_errors_++;
+                return Status::BadChecksum;
+            }
+        }
+        return Status::Complete;
+    }
+
+    // skips to the next "8=FIX" after p, keeping a partial "8=FIX" at the very end
+    size_t resync( const char* p, size_t len )
+    {
+        static constexpr char   BEGIN[] = "8=FIX";
+        static constexpr size_t BEGIN_LEN = sizeof( BEGIN ) - 1;
+
+        const void* next = len > 1 ? ::memmem( p + 1, len - 1, BEGIN, BEGIN_LEN ) : nullptr;
+        size_t      skip;
+        if( next != nullptr )
+        {
+            skip = static_cast<size_t>( static_cast<const char*>( next ) - p );
+        }
+        else
+        {
+            skip = len > BEGIN_LEN ? len - BEGIN_LEN + 1 : 1;
+            while( skip < len && ::memcmp( p + skip, BEGIN, len - skip ) != 0 )
+            {
+                skip++;
+            }
+        }
+        garbage_bytes_ += skip;
+        return skip;
+    }
+
+    TinyFixFrame frames_[MAX_BATCH];
+    uint16_t     frame_count_;
+    uint64_t     garbage_bytes_;
+    uint64_t     checksum_errors_;
+};
+
+} // namespace TinyFix
@@ -1,7 +1,14 @@
+#pragma once
+
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "tiny_fix_utils.h"
+
 namespace TinyFix {
 
 enum class HeatBeatStyle : uint8_t
@@ -15,21 +22,38 @@ enum class HeatBeatStyle : uint8_t
 
 struct DefaultTinyFixMsgComponents
 {
-    bool FIELD_IN_ORDER = true;
-    uint16_t DEFAULT_ALLOC_SIZE = 128;
+    static constexpr bool     FIELD_IN_ORDER = true;
+    static constexpr uint16_t DEFAULT_ALLOC_SIZE = 512;
+    static constexpr std::string_view BEGIN_STRING = "FIX.4.4";
 };
 
-template<typename TinyFixMsgComponentsT>
+// Encoder that writes a FIX message straight into one memory block.
+// The block starts with HEADER_RESERVE bytes kept free for "8=...<SOH>9=...<SOH>",
+// the body is appended after them, and gen_tail() back-patches the header right
+// aligned against the body, so the message is contiguous without moving the body.
+// The CheckSum is accumulated as fields are appended, while they are still hot in
+// cache, so gen_tail() only sums the few header bytes.
+// Messages are limited to 64KB, appends that do not fit fail and leave the message
+// unchanged.
+template<typename TinyFixMsgComponentsT = DefaultTinyFixMsgComponents>
 class TinyFixMsgBase
 {
 public:
     static constexpr bool FIELD_IN_ORDER = TinyFixMsgComponentsT::FIELD_IN_ORDER;
     static constexpr uint16_t DEFAULT_ALLOC_SIZE = TinyFixMsgComponentsT::DEFAULT_ALLOC_SIZE;
+    static constexpr std::string_view BEGIN_STRING = TinyFixMsgComponentsT::BEGIN_STRING;
+    // "8=" BEGIN_STRING SOH "9=" up to 5 digits SOH
+    static constexpr uint16_t HEADER_RESERVE = 2 + BEGIN_STRING.size() + 1 + 2 + 5 + 1;
+    // "10=xxx" SOH
+    static constexpr uint16_t TRAILER_SIZE = 7;
 
     TinyFixMsgBase();
     TinyFixMsgBase( size_t size );
     TinyFixMsgBase( char* memblk, size_t size );
 
+    TinyFixMsgBase( const TinyFixMsgBase& ) = delete;
+    TinyFixMsgBase& operator=( const TinyFixMsgBase& ) = delete;
+
     // Quickfix Compatible Methods
     [[deprecated]]
     void setField( int field, const std::string& str );
@@ -40,31 +64,433 @@ public:
 
     // Zero Copy Style Interface
     char* get_write_head();
+    // commits size bytes written at the write head
     void advance(size_t size);
+    // write head if size more bytes fit in the block, nullptr otherwise
     char* reserve_block(size_t size);
 
+    bool add_field( uint32_t tag, std::string_view value );
+    bool add_int( uint32_t tag, int64_t value );
+    bool add_char( uint32_t tag, char value );
+    // mantissa * 10^-scale, e.g. price 101.25 as (10125, 2).
+    // returns false if scale exceeds MAX_DECIMAL_SCALE.
+    bool add_decimal( uint32_t tag, int64_t mantissa, uint8_t scale );
+
+    // writes BeginString, BodyLength and CheckSum, the message is ready to send after this
     void gen_tail();
+    const char* get_msg_data();
     size_t get_msg_size();
 
+    // drops the body so the block can be reused for the next message
+    void reset();
+
 private:
+    // tag digits and '=' at the write head, returns the chars written
+    size_t write_tag( char* p, uint32_t tag );
+    void commit( char* end );
+
     std::unique_ptr<char[]> memblk_;
     char* const data_;
     uint16_t data_len_;
     uint16_t tail_pos_;
+    uint16_t head_pos_;
+    uint32_t body_sum_;
 };
 
 template<typename TinyFixMsgComponentsT>
 TinyFixMsgBase<TinyFixMsgComponentsT>::TinyFixMsgBase()
-: memblk_
+    : TinyFixMsgBase( DEFAULT_ALLOC_SIZE )
 {}
 
 template<typename TinyFixMsgComponentsT>
 TinyFixMsgBase<TinyFixMsgComponentsT>::TinyFixMsgBase(size_t size )
+    : memblk_( new char[size < UINT16_MAX ? size : UINT16_MAX] )
+    , data_( memblk_.get() )
+    , data_len_( static_cast<uint16_t>( size < UINT16_MAX ? size : UINT16_MAX ) )
+    , tail_pos_( HEADER_RESERVE )
+    , head_pos_( HEADER_RESERVE )
+    , body_sum_( 0 )
 {}
 
 template<typename TinyFixMsgComponentsT>
 TinyFixMsgBase<TinyFixMsgComponentsT>::TinyFixMsgBase(char* memblk, size_t size)
+    : data_( memblk )
+    , data_len_( static_cast<uint16_t>( size < UINT16_MAX ? size : UINT16_MAX ) )
+    , tail_pos_( HEADER_RESERVE )
+    , head_pos_( HEADER_RESERVE )
+    , body_sum_( 0 )
 {}
 
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::setField( int field, const std::string& str )
+{
+    add_field( static_cast<uint32_t>( field ), std::string_view( str ) );
+}
+
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::setField( int field, std::string_view str )
+{
+    add_field( static_cast<uint32_t>( field ), str );
+}
+
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::setField( int field, const char* str, size_t strlen )
+{
+    add_field( static_cast<uint32_t>( field ), std::string_view( str, strlen ) );
+}
+
+template<typename TinyFixMsgComponentsT>
+char* TinyFixMsgBase<TinyFixMsgComponentsT>::get_write_head()
+{
+    return data_ + tail_pos_;
+}
+
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::advance( size_t size )
+{
+    commit( data_ + tail_pos_ + size );
+}
+
+template<typename TinyFixMsgComponentsT>
+char* TinyFixMsgBase<TinyFixMsgComponentsT>::reserve_block( size_t size )
+{
+    if( static_cast<size_t>( tail_pos_ ) + size + TRAILER_SIZE > data_len_ )
+    {
+        return nullptr;
+    }
+    return data_ + tail_pos_;
+}
+
+template<typename TinyFixMsgComponentsT>
+bool TinyFixMsgBase<TinyFixMsgComponentsT>::add_field( uint32_t tag, std::string_view value )
+{
+    // 10 chars cover any uint32_t tag plus '='
+    char* p = reserve_block( 11 + value.size() + 1 );
+    if( p == nullptr )
+    {
+        return false;
+    }
+    p += write_tag( p, tag );
+    ::memcpy( p, value.data(), value.size() );
+    p += value.size();
+    *p++ = SOH;
+    commit( p );
+    return true;
+}
+
+template<typename TinyFixMsgComponentsT>
+bool TinyFixMsgBase<TinyFixMsgComponentsT>::add_int( uint32_t tag, int64_t value )
+{
+    char* p = reserve_block( 11 + 20 + 1 );
+    if( p == nullptr )
+    {
+        return false;
+    }
+    p += write_tag( p, tag );
+    p += formatInt( p, value );
+    *p++ = SOH;
+    commit( p );
+    return true;
+}
+
+template<typename TinyFixMsgComponentsT>
+bool TinyFixMsgBase<TinyFixMsgComponentsT>::add_char( uint32_t tag, char value )
+{
+    char* p = reserve_block( 11 + 1 + 1 );
+    if( p == nullptr )
+    {
+        return false;
+    }
+    p += write_tag( p, tag );
+    *p++ = value;
+    *p++ = SOH;
+    commit( p );
+    return true;
+}
+
+template<typename TinyFixMsgComponentsT>
+bool TinyFixMsgBase<TinyFixMsgComponentsT>::add_decimal( uint32_t tag,
+                                                         int64_t  mantissa,
+                                                         uint8_t  scale )
+{
+    if( scale > MAX_DECIMAL_SCALE )
+    {
+        return false;
+    }
+    // sign, 20 digits, a leading "0." and up to MAX_DECIMAL_SCALE fraction digits
+    char* p = reserve_block( 11 + 1 + 20 + 2 + scale + 1 );
+    if( p == nullptr )
+    {
+        return false;
+    }
+    p += write_tag( p, tag );
+    p += formatDecimal( p, mantissa, scale );
+    *p++ = SOH;
+    commit( p );
+    return true;
+}
+
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::gen_tail()
+{
+    uint16_t body_len = tail_pos_ - HEADER_RESERVE;
+    size_t   len_digits = countDigits( body_len );
+    size_t   prefix_len = 2 + BEGIN_STRING.size() + 1 + 2 + len_digits + 1;
+
+    head_pos_ = static_cast<uint16_t>( HEADER_RESERVE - prefix_len );
+    char* p = data_ + head_pos_;
+    *p++ = '8';
+    *p++ = '=';
+    ::memcpy( p, BEGIN_STRING.data(), BEGIN_STRING.size() );
+    p += BEGIN_STRING.size();
+    *p++ = SOH;
+    *p++ = '9';
+    *p++ = '=';
+    formatUIntFixed( p, body_len, len_digits );
+    p += len_digits;
+    *p++ = SOH;
+
+    uint32_t checksum = ( body_sum_ + byteSum( data_ + head_pos_, prefix_len ) ) & 0xFF;
+    p = data_ + tail_pos_;
+    *p++ = '1';
+    *p++ = '0';
+    *p++ = '=';
+    formatUIntFixed( p, checksum, 3 );
+    p[3] = SOH;
+}
+
+template<typename TinyFixMsgComponentsT>
+const char* TinyFixMsgBase<TinyFixMsgComponentsT>::get_msg_data()
+{
+    return data_ + head_pos_;
+}
+
+template<typename TinyFixMsgComponentsT>
+size_t TinyFixMsgBase<TinyFixMsgComponentsT>::get_msg_size()
+{
+    return static_cast<size_t>( tail_pos_ ) + TRAILER_SIZE - head_pos_;
+}
+
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::reset()
+{
+    tail_pos_ = HEADER_RESERVE;
+    head_pos_ = HEADER_RESERVE;
+    body_sum_ = 0;
+}
+
+template<typename TinyFixMsgComponentsT>
+size_t TinyFixMsgBase<TinyFixMsgComponentsT>::write_tag( char* p, uint32_t tag )
+{
+    size_t len = formatUInt( p, tag );
+    p[len] = '=';
+    return len + 1;
+}
+
+template<typename TinyFixMsgComponentsT>
+void TinyFixMsgBase<TinyFixMsgComponentsT>::commit( char* end )
+{
+    char* begin = data_ + tail_pos_;
+    body_sum_ += byteSum( begin, static_cast<size_t>( end - begin ) );
+    tail_pos_ = static_cast<uint16_t>( end - data_ );
+}
+
+struct DefaultTinyFixMsgViewComponents
+{
+    // fields beyond this count make parse() fail
+    static constexpr uint16_t MAX_FIELDS = 256;
+    // tags below this are looked up through a flat array, others by a linear scan
+    static constexpr uint16_t DIRECT_INDEX_SIZE = 1024;
+};
+
+struct TinyFixFieldRef
+{
+    uint32_t tag;
+    uint32_t offset; // value offset from the start of the message
+    uint32_t length;
+};
+
+// Read-only view over a received FIX message. Nothing is copied: parse() records
+// (tag, offset, length) for every field and all accessors hand out views into the
+// original buffer, so the buffer must outlive the view's use of it.
+// Repeated tags (repeating groups) are reachable through field(); the tag lookups
+// return the first occurrence.
+template<typename TinyFixMsgViewComponentsT = DefaultTinyFixMsgViewComponents>
+class TinyFixMsgView
+{
+public:
+    static constexpr uint16_t MAX_FIELDS = TinyFixMsgViewComponentsT::MAX_FIELDS;
+    static constexpr uint16_t DIRECT_INDEX_SIZE = TinyFixMsgViewComponentsT::DIRECT_INDEX_SIZE;
+
+    TinyFixMsgView()
+        : data_( nullptr )
+        , data_len_( 0 )
+        , field_count_( 0 )
+    {
+        ::memset( index_, 0, sizeof( index_ ) );
+    }
+
+    TinyFixMsgView( const TinyFixMsgView& ) = delete;
+    TinyFixMsgView& operator=( const TinyFixMsgView& ) = delete;
+
+    // data must hold whole fields, each terminated by SOH
+    bool parse( const char* data, size_t len )
+    {
+        clear();
+        data_ = data;
+        data_len_ = len;
+
+        size_t field_start = 0;
+        for( size_t block = 0; block < len; block += 32 )
+        {
+            uint32_t soh_mask = byteMask32( data + block, len - block, SOH );
+            while( soh_mask != 0 )
+            {
+                size_t field_end = block + __builtin_ctz( soh_mask );
+                soh_mask &= soh_mask - 1;
+                if( !add_field( field_start, field_end ) )
+                {
+                    return false;
+                }
+                field_start = field_end + 1;
+            }
+        }
+        return field_start == len && field_count_ > 0;
+    }
+
+    void clear()
+    {
+        // only the slots we touched are dirty, cheaper than wiping the whole index
+        for( uint16_t i = 0; i < field_count_; i++ )
+        {
+            if( fields_[i].tag < DIRECT_INDEX_SIZE )
+            {
+                index_[fields_[i].tag] = 0;
+            }
+        }
+        field_count_ = 0;
+    }
+
+    bool has( uint32_t tag ) const
+    {
+        return find( tag ) != nullptr;
+    }
+
+    std::string_view get_string( uint32_t tag ) const
+    {
+        const TinyFixFieldRef* field = find( tag );
+        if( field == nullptr )
+        {
+            return std::string_view();
+        }
+        return std::string_view( data_ + field->offset, field->length );
+    }
+
+    bool get_int( uint32_t tag, int64_t& value ) const
+    {
+        const TinyFixFieldRef* field = find( tag );
+        return field != nullptr && parseInt( data_ + field->offset, field->length, value );
+    }
+
+    bool get_char( uint32_t tag, char& value ) const
+    {
+        const TinyFixFieldRef* field = find( tag );
+        if( field == nullptr || field->length != 1 )
+        {
+            return false;
+        }
+        value = data_[field->offset];
+        return true;
+    }
+
+    std::string_view get_msg_type() const
+    {
+        return get_string( 35 );
+    }
+
+    uint16_t field_count() const
+    {
+        return field_count_;
+    }
+
+    const TinyFixFieldRef& field( uint16_t i ) const
+    {
+        return fields_[i];
+    }
+
+    std::string_view value( uint16_t i ) const
+    {
+        return std::string_view( data_ + fields_[i].offset, fields_[i].length );
+    }
+
+    const char* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return data_len_;
+    }
+
+private:
+    bool add_field( size_t start, size_t end )
+    {
+        if( field_count_ == MAX_FIELDS )
+        {
+            return false;
+        }
+        // tags are short, walking the digits also finds the '='; ten digits can pass
+        // UINT32_MAX, so they add up in 64 bits and a wrapped tag is refused
+        uint64_t tag = 0;
+        size_t   pos = start;
+        for( ; pos < end && pos - start < 10; pos++ )
+        {
+            uint8_t digit = static_cast<uint8_t>( data_[pos] - '0' );
+            if( digit > 9 )
+            {
+                break;
+            }
+            tag = tag * 10 + digit;
+        }
+        if( pos == start || pos == end || data_[pos] != '=' || tag == 0 || tag > UINT32_MAX )
+        {
+            return false;
+        }
+
+        TinyFixFieldRef& field = fields_[field_count_];
+        field.tag = static_cast<uint32_t>( tag );
+        field.offset = static_cast<uint32_t>( pos + 1 );
+        field.length = static_cast<uint32_t>( end - pos - 1 );
+        field_count_++;
+        if( tag < DIRECT_INDEX_SIZE && index_[tag] == 0 )
+        {
+            index_[tag] = field_count_;
+        }
+        return true;
+    }
+
+    const TinyFixFieldRef* find( uint32_t tag ) const
+    {
+        if( tag < DIRECT_INDEX_SIZE )
+        {
+            return index_[tag] == 0 ? nullptr : &fields_[index_[tag] - 1];
+        }
+        for( uint16_t i = 0; i < field_count_; i++ )
+        {
+            if( fields_[i].tag == tag )
+            {
+                return &fields_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const char*     data_;
+    size_t          data_len_;
+    uint16_t        field_count_;
+    uint16_t        index_[DIRECT_INDEX_SIZE]; // field position + 1, 0 means absent
+    TinyFixFieldRef fields_[MAX_FIELDS];
+};
 
 } // namespace TinyFix
\ No newline at end of file
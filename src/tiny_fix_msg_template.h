@@ -0,0 +1,316 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+#include <stdint.h>
+#include <string.h>
+
+#include "tiny_fix_utils.h"
+
+namespace TinyFix {
+
+// a variable field of a message template, always rendered with exactly width chars;
+// string values have to be that long already, see TinyFixMsgTemplate
+struct TinyFixSlot
+{
+    uint32_t tag;
+    uint16_t width;
+};
+
+// Example schema. A schema declares at compile time everything that never changes
+// for a message type, and the fixed width slots that are rewritten on every send:
+//   BEGIN_STRING, MSG_TYPE: the constant header fields
+//   SLOTS: the variable fields in wire order; SLOTS[0] must be MsgSeqNum(34)
+//   SIZE: capacity of the rendered message, checked at init()
+struct NewOrderSingleTemplateSchema
+{
+    static constexpr std::string_view BEGIN_STRING = "FIX.4.4";
+    static constexpr std::string_view MSG_TYPE = "D";
+    static constexpr uint16_t         SIZE = 512;
+
+    enum Slot : uint8_t
+    {
+        MsgSeqNum,
+        SendingTime,
+        ClOrdID,
+        Side,
+        TransactTime,
+        OrderQty,
+        OrdType,
+        Price,
+    };
+    static constexpr std::array<TinyFixSlot, 8> SLOTS = { {
+        { 34, 9 },  // MsgSeqNum
+        { 52, 21 }, // SendingTime, YYYYMMDD-HH:MM:SS.sss
+        { 11, 16 }, // ClOrdID
+        { 54, 1 },  // Side
+        { 60, 21 }, // TransactTime
+        { 38, 10 }, // OrderQty
+        { 40, 1 },  // OrdType
+        { 44, 12 }, // Price
+    } };
+};
+
+struct OrderCancelRequestTemplateSchema
+{
+    static constexpr std::string_view BEGIN_STRING = "FIX.4.4";
+    static constexpr std::string_view MSG_TYPE = "F";
+    static constexpr uint16_t         SIZE = 512;
+
+    enum Slot : uint8_t
+    {
+        MsgSeqNum,
+        SendingTime,
+        OrigClOrdID,
+        ClOrdID,
+        Side,
+        TransactTime,
+    };
+    static constexpr std::array<TinyFixSlot, 6> SLOTS = { {
+        { 34, 9 },  // MsgSeqNum
+        { 52, 21 }, // SendingTime
+        { 41, 16 }, // OrigClOrdID
+        { 11, 16 }, // ClOrdID
+        { 54, 1 },  // Side
+        { 60, 21 }, // TransactTime
+    } };
+};
+
+// Pre-rendered message for the highest rate order types.
+// init() renders the whole message once per session: BeginString, BodyLength,
+// MsgType, the session's CompIDs and every slot zero filled. Since all slots have a
+// fixed width BodyLength never changes, so a send is a memcpy of the template plus
+// a few fixed position writes and a CheckSum over the bytes that changed.
+// Numeric slots are zero padded on the left, which FIX int/float/Qty/Price fields
+// allow. String slots are not padded, a trailing space would change the value: a
+// string must be exactly the slot width, so size the slot to ids of a fixed length
+// (e.g. zero padded counters) or use TinyFixMsgBase for free form fields. A value
+// that doesn't fit is rejected rather than truncated or padded, see Writer.
+template<typename TinyFixMsgSchemaT>
+class TinyFixMsgTemplate
+{
+public:
+    static constexpr std::string_view BEGIN_STRING = TinyFixMsgSchemaT::BEGIN_STRING;
+    static constexpr std::string_view MSG_TYPE = TinyFixMsgSchemaT::MSG_TYPE;
+    static constexpr uint16_t         SIZE = TinyFixMsgSchemaT::SIZE;
+    static constexpr auto&            SLOTS = TinyFixMsgSchemaT::SLOTS;
+    static constexpr size_t           NUM_SLOTS = SLOTS.size();
+
+    static_assert( NUM_SLOTS > 0 && SLOTS[0].tag == 34, "first slot must be MsgSeqNum(34)" );
+    static_assert( NUM_SLOTS <= 64, "a template has at most 64 slots" );
+
+    TinyFixMsgTemplate()
+        : size_( 0 )
+        , template_sum_( 0 )
+    {
+    }
+
+    TinyFixMsgTemplate( const TinyFixMsgTemplate& ) = delete;
+    TinyFixMsgTemplate& operator=( const TinyFixMsgTemplate& ) = delete;
+
+    // renders the constant part of the message, once per session
+    bool init( std::string_view sender_comp_id, std::string_view target_comp_id )
+    {
+        // body: 35=.. 49=.. 56=.. then the slots, in that order
+        size_t body_len = field_size( 35, MSG_TYPE.size() ) +
+                          field_size( 49, sender_comp_id.size() ) +
+                          field_size( 56, target_comp_id.size() );
+        for( const TinyFixSlot& slot : SLOTS )
+        {
+            body_len += field_size( slot.tag, slot.width );
+        }
+        size_t header_len = 2 + BEGIN_STRING.size() + 1 + 2 + countDigits( body_len ) + 1;
+        if( header_len + body_len + 7 > SIZE )
+        {
+            return false;
+        }
+
+        char* p = data_;
+        p = put_field( p, 8, BEGIN_STRING );
+        p = put_tag( p, 9 );
+        p += formatUInt( p, body_len );
+        *p++ = SOH;
+        p = put_field( p, 35, MSG_TYPE );
+        p = put_field( p, 49, sender_comp_id );
+        p = put_field( p, 56, target_comp_id );
+        for( size_t i = 0; i < NUM_SLOTS; i++ )
+        {
+            p = put_tag( p, SLOTS[i].tag );
+            offsets_[i] = static_cast<uint16_t>( p - data_ );
+            ::memset( p, '0', SLOTS[i].width );
+            p += SLOTS[i].width;
+            *p++ = SOH;
+        }
+        checksum_pos_ = static_cast<uint16_t>( p - data_ );
+        ::memcpy( p, "10=000", 6 );
+        p[6] = SOH;
+        size_ = static_cast<uint16_t>( checksum_pos_ + 7 );
+        template_sum_ = byteSum( data_, checksum_pos_ );
+        return true;
+    }
+
+    uint16_t size() const
+    {
+        return size_;
+    }
+
+    uint16_t slot_offset( size_t slot ) const
+    {
+        return offsets_[slot];
+    }
+
+    // Per message writer over a copy of the template. Every slot that is set
+    // adjusts the CheckSum by the difference to the template bytes, finish()
+    // writes it. Every slot must be set exactly to its width: a value that does
+    // not fit, or a slot left with its zero filled template bytes, fails the
+    // message and finish() returns 0.
+    class Writer
+    {
+    public:
+        Writer( const TinyFixMsgTemplate& tmpl, char* dst )
+            : tmpl_( tmpl )
+            , dst_( dst )
+            , sum_( tmpl.template_sum_ )
+            , set_( 0 )
+            , failed_( false )
+        {
+            ::memcpy( dst_, tmpl_.data_, tmpl_.size_ );
+        }
+
+        Writer& set_uint( size_t slot, uint64_t value )
+        {
+            uint16_t width = SLOTS[slot].width;
+            if( countDigits( value ) > width )
+            {
+                return fail();
+            }
+            char* p = begin( slot );
+            formatUIntFixed( p, value, width );
+            return end( slot, p );
+        }
+
+        // non negative mantissa * 10^-scale, zero padded to the slot width
+        Writer& set_decimal( size_t slot, uint64_t mantissa, uint8_t scale )
+        {
+            uint16_t width = SLOTS[slot].width;
+            if( scale == 0 )
+            {
+                return set_uint( slot, mantissa );
+            }
+            if( scale > MAX_DECIMAL_SCALE || scale + 2 > width )
+            {
+                return fail();
+            }
+            uint64_t divisor = 1;
+            for( uint8_t i = 0; i < scale; i++ )
+            {
+                divisor *= 10;
+            }
+            size_t int_width = width - scale - 1;
+            if( countDigits( mantissa / divisor ) > int_width )
+            {
+                return fail();
+            }
+            char* p = begin( slot );
+            formatUIntFixed( p, mantissa / divisor, int_width );
+            p[int_width] = '.';
+            formatUIntFixed( p + int_width + 1, mantissa % divisor, scale );
+            return end( slot, p );
+        }
+
+        // value has to be exactly the slot width
+        Writer& set_string( size_t slot, std::string_view value )
+        {
+            if( value.size() != SLOTS[slot].width )
+            {
+                return fail();
+            }
+            char* p = begin( slot );
+            ::memcpy( p, value.data(), value.size() );
+            return end( slot, p );
+        }
+
+        Writer& set_char( size_t slot, char value )
+        {
+            return set_string( slot, std::string_view( &value, 1 ) );
+        }
+
+        // returns the message size, or 0 if a value did not fit or a slot was not set
+        uint16_t finish()
+        {
+            if( failed_ || set_ != ALL_SLOTS )
+            {
+                return 0;
+            }
+            formatUIntFixed( dst_ + tmpl_.checksum_pos_ + 3, sum_ & 0xFF, 3 );
+            return tmpl_.size_;
+        }
+
+    private:
+        static constexpr uint64_t ALL_SLOTS =
+            NUM_SLOTS == 64 ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << NUM_SLOTS ) - 1;
+
+        Writer& fail()
+        {
+            failed_ = true;
+            return *this;
+        }
+
+        // slot bytes about to be rewritten, taken out of the CheckSum
+        char* begin( size_t slot )
+        {
+            char* p = dst_ + tmpl_.offsets_[slot];
+            sum_ -= byteSum( p, SLOTS[slot].width );
+            return p;
+        }
+
+        Writer& end( size_t slot, const char* p )
+        {
+            sum_ += byteSum( p, SLOTS[slot].width );
+            set_ |= uint64_t( 1 ) << slot;
+            return *this;
+        }
+
+        const TinyFixMsgTemplate& tmpl_;
+        char* const               dst_;
+        uint32_t                  sum_;
+        uint64_t                  set_;
+        bool                      failed_;
+    };
+
+    // dst must hold size() bytes
+    Writer render( char* dst ) const
+    {
+        return Writer( *this, dst );
+    }
+
+private:
+    static size_t field_size( uint32_t tag, size_t value_len )
+    {
+        return countDigits( tag ) + 1 + value_len + 1;
+    }
+
+    static char* put_tag( char* p, uint32_t tag )
+    {
+        p += formatUInt( p, tag );
+        *p++ = '=';
+        return p;
+    }
+
+    static char* put_field( char* p, uint32_t tag, std::string_view value )
+    {
+        p = put_tag( p, tag );
+        ::memcpy( p, value.data(), value.size() );
+        p += value.size();
+        *p++ = SOH;
+        return p;
+    }
+
+    char     data_[SIZE];
+    uint16_t offsets_[NUM_SLOTS];
+    uint16_t checksum_pos_;
+    uint16_t size_;
+    uint32_t template_sum_;
+};
+
+} // namespace TinyFix
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#if defined( __SSE2__ ) || defined( __AVX2__ )
+#include <immintrin.h>
+#endif
+
+namespace TinyFix {
+
+constexpr char SOH = '\x01';
+
+// bit i of the result is set if p[i] == c, for the first min(len, 32) bytes of p.
+// bytes past len are never read.
+inline uint32_t byteMask32( const char* p, size_t len, char c )
+{
+    if( len < 32 )
+    {
+        uint32_t mask = 0;
+        for( size_t i = 0; i < len; i++ )
+        {
+            mask |= static_cast<uint32_t>( p[i] == c ) << i;
+        }
+        return mask;
+    }
+#if defined( __AVX2__ )
+    const __m256i chunk = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+    return static_cast<uint32_t>(
+        _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, _mm256_set1_epi8( c ) ) ) );
+#elif defined( __SSE2__ )
+    const __m128i needle = _mm_set1_epi8( c );
+    const __m128i lo = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+    const __m128i hi = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + 16 ) );
+    return static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( lo, needle ) ) ) |
+           ( static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( hi, needle ) ) ) << 16 );
+#else
+    uint32_t mask = 0;
+    for( size_t i = 0; i < 32; i++ )
+    {
+        mask |= static_cast<uint32_t>( p[i] == c ) << i;
+    }
+    return mask;
+#endif
+}
+
+// first occurrence of c in [begin, end), or end
+inline const char* findByte( const char* begin, const char* end, char c )
+{
+    while( begin < end )
+    {
+        uint32_t mask = byteMask32( begin, static_cast<size_t>( end - begin ), c );
+        if( mask != 0 )
+        {
+            return begin + __builtin_ctz( mask );
+        }
+        begin += 32;
+    }
+    return end;
+}
+
+// sum of the unsigned byte values in [p, p + len), the basis of the FIX CheckSum
+inline uint32_t byteSum( const char* p, size_t len )
+{
+    uint64_t sum = 0;
+    size_t   i = 0;
+#if defined( __AVX2__ )
+    __m256i acc = _mm256_setzero_si256();
+    for( ; i + 32 <= len; i += 32 )
+    {
+        const __m256i chunk = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p + i ) );
+        acc = _mm256_add_epi64( acc, _mm256_sad_epu8( chunk, _mm256_setzero_si256() ) );
+    }
+    sum += static_cast<uint64_t>( _mm256_extract_epi64( acc, 0 ) ) +
+           static_cast<uint64_t>( _mm256_extract_epi64( acc, 1 ) ) +
+           static_cast<uint64_t>( _mm256_extract_epi64( acc, 2 ) ) +
+           static_cast<uint64_t>( _mm256_extract_epi64( acc, 3 ) );
+#endif
+#if defined( __SSE2__ )
+    __m128i acc128 = _mm_setzero_si128();
+    for( ; i + 16 <= len; i += 16 )
+    {
+        const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + i ) );
+        acc128 = _mm_add_epi64( acc128, _mm_sad_epu8( chunk, _mm_setzero_si128() ) );
+    }
+    sum += static_cast<uint64_t>( _mm_cvtsi128_si64( acc128 ) ) +
+           static_cast<uint64_t>( _mm_cvtsi128_si64( _mm_unpackhi_epi64( acc128, acc128 ) ) );
+#endif
+    for( ; i < len; i++ )
+    {
+        sum += static_cast<uint8_t>( p[i] );
+    }
+    return static_cast<uint32_t>( sum );
+}
+
+// parses an optionally signed decimal integer that spans exactly [p, p + len)
+inline bool parseInt( const char* p, size_t len, int64_t& value )
+{
+    if( len == 0 )
+    {
+        return false;
+    }
+    bool negative = false;
+    if( *p == '-' || *p == '+' )
+    {
+        negative = *p == '-';
+        p++;
+        len--;
+        if( len == 0 )
+        {
+            return false;
+        }
+    }
+    if( len > 18 )
+    {
+        return false;
+    }
+    uint64_t res = 0;
+    for( size_t i = 0; i < len; i++ )
+    {
+        uint8_t digit = static_cast<uint8_t>( p[i] - '0' );
+        if( digit > 9 )
+        {
+            return false;
+        }
+        res = res * 10 + digit;
+    }
+    value = negative ? -static_cast<int64_t>( res ) : static_cast<int64_t>( res );
+    return true;
+}
+
+constexpr char DIGIT_PAIRS[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+
+inline size_t countDigits( uint64_t value )
+{
+    size_t digits = 1;
+    for( ;; )
+    {
+        if( value < 10 )
+            return digits;
+        if( value < 100 )
+            return digits + 1;
+        if( value < 1000 )
+            return digits + 2;
+        if( value < 10000 )
+            return digits + 3;
+        value /= 10000;
+        digits += 4;
+    }
+}
+
+// writes exactly width digits ending at dst + width, zero padded on the left.
+// the most significant digits are dropped if value does not fit.
+inline void formatUIntFixed( char* dst, uint64_t value, size_t width )
+{
+    char* p = dst + width;
+    while( p - dst >= 2 )
+    {
+        const char* pair = DIGIT_PAIRS + ( value % 100 ) * 2;
+        value /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if( p != dst )
+    {
+        *--p = static_cast<char>( '0' + value % 10 );
+    }
+}
+
+// writes value in decimal without a terminator and returns the number of chars written
+inline size_t formatUInt( char* dst, uint64_t value )
+{
+    size_t digits = countDigits( value );
+    formatUIntFixed( dst, value, digits );
+    return digits;
+}
+
+inline size_t formatInt( char* dst, int64_t value )
+{
+    if( value < 0 )
+    {
+        *dst = '-';
+        return formatUInt( dst + 1, 0 - static_cast<uint64_t>( value ) ) + 1;
+    }
+    return formatUInt( dst, static_cast<uint64_t>( value ) );
+}
+
+// largest scale formatDecimal accepts, 10^18 is the largest power of ten in a uint64_t
+constexpr uint8_t MAX_DECIMAL_SCALE = 18;
+
+// writes mantissa * 10^-scale, e.g. (12345, 2) -> "123.45", (-5, 3) -> "-0.005".
+// scale must not exceed MAX_DECIMAL_SCALE.
+inline size_t formatDecimal( char* dst, int64_t mantissa, uint8_t scale )
+{
+    if( scale == 0 )
+    {
+        return formatInt( dst, mantissa );
+    }
+    char* p = dst;
+    if( mantissa < 0 )
+    {
+        *p++ = '-';
+    }
+    uint64_t abs = mantissa < 0 ? 0 - static_cast<uint64_t>( mantissa ) : mantissa;
+    size_t   digits = countDigits( abs );
+    size_t   int_digits = digits > scale ? digits - scale : 1;
+    // integer part, then the fraction zero padded to scale digits
+    uint64_t divisor = 1;
+    for( uint8_t i = 0; i < scale; i++ )
+    {
+        divisor *= 10;
+    }
+    formatUIntFixed( p, abs / divisor, int_digits );
+    p += int_digits;
+    *p++ = '.';
+    formatUIntFixed( p, abs % divisor, scale );
+    p += scale;
+    return static_cast<size_t>( p - dst );
+}
+
+// Formats CLOCK_REALTIME as a FIX UTCTimestamp, "YYYYMMDD-HH:MM:SS.sss".
+// The date and time part is cached and only rebuilt when the second changes, so the
+// common case is a clock read, a memcpy and three digits.
+class UtcTimestampFormatter
+{
+public:
+    static constexpr size_t SIZE = 21;
+
+    UtcTimestampFormatter()
+        : m_second( -1 )
+    {
+    }
+
+    // writes exactly SIZE chars, no terminator
+    void format( char* dst )
+    {
+        struct timespec now;
+        ::clock_gettime( CLOCK_REALTIME, &now );
+        format( dst, now );
+    }
+
+    void format( char* dst, const struct timespec& now )
+    {
+        if( now.tv_sec != m_second )
+        {
+            struct tm tm;
+            ::gmtime_r( &now.tv_sec, &tm );
+            formatUIntFixed( m_prefix, static_cast<uint64_t>( tm.tm_year + 1900 ), 4 );
+            formatUIntFixed( m_prefix + 4, static_cast<uint64_t>( tm.tm_mon + 1 ), 2 );
+            formatUIntFixed( m_prefix + 6, static_cast<uint64_t>( tm.tm_mday ), 2 );
+            m_prefix[8] = '-';
+            formatUIntFixed( m_prefix + 9, static_cast<uint64_t>( tm.tm_hour ), 2 );
+            m_prefix[11] = ':';
+            formatUIntFixed( m_prefix + 12, static_cast<uint64_t>( tm.tm_min ), 2 );
+            m_prefix[14] = ':';
+            formatUIntFixed( m_prefix + 15, static_cast<uint64_t>( tm.tm_sec ), 2 );
+            m_prefix[17] = '.';
+            m_second = now.tv_sec;
+        }
+        ::memcpy( dst, m_prefix, sizeof( m_prefix ) );
+        formatUIntFixed( dst + sizeof( m_prefix ), static_cast<uint64_t>( now.tv_nsec / 1000000 ), 3 );
+    }
+
+private:
+    time_t m_second;
+    char   m_prefix[18];
+};
+
+} // namespace TinyFix